@@ -9,4 +9,5 @@
 #define SKYRIM64_USE_VFS			0	// Enable virtual file system
 #define SKYRIM64_USE_PROFILER		0	// Enable built-in profiler macros / "profiler.h"
 #define SKYRIM64_USE_TRACY			0	// Enable tracy client + server / https://bitbucket.org/wolfpld/tracy/overview
-#define SKYRIM64_USE_PAGE_HEAP		0	// Treat every memory allocation as a separate page (4096 bytes) for debugging
\ No newline at end of file
+#define SKYRIM64_USE_PAGE_HEAP		0	// Treat every memory allocation as a separate page (4096 bytes) for debugging
+#define SKYRIM64_USE_SMALLBLOCK_HEAP	1	// Route small allocations through size-class slabs and ScrapHeap through per-thread bump arenas
\ No newline at end of file
@@ -55,6 +55,27 @@ public:
 		m_uiRefCount = (HandleIndex << HANDLE_BIT_INDEX) | (1u << ACTIVE_BIT_INDEX) | QRefCount();
 	}
 
+	bool TrySetHandleEntryIndex(uint32_t HandleIndex)
+	{
+		// Ref count bits change concurrently, so this has to be a CAS. Fails if another thread
+		// attached a handle first.
+		uint32_t oldValue = m_uiRefCount;
+
+		for (;;)
+		{
+			if (oldValue & (1u << ACTIVE_BIT_INDEX))
+				return false;
+
+			uint32_t newValue = (HandleIndex << HANDLE_BIT_INDEX) | (1u << ACTIVE_BIT_INDEX) | (oldValue & REF_COUNT_MASK);
+			uint32_t prevValue = InterlockedCompareExchange(&m_uiRefCount, newValue, oldValue);
+
+			if (prevValue == oldValue)
+				return true;
+
+			oldValue = prevValue;
+		}
+	}
+
 	uint32_t QHandleEntryIndex() const
 	{
 		return m_uiRefCount >> HANDLE_BIT_INDEX;
@@ -62,7 +83,7 @@ public:
 
 	void ClearHandleEntryIndex()
 	{
-		m_uiRefCount &= REF_COUNT_MASK;
+		_InterlockedAnd((volatile long *)&m_uiRefCount, REF_COUNT_MASK);
 	}
 
 	bool IsHandleValid() const
@@ -5,28 +5,46 @@ template class BSPointerHandleManager<>;
 template class BSPointerHandleManagerInterface<>;
 
 template<typename HandleType>
-void BSPointerHandleManager<HandleType>::InitSDM()
+BSPointerHandleManager<HandleType>::ThreadHandleCache::~ThreadHandleCache()
 {
-	FreeListHead = 0;
-	HandleEntries.resize(HandleType::MAX_HANDLE_COUNT);
-
-	for (uint32_t i = 0; i < HandleType::MAX_HANDLE_COUNT; i++)
+	// Give everything back to the shared list or the indices are lost for good
+	if (Generation == CacheGeneration.load())
 	{
-		if ((i + 1) >= HandleType::MAX_HANDLE_COUNT)
-			HandleEntries[i].SetNextFreeEntry(i);
-		else
-			HandleEntries[i].SetNextFreeEntry(i + 1);
+		RetireEntries(Retired, RetiredCount);
+
+		for (; NextFresh < FreshEnd; NextFresh++)
+			RetireEntries(&NextFresh, 1);
 	}
 
-	FreeListTail = HandleType::MAX_HANDLE_COUNT - 1;
+	RetiredCount = 0;
+	Released = true;
+}
+
+template<typename HandleType>
+void BSPointerHandleManager<HandleType>::InitSDM()
+{
+	if (HandleEntries)
+		return;
+
+	// Only reserve address space here. Pages are committed as handles are created.
+	HandleEntries = (Entry *)VirtualAlloc(nullptr, HandleType::MAX_HANDLE_COUNT * sizeof(Entry), MEM_RESERVE, PAGE_NOACCESS);
+	AssertMsg(HandleEntries, "BSPointerHandleManager::InitSDM - Failed to reserve handle array memory");
+
+	FreeListHead = FREE_LIST_EMPTY;
+	RetiredListHead = FREE_LIST_EMPTY;
+	RetiredCount = 0;
+	NextUnusedEntry = 1;
+	CommittedEntries = 0;
+
+	CommitEntries(0);
 }
 
 template<typename HandleType>
 void BSPointerHandleManager<HandleType>::KillSDM()
 {
-	HandleManagerLock.LockForWrite();
+	const uint32_t highWater = std::min(NextUnusedEntry.load(), CommittedEntries.load());
 
-	for (uint32_t i = 0; i < HandleType::MAX_HANDLE_COUNT; i++)
+	for (uint32_t i = 1; i < highWater; i++)
 	{
 		auto& arrayHandle = HandleEntries[i];
 
@@ -38,17 +56,243 @@ void BSPointerHandleManager<HandleType>::KillSDM()
 
 		arrayHandle.SetPointer(nullptr);
 		arrayHandle.SetNotInUse();
+	}
+
+	// Every entry is free again. Hand them out from the bottom of the table and invalidate all
+	// thread caches. Ages are kept so stale handles still fail validation.
+	FreeListHead = FREE_LIST_EMPTY;
+	RetiredListHead = FREE_LIST_EMPTY;
+	RetiredCount = 0;
+	NextUnusedEntry = 1;
+	CacheGeneration++;
+}
+
+template<typename HandleType>
+typename BSPointerHandleManager<HandleType>::Entry *BSPointerHandleManager<HandleType>::GetEntry(uint32_t Index)
+{
+	// Indices past the committed range can't belong to a live handle
+	if (Index >= CommittedEntries.load(std::memory_order_acquire))
+		return nullptr;
+
+	return &HandleEntries[Index];
+}
+
+template<typename HandleType>
+bool BSPointerHandleManager<HandleType>::CommitEntries(uint32_t Index)
+{
+	bool result = true;
+
+	AcquireSRWLockExclusive(&CommitLock);
+	{
+		const uint32_t committed = CommittedEntries.load(std::memory_order_relaxed);
+
+		if (Index >= committed)
+		{
+			const uint32_t newCommitted = std::min(((Index / COMMIT_ENTRY_COUNT) + 1) * COMMIT_ENTRY_COUNT, HandleType::MAX_HANDLE_COUNT);
+
+			// Fresh pages are zeroed, which is a valid unused entry
+			if (VirtualAlloc(&HandleEntries[committed], (newCommitted - committed) * sizeof(Entry), MEM_COMMIT, PAGE_READWRITE))
+				CommittedEntries.store(newCommitted, std::memory_order_release);
+			else
+				result = false;
+		}
+	}
+	ReleaseSRWLockExclusive(&CommitLock);
+
+	return result;
+}
+
+template<typename HandleType>
+void BSPointerHandleManager<HandleType>::PushList(std::atomic<uint64_t>& Head, uint32_t First, uint32_t Last)
+{
+	auto& last = HandleEntries[Last];
+	uint64_t head = Head.load(std::memory_order_relaxed);
+	uint64_t newHead;
+
+	do
+	{
+		// The final entry points to itself
+		const uint32_t headIndex = (uint32_t)head;
+
+		last.SetNextFreeEntry(headIndex == FREE_LIST_EMPTY ? Last : headIndex);
+		newHead = (((head >> 32) + 1) << 32) | First;
+	} while (!Head.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+template<typename HandleType>
+uint32_t BSPointerHandleManager<HandleType>::PopList(std::atomic<uint64_t>& Head)
+{
+	uint64_t head = Head.load(std::memory_order_acquire);
+
+	for (;;)
+	{
+		const uint32_t index = (uint32_t)head;
+
+		if (index == FREE_LIST_EMPTY)
+			return FREE_LIST_EMPTY;
+
+		// The next index may be garbage if another thread popped this entry first. The tag makes
+		// the CAS fail in that case.
+		const uint32_t next = HandleEntries[index].QNextFreeEntry();
+		const uint64_t newHead = (((head >> 32) + 1) << 32) | (next == index ? FREE_LIST_EMPTY : next);
+
+		if (Head.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+			return index;
+	}
+}
+
+template<typename HandleType>
+void BSPointerHandleManager<HandleType>::RetireEntries(const uint32_t *Indices, uint32_t Count)
+{
+	if (Count == 0)
+		return;
+
+	// Link the batch privately, then splice it in with a single CAS
+	for (uint32_t i = 0; i < Count - 1; i++)
+		HandleEntries[Indices[i]].SetNextFreeEntry(Indices[i + 1]);
+
+	// Count first so a concurrent RecycleRetiredList() can't take the counter below zero
+	RetiredCount += Count;
+	PushList(RetiredListHead, Indices[0], Indices[Count - 1]);
+}
+
+template<typename HandleType>
+bool BSPointerHandleManager<HandleType>::RecycleRetiredList(uint32_t MinCount)
+{
+	if (RetiredCount.load(std::memory_order_relaxed) < MinCount)
+		return false;
+
+	// Detach the entire retired list. Nobody else can see the chain after this.
+	uint64_t head = RetiredListHead.load(std::memory_order_acquire);
+
+	do
+	{
+		if ((uint32_t)head == FREE_LIST_EMPTY)
+			return false;
+	} while (!RetiredListHead.compare_exchange_weak(head, (((head >> 32) + 1) << 32) | FREE_LIST_EMPTY, std::memory_order_acquire, std::memory_order_acquire));
+
+	const uint32_t first = (uint32_t)head;
+	uint32_t last = first;
+	uint32_t count = 1;
+
+	for (uint32_t next; (next = HandleEntries[last].QNextFreeEntry()) != last; count++)
+		last = next;
+
+	RetiredCount -= count;
+	PushList(FreeListHead, first, last);
+	return true;
+}
+
+template<typename HandleType>
+typename BSPointerHandleManager<HandleType>::ThreadHandleCache *BSPointerHandleManager<HandleType>::GetThreadCache()
+{
+	auto& cache = ThreadCache;
+
+	// Thread is shutting down
+	if (cache.Released)
+		return nullptr;
+
+	// KillSDM() reset the table, anything cached is stale
+	if (const uint32_t generation = CacheGeneration.load(std::memory_order_relaxed); cache.Generation != generation)
+	{
+		cache.Generation = generation;
+		cache.NextFresh = 0;
+		cache.FreshEnd = 0;
+		cache.RetiredCount = 0;
+	}
+
+	return &cache;
+}
+
+template<typename HandleType>
+uint32_t BSPointerHandleManager<HandleType>::AllocateEntry()
+{
+	ThreadHandleCache *cache = GetThreadCache();
+
+	for (;;)
+	{
+		if (uint32_t index = PopList(FreeListHead); index != FREE_LIST_EMPTY)
+			return index;
+
+		// Current generation is used up. Start the next one if it's big enough.
+		if (!RecycleRetiredList(MIN_RECYCLE_COUNT))
+			break;
+	}
+
+	if (cache && cache->NextFresh < cache->FreshEnd)
+		return cache->NextFresh++;
+
+	// Nothing to recycle: grow the table. Threads claim a small range at a time.
+	uint32_t index = NextUnusedEntry.load(std::memory_order_relaxed);
+
+	while (index < HandleType::MAX_HANDLE_COUNT)
+	{
+		const uint32_t count = cache ? std::min(CACHE_SIZE, HandleType::MAX_HANDLE_COUNT - index) : 1;
+
+		if (NextUnusedEntry.compare_exchange_weak(index, index + count))
+		{
+			if ((index + count - 1) >= CommittedEntries.load(std::memory_order_acquire) && !CommitEntries(index + count - 1))
+				return FREE_LIST_EMPTY;
+
+			if (cache)
+			{
+				cache->NextFresh = index + 1;
+				cache->FreshEnd = index + count;
+			}
+
+			return index;
+		}
+	}
+
+	// Table is full. Take whatever is left.
+	if (cache)
+	{
+		RetireEntries(cache->Retired, cache->RetiredCount);
+		cache->RetiredCount = 0;
+	}
 
-		if (FreeListTail == 0xFFFFFFFF)
-			FreeListHead = i;
-		else
-			HandleEntries[FreeListTail].SetNextFreeEntry(i);
+	do
+	{
+		if (uint32_t index = PopList(FreeListHead); index != FREE_LIST_EMPTY)
+			return index;
+	} while (RecycleRetiredList(0));
+
+	return FREE_LIST_EMPTY;
+}
+
+template<typename HandleType>
+void BSPointerHandleManager<HandleType>::ReleaseEntry(uint32_t Index)
+{
+	ThreadHandleCache *cache = GetThreadCache();
+
+	if (!cache)
+	{
+		RetireEntries(&Index, 1);
+		return;
+	}
 
-		arrayHandle.SetNextFreeEntry(i);
-		FreeListTail = i;
+	// Batch up releases so the shared list sees one CAS per CACHE_SIZE entries
+	cache->Retired[cache->RetiredCount++] = Index;
+
+	if (cache->RetiredCount >= CACHE_SIZE)
+	{
+		RetireEntries(cache->Retired, cache->RetiredCount);
+		cache->RetiredCount = 0;
 	}
+}
+
+template<typename HandleType>
+void BSPointerHandleManager<HandleType>::DestroyEntry(uint32_t Index, uint32_t Age)
+{
+	Entry *arrayHandle = GetEntry(Index);
+
+	if (!arrayHandle || !arrayHandle->TryClaimForDestroy(Age))
+		return;
 
-	HandleManagerLock.UnlockWrite();
+	arrayHandle->GetPointer()->ClearHandleEntryIndex();
+	arrayHandle->SetPointer(nullptr);
+
+	ReleaseEntry(Index);
 }
 
 void HandleManager::KillSDM()
@@ -68,10 +312,14 @@ BSUntypedPointerHandle<> BSPointerHandleManagerInterface<ObjectType, Manager>::G
 
 	if (Refr && Refr->IsHandleValid())
 	{
-		auto& handle = HandleEntries[Refr->QHandleEntryIndex()];
-		untypedHandle.Set(Refr->QHandleEntryIndex(), handle.QAge());
-
-		AssertMsg(untypedHandle.QAge() == handle.QAge(), "BSPointerHandleManagerInterface::GetCurrentHandle - Handle already exists but has wrong age!");
+		const uint32_t handleIndex = Refr->QHandleEntryIndex();
+		auto& handle = HandleEntries[handleIndex];
+		untypedHandle.Set(handleIndex, handle.QAge());
+
+		// Without a lock the handle can be destroyed and the entry recycled between reading the
+		// index and the age. Never return a handle that resolves to another object.
+		if (handle.GetPointer() != Refr)
+			untypedHandle.SetBitwiseNull();
 	}
 
 	return untypedHandle;
@@ -91,47 +339,34 @@ BSUntypedPointerHandle<> BSPointerHandleManagerInterface<ObjectType, Manager>::C
 	if (untypedHandle != NullHandle)
 		return untypedHandle;
 
-	// Wasn't present. Acquire lock and add it (unless someone else inserted it in the meantime)
-	HandleManagerLock.LockForWrite();
+	const uint32_t handleIndex = AllocateEntry();
+
+	if (handleIndex == FREE_LIST_EMPTY)
 	{
-		untypedHandle = GetCurrentHandle(Refr);
+		untypedHandle.SetBitwiseNull();
+		AssertMsgVa(false, "OUT OF HANDLE ARRAY ENTRIES. Null handle created for pointer 0x%p.", Refr);
 
-		if (untypedHandle == NullHandle)
-		{
-			if (FreeListHead == 0xFFFFFFFF)
-			{
-				untypedHandle.SetBitwiseNull();
-				AssertMsgVa(false, "OUT OF HANDLE ARRAY ENTRIES. Null handle created for pointer 0x%p.", Refr);
-			}
-			else
-			{
-				auto& newHandle = HandleEntries[FreeListHead];
-				newHandle.IncrementAge();
-				newHandle.SetInUse();
-
-				untypedHandle.Set(newHandle.QNextFreeEntry(), newHandle.QAge());
-				newHandle.SetPointer(Refr);
-
-				Refr->SetHandleEntryIndex(FreeListHead);
-				Assert(Refr->QHandleEntryIndex() == FreeListHead);
-
-				if (newHandle.QNextFreeEntry() == FreeListHead)
-				{
-					// Table reached the maximum count
-					Assert(FreeListHead == FreeListTail);
-
-					FreeListHead = 0xFFFFFFFF;
-					FreeListTail = 0xFFFFFFFF;
-				}
-				else
-				{
-					Assert(FreeListHead != FreeListTail);
-					FreeListHead = newHandle.QNextFreeEntry();
-				}
-			}
-		}
+		return untypedHandle;
+	}
+
+	// The entry has to be complete before the index is published through the ref
+	auto& newHandle = HandleEntries[handleIndex];
+	newHandle.IncrementAge();
+	newHandle.SetPointer(Refr);
+	newHandle.SetInUse();
+
+	// Read the age before publishing. Afterwards other threads may already destroy and recycle it.
+	untypedHandle.Set(handleIndex, newHandle.QAge());
+
+	if (!Refr->TrySetHandleEntryIndex(handleIndex))
+	{
+		// Another thread created a handle for this ref in the meantime. Use theirs.
+		newHandle.SetNotInUse();
+		newHandle.SetPointer(nullptr);
+		ReleaseEntry(handleIndex);
+
+		return GetCurrentHandle(Refr);
 	}
-	HandleManagerLock.UnlockWrite();
 
 	return untypedHandle;
 }
@@ -142,27 +377,7 @@ void BSPointerHandleManagerInterface<ObjectType, Manager>::Destroy1(const BSUnty
 	if (Handle.IsBitwiseNull())
 		return;
 
-	HandleManagerLock.LockForWrite();
-	{
-		const uint32_t handleIndex = Handle.QIndex();
-		auto& arrayHandle = HandleEntries[handleIndex];
-
-		if (arrayHandle.IsValid(Handle.QAge()))
-		{
-			arrayHandle.GetPointer()->ClearHandleEntryIndex();
-			arrayHandle.SetPointer(nullptr);
-			arrayHandle.SetNotInUse();
-
-			if (FreeListTail == 0xFFFFFFFF)
-				FreeListHead = handleIndex;
-			else
-				HandleEntries[FreeListTail].SetNextFreeEntry(handleIndex);
-
-			arrayHandle.SetNextFreeEntry(handleIndex);
-			FreeListTail = handleIndex;
-		}
-	}
-	HandleManagerLock.UnlockWrite();
+	DestroyEntry(Handle.QIndex(), Handle.QAge());
 }
 
 template<typename ObjectType, typename Manager>
@@ -171,30 +386,10 @@ void BSPointerHandleManagerInterface<ObjectType, Manager>::Destroy2(BSUntypedPoi
 	if (Handle.IsBitwiseNull())
 		return;
 
-	HandleManagerLock.LockForWrite();
-	{
-		const uint32_t handleIndex = Handle.QIndex();
-		auto& arrayHandle = HandleEntries[handleIndex];
-
-		if (arrayHandle.IsValid(Handle.QAge()))
-		{
-			arrayHandle.GetPointer()->ClearHandleEntryIndex();
-			arrayHandle.SetPointer(nullptr);
-			arrayHandle.SetNotInUse();
-
-			if (FreeListTail == 0xFFFFFFFF)
-				FreeListHead = handleIndex;
-			else
-				HandleEntries[FreeListTail].SetNextFreeEntry(handleIndex);
+	DestroyEntry(Handle.QIndex(), Handle.QAge());
 
-			arrayHandle.SetNextFreeEntry(handleIndex);
-			FreeListTail = handleIndex;
-		}
-
-		// Identical to Destroy1 except for this Handle.SetBitwiseNull();
-		Handle.SetBitwiseNull();
-	}
-	HandleManagerLock.UnlockWrite();
+	// Identical to Destroy1 except for this Handle.SetBitwiseNull();
+	Handle.SetBitwiseNull();
 }
 
 template<typename ObjectType, typename Manager>
@@ -207,11 +402,17 @@ bool BSPointerHandleManagerInterface<ObjectType, Manager>::GetSmartPointer1(cons
 	}
 
 	const uint32_t handleIndex = Handle.QIndex();
-	auto& arrayHandle = HandleEntries[handleIndex];
+	auto arrayHandle = GetEntry(handleIndex);
+
+	if (!arrayHandle)
+	{
+		Out = nullptr;
+		return false;
+	}
 
-	Out = static_cast<TESObjectREFR_CK *>(arrayHandle.GetPointer());
+	Out = static_cast<TESObjectREFR_CK *>(arrayHandle->GetPointer());
 
-	if (!arrayHandle.IsValid(Handle.QAge()) || Out->QHandleEntryIndex() != handleIndex)
+	if (!arrayHandle->IsValid(Handle.QAge()) || Out->QHandleEntryIndex() != handleIndex)
 		Out = nullptr;
 
 	return Out != nullptr;
@@ -227,11 +428,12 @@ bool BSPointerHandleManagerInterface<ObjectType, Manager>::GetSmartPointer2(BSUn
 	}
 
 	const uint32_t handleIndex = Handle.QIndex();
-	auto& arrayHandle = HandleEntries[handleIndex];
+	auto arrayHandle = GetEntry(handleIndex);
 
-	Out = static_cast<TESObjectREFR_CK *>(arrayHandle.GetPointer());
+	if (arrayHandle)
+		Out = static_cast<TESObjectREFR_CK *>(arrayHandle->GetPointer());
 
-	if (!arrayHandle.IsValid(Handle.QAge()) || Out->QHandleEntryIndex() != handleIndex)
+	if (!arrayHandle || !arrayHandle->IsValid(Handle.QAge()) || Out->QHandleEntryIndex() != handleIndex)
 	{
 		// Identical to GetSmartPointer1 except for this Handle.SetBitwiseNull();
 		Handle.SetBitwiseNull();
@@ -245,12 +447,12 @@ template<typename ObjectType, typename Manager>
 bool BSPointerHandleManagerInterface<ObjectType, Manager>::IsValid(const BSUntypedPointerHandle<>& Handle)
 {
 	const uint32_t handleIndex = Handle.QIndex();
-	auto& arrayHandle = HandleEntries[handleIndex];
+	auto arrayHandle = GetEntry(handleIndex);
 
 	// Handle.IsBitwiseNull(); -- This if() is optimized away because the result is irrelevant
 
-	if (!arrayHandle.IsValid(Handle.QAge()))
+	if (!arrayHandle || !arrayHandle->IsValid(Handle.QAge()))
 		return false;
 
-	return arrayHandle.GetPointer()->QHandleEntryIndex() == handleIndex;
+	return arrayHandle->GetPointer()->QHandleEntryIndex() == handleIndex;
 }
\ No newline at end of file
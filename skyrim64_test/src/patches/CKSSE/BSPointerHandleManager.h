@@ -1,7 +1,7 @@
 #pragma once
 
+#include <atomic>
 #include "../TES/NiMain/NiPointer.h"
-#include "../TES/BSReadWriteLock.h"
 #include "TESForm_CK.h"
 
 template<int IndexBits = 21, int AgeCountBits = 6>
@@ -88,38 +88,54 @@ protected:
 	class Entry
 	{
 	private:
-		uint32_t m_EntryBits = 0;
+		std::atomic<uint32_t> m_EntryBits = 0;
 		NiPointer<BSHandleRefObject> m_Pointer;
 
 	public:
 		void SetInUse()
 		{
-			m_EntryBits |= HandleType::ACTIVE_BIT_MASK;
+			m_EntryBits.fetch_or(HandleType::ACTIVE_BIT_MASK);
 		}
 
 		void SetNotInUse()
 		{
-			m_EntryBits &= ~HandleType::ACTIVE_BIT_MASK;
+			m_EntryBits.fetch_and(~HandleType::ACTIVE_BIT_MASK);
 		}
 
 		bool IsInUse() const
 		{
-			return (m_EntryBits & HandleType::ACTIVE_BIT_MASK) != 0;
+			return (m_EntryBits.load(std::memory_order_acquire) & HandleType::ACTIVE_BIT_MASK) != 0;
+		}
+
+		bool TryClaimForDestroy(uint32_t Age)
+		{
+			// Exactly one thread wins when the same handle is destroyed concurrently
+			uint32_t bits = m_EntryBits.load();
+
+			do
+			{
+				if ((bits & HandleType::ACTIVE_BIT_MASK) == 0 || (bits & HandleType::AGE_MASK) != Age)
+					return false;
+			} while (!m_EntryBits.compare_exchange_weak(bits, bits & ~HandleType::ACTIVE_BIT_MASK));
+
+			return true;
 		}
 
 		void SetNextFreeEntry(uint32_t Index)
 		{
-			m_EntryBits = (Index & HandleType::INDEX_MASK) | (m_EntryBits & ~HandleType::INDEX_MASK);
+			// Index bits are only written by the thread owning a free entry
+			uint32_t bits = m_EntryBits.load(std::memory_order_relaxed);
+			m_EntryBits.store((Index & HandleType::INDEX_MASK) | (bits & ~HandleType::INDEX_MASK), std::memory_order_relaxed);
 		}
 
 		uint32_t QNextFreeEntry() const
 		{
-			return m_EntryBits & HandleType::INDEX_MASK;
+			return m_EntryBits.load(std::memory_order_relaxed) & HandleType::INDEX_MASK;
 		}
 
 		uint32_t QAge() const
 		{
-			return m_EntryBits & HandleType::AGE_MASK;
+			return m_EntryBits.load(std::memory_order_acquire) & HandleType::AGE_MASK;
 		}
 
 		void SetPointer(BSHandleRefObject *Pointer)
@@ -134,22 +150,67 @@ protected:
 
 		bool IsValid(uint32_t Age) const
 		{
-			return IsInUse() && QAge() == Age;
+			uint32_t bits = m_EntryBits.load(std::memory_order_acquire);
+			return (bits & HandleType::ACTIVE_BIT_MASK) != 0 && (bits & HandleType::AGE_MASK) == Age;
 		}
 
 		void IncrementAge()
 		{
-			m_EntryBits = ((m_EntryBits << HandleType::INDEX_BITS) & HandleType::AGE_MASK) | (m_EntryBits & ~HandleType::AGE_MASK);
+			uint32_t bits = m_EntryBits.load(std::memory_order_relaxed);
+			m_EntryBits.store(((bits + (1u << HandleType::INDEX_BITS)) & HandleType::AGE_MASK) | (bits & ~HandleType::AGE_MASK), std::memory_order_relaxed);
 		}
 	};
 	static_assert(sizeof(Entry) == 0x10);
 
-	inline static uint32_t FreeListHead;
-	inline static uint32_t FreeListTail;
-	inline static BSReadWriteLock HandleManagerLock;
-	inline static std::vector<Entry> HandleEntries;
+	//
+	// Entries live in one reserved range and pages are committed as the high water mark grows.
+	// Destroyed indices are batched per thread and spliced onto a global retired list. Allocation
+	// pops from the free list and only moves the retired list over once the free list is empty,
+	// so an index waits for a whole generation before it's reused. The 6 age bits wrap after 64
+	// reuses and a short LIFO would let stale handles resolve again. Both list heads pack a
+	// 32-bit ABA tag above the entry index.
+	//
+	// Index 0 is never handed out: a handle with index 0 and age 0 is bitwise null.
+	//
+	constexpr static uint32_t COMMIT_ENTRY_COUNT	= (64 * 1024) / sizeof(Entry);
+	constexpr static uint32_t FREE_LIST_EMPTY		= 0xFFFFFFFF;
+	constexpr static uint32_t MIN_RECYCLE_COUNT		= HandleType::MAX_HANDLE_COUNT / 8;	// Grow the table instead of recycling a smaller generation
+	constexpr static uint32_t CACHE_SIZE			= 64;
+
+	struct ThreadHandleCache
+	{
+		bool Released = false;
+		uint32_t Generation = 0;
+		uint32_t NextFresh = 0;				// Never used indices claimed from the high water mark
+		uint32_t FreshEnd = 0;
+		uint32_t RetiredCount = 0;
+		uint32_t Retired[CACHE_SIZE];
+
+		~ThreadHandleCache();
+	};
+
+	inline static Entry *HandleEntries;
+	inline static std::atomic<uint64_t> FreeListHead = FREE_LIST_EMPTY;
+	inline static std::atomic<uint64_t> RetiredListHead = FREE_LIST_EMPTY;
+	inline static std::atomic<uint32_t> RetiredCount;
+	inline static std::atomic<uint32_t> NextUnusedEntry = 1;
+	inline static std::atomic<uint32_t> CommittedEntries;
+	inline static std::atomic<uint32_t> CacheGeneration = 1;
+	inline static SRWLOCK CommitLock = SRWLOCK_INIT;
+	inline static thread_local ThreadHandleCache ThreadCache;
 	inline const static BSUntypedPointerHandle<> NullHandle;
 
+	static Entry *GetEntry(uint32_t Index);
+	static uint32_t AllocateEntry();
+	static void ReleaseEntry(uint32_t Index);
+	static void RetireEntries(const uint32_t *Indices, uint32_t Count);
+	static ThreadHandleCache *GetThreadCache();
+	static void PushList(std::atomic<uint64_t>& Head, uint32_t First, uint32_t Last);
+	static uint32_t PopList(std::atomic<uint64_t>& Head);
+	static bool RecycleRetiredList(uint32_t MinCount);
+	static bool CommitEntries(uint32_t Index);
+	static void DestroyEntry(uint32_t Index, uint32_t Age);
+
 public:
 	static void InitSDM();
 	static void KillSDM();
@@ -1,7 +1,10 @@
 #include "../../common.h"
-#include "../TES/MemoryManager.h"
+#include "../TES/RenderPassArena.h"
 #include "BSRenderPass_CK.h"
 
+// Passes are cached by shader properties and can live for many frames. They're freed one at a time.
+using PassArena = RenderPassArena<sizeof(BSRenderPass) + (sizeof(BSLight *) * BSRenderPass::MaxLightInArrayC)>;
+
 void BSRenderPass_CK::InitSDM()
 {
 	// Intentionally left empty
@@ -15,7 +18,9 @@ void BSRenderPass_CK::KillSDM()
 BSRenderPass_CK *BSRenderPass_CK::AllocatePass(BSShader *Shader, BSShaderProperty *ShaderProperty, BSGeometry *Geometry, uint32_t PassEnum, uint8_t NumLights, BSLight **SceneLights)
 {
 	uint32_t size = sizeof(BSRenderPass_CK) + (sizeof(BSLight *) * MaxLightInArrayC);
-	void *data = MemoryManager::Allocate(nullptr, size, 8, true);
+	void *data = PassArena::Allocate();
+
+	AssertMsg(data, "Out of memory for render passes");
 
 	memset(data, 0, size);
 
@@ -31,5 +36,5 @@ BSRenderPass_CK *BSRenderPass_CK::AllocatePass(BSShader *Shader, BSShaderPropert
 
 void BSRenderPass_CK::DeallocatePass(BSRenderPass_CK *Pass)
 {
-	MemoryManager::Deallocate(nullptr, Pass, true);
+	PassArena::Free(Pass);
 }
\ No newline at end of file
@@ -17,6 +17,7 @@
 #include "TESWater.h"
 #include "LogWindow.h"
 #include "MainWindow.h"
+#include "RecordDecompressor.h"
 
 #pragma comment(lib, "libdeflate.lib")
 
@@ -37,22 +38,59 @@ int hk_inflateInit(z_stream_s *Stream, const char *Version, int Mode)
 	// Force inflateEnd to error out and skip frees
 	Stream->state = nullptr;
 
+	RecordDecompressor::ReleasePendingInput(Stream);
 	return 0;
 }
 
 int hk_inflate(z_stream_s *Stream, int Flush)
 {
+	const int Z_FINISH = 4;
+
 	size_t outBytes = 0;
-	libdeflate_decompressor *decompressor = libdeflate_alloc_decompressor();
+	libdeflate_result result = LIBDEFLATE_SUCCESS;
+	bool chunked = false;
+
+	if (!RecordDecompressor::TakePrefetched(Stream->next_in, Stream->avail_in, Stream->next_out, Stream->avail_out, &outBytes))
+	{
+		const void *input = Stream->next_in;
+		size_t inputSize = Stream->avail_in;
+
+		// Earlier chunks of this stream are buffered, decompress everything seen so far
+		if (RecordDecompressor::ContinuePendingInput(Stream, Stream->next_in, Stream->avail_in, &input, &inputSize))
+			chunked = true;
+
+		result = RecordDecompressor::Decompress(input, inputSize, Stream->next_out, Stream->avail_out, &outBytes);
+
+		// libdeflate can't resume. A truncated stream looks like bad data, so keep it around until
+		// the caller says there's no more input. If it's still bad then, it fails below.
+		if (result == LIBDEFLATE_BAD_DATA && Flush != Z_FINISH && Stream->avail_in > 0)
+		{
+			if (!chunked)
+				RecordDecompressor::BeginPendingInput(Stream, Stream->next_in, Stream->avail_in);
 
-	libdeflate_result result = libdeflate_zlib_decompress(decompressor, Stream->next_in, Stream->avail_in, Stream->next_out, Stream->avail_out, &outBytes);
-	libdeflate_free_decompressor(decompressor);
+			Stream->next_in = (const uint8_t *)Stream->next_in + Stream->avail_in;
+			Stream->total_in += Stream->avail_in;
+			Stream->avail_in = 0;
+			return 0;
+		}
+
+		if (chunked)
+		{
+			Stream->total_in += Stream->avail_in;
+			Stream->avail_in = 0;
+		}
+	}
+
+	// The stream is finished either way, nothing gets resumed after this
+	RecordDecompressor::ReleasePendingInput(Stream);
 
 	if (result == LIBDEFLATE_SUCCESS)
 	{
 		Assert(outBytes < std::numeric_limits<uint32_t>::max());
 
-		Stream->total_in = Stream->avail_in;
+		if (!chunked)
+			Stream->total_in = Stream->avail_in;
+
 		Stream->total_out = (uint32_t)outBytes;
 
 		return 1;
@@ -0,0 +1,411 @@
+#include "../../common.h"
+#include <execution>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include "../TES/FlatScatterTable.h"
+#include "RecordDecompressor.h"
+#include "LogWindow.h"
+
+namespace RecordDecompressor
+{
+	const static uint32_t RecordHeaderSize	= 24;
+	const static uint32_t CompressedFlag	= 0x00040000;
+	const static size_t BatchSize			= 256;
+	const static size_t MaxRecordSize		= 64 * 1024 * 1024;
+	const static size_t MaxCachedBytes		= 256 * 1024 * 1024;
+	const static DWORD StallTimeout			= 5000;		// Milliseconds without the loader taking a record
+
+	struct DecompressorGuard
+	{
+		libdeflate_decompressor *Decompressor = nullptr;
+
+		~DecompressorGuard()
+		{
+			if (Decompressor)
+				libdeflate_free_decompressor(Decompressor);
+		}
+	};
+
+	struct MappedFile
+	{
+		HANDLE File = INVALID_HANDLE_VALUE;
+		HANDLE Mapping = nullptr;
+		const uint8_t *View = nullptr;
+		size_t Size = 0;
+
+		~MappedFile()
+		{
+			if (View)
+				UnmapViewOfFile(View);
+
+			if (Mapping)
+				CloseHandle(Mapping);
+
+			if (File != INVALID_HANDLE_VALUE)
+				CloseHandle(File);
+		}
+
+		bool Open(const char *FilePath)
+		{
+			File = CreateFileA(FilePath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+			if (File == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER fileSize;
+
+			if (!GetFileSizeEx(File, &fileSize) || fileSize.QuadPart < RecordHeaderSize)
+				return false;
+
+			Mapping = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+			if (!Mapping)
+				return false;
+
+			View = (const uint8_t *)MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+			Size = (size_t)fileSize.QuadPart;
+			return View != nullptr;
+		}
+	};
+
+	struct CachedRecord
+	{
+		std::shared_ptr<MappedFile> Source;		// Keeps Input mapped
+		const uint8_t *Input;
+		uint32_t InputSize;
+		std::unique_ptr<uint8_t[]> Output;
+		uint32_t OutputSize;
+		CachedRecord *Next;						// Other records with the same key
+	};
+
+	thread_local DecompressorGuard TLSDecompressor;
+	thread_local std::unordered_map<const void *, std::vector<uint8_t>> TLSPendingInput;
+
+	SRWLOCK CacheLock = SRWLOCK_INIT;
+	FlatScatterTable<uint64_t, CachedRecord *> Cache;
+	std::atomic_size_t CachedCount;
+	std::atomic_size_t CachedBytes;
+	std::atomic_uint32_t TakeCount;
+
+	std::mutex DrainMutex;
+	std::condition_variable DrainCondition;	// Signaled when a record is taken from a full cache
+
+	std::mutex QueueMutex;
+	std::condition_variable QueueCondition;
+	std::deque<std::string> FileQueue;
+	std::unordered_set<std::string> QueuedFiles;
+	bool WorkerStarted;
+
+	uint64_t GetCacheKey(const void *Input, size_t InputSize)
+	{
+		// Every zlib stream ends with the Adler-32 of its decompressed data
+		uint32_t adler;
+		memcpy(&adler, (const uint8_t *)Input + InputSize - sizeof(uint32_t), sizeof(uint32_t));
+
+		return ((uint64_t)InputSize << 32) | adler;
+	}
+
+	libdeflate_result Decompress(const void *Input, size_t InputSize, void *Output, size_t OutputSize, size_t *OutputBytes)
+	{
+		auto& guard = TLSDecompressor;
+
+		if (!guard.Decompressor)
+		{
+			guard.Decompressor = libdeflate_alloc_decompressor();
+			AssertMsg(guard.Decompressor, "Failed to allocate a libdeflate decompressor");
+		}
+
+		return libdeflate_zlib_decompress(guard.Decompressor, Input, InputSize, Output, OutputSize, OutputBytes);
+	}
+
+	void DecompressBatch(BatchEntry *Entries, size_t Count)
+	{
+		std::for_each(std::execution::par, Entries, Entries + Count, [](BatchEntry& Entry)
+		{
+			// Trust the stored size first, then double until the record fits
+			size_t capacity = std::max<size_t>(Entry.SizeHint, 64);
+			size_t outBytes = 0;
+
+			for (;;)
+			{
+				Entry.Output.reset(new uint8_t[capacity]);
+				Entry.Result = Decompress(Entry.Input, Entry.InputSize, Entry.Output.get(), capacity, &outBytes);
+
+				if (Entry.Result != LIBDEFLATE_INSUFFICIENT_SPACE || capacity >= MaxRecordSize)
+					break;
+
+				capacity *= 2;
+			}
+
+			Entry.OutputSize = (Entry.Result == LIBDEFLATE_SUCCESS) ? (uint32_t)outBytes : 0;
+		});
+	}
+
+	void BeginPendingInput(const void *Stream, const void *Input, size_t InputSize)
+	{
+		TLSPendingInput[Stream].assign((const uint8_t *)Input, (const uint8_t *)Input + InputSize);
+	}
+
+	bool ContinuePendingInput(const void *Stream, const void *Input, size_t InputSize, const void **Data, size_t *DataSize)
+	{
+		auto itr = TLSPendingInput.find(Stream);
+
+		if (itr == TLSPendingInput.end())
+			return false;
+
+		auto& buffer = itr->second;
+		buffer.insert(buffer.end(), (const uint8_t *)Input, (const uint8_t *)Input + InputSize);
+
+		*Data = buffer.data();
+		*DataSize = buffer.size();
+		return true;
+	}
+
+	void ReleasePendingInput(const void *Stream)
+	{
+		if (!TLSPendingInput.empty())
+			TLSPendingInput.erase(Stream);
+	}
+
+	void DropCache()
+	{
+		std::vector<CachedRecord *> records;
+
+		AcquireSRWLockExclusive(&CacheLock);
+		{
+			for (auto& entry : Cache)
+			{
+				for (CachedRecord *record = entry.second; record; record = record->Next)
+					records.push_back(record);
+			}
+
+			Cache.clear();
+			CachedCount = 0;
+			CachedBytes = 0;
+		}
+		ReleaseSRWLockExclusive(&CacheLock);
+
+		for (CachedRecord *record : records)
+			delete record;
+	}
+
+	bool FlushBatch(const std::shared_ptr<MappedFile>& Source, std::vector<BatchEntry>& Batch)
+	{
+		// Stay under the memory budget. If the loader stops consuming, whatever it skipped is
+		// never going to be used.
+		{
+			std::unique_lock<std::mutex> lock(DrainMutex);
+			uint32_t lastTakeCount = TakeCount.load();
+
+			while (CachedBytes.load() > MaxCachedBytes)
+			{
+				bool taken = DrainCondition.wait_for(lock, std::chrono::milliseconds(StallTimeout), [&]
+				{
+					return TakeCount.load() != lastTakeCount || CachedBytes.load() <= MaxCachedBytes;
+				});
+
+				if (!taken)
+				{
+					lock.unlock();
+
+					Batch.clear();
+					DropCache();
+					return false;
+				}
+
+				lastTakeCount = TakeCount.load();
+			}
+		}
+
+		DecompressBatch(Batch.data(), Batch.size());
+
+		AcquireSRWLockExclusive(&CacheLock);
+		{
+			for (auto& entry : Batch)
+			{
+				if (entry.Result != LIBDEFLATE_SUCCESS)
+					continue;
+
+				CachedRecord *& head = Cache[GetCacheKey(entry.Input, entry.InputSize)];
+				head = new CachedRecord{ Source, entry.Input, entry.InputSize, std::move(entry.Output), entry.OutputSize, head };
+
+				CachedCount++;
+				CachedBytes += entry.OutputSize;
+			}
+		}
+		ReleaseSRWLockExclusive(&CacheLock);
+
+		Batch.clear();
+		return true;
+	}
+
+	void PrefetchRecords(const char *FilePath)
+	{
+		auto file = std::make_shared<MappedFile>();
+
+		if (!file->Open(FilePath))
+			return;
+
+		std::vector<BatchEntry> batch;
+		batch.reserve(BatchSize);
+
+		uint32_t recordCount = 0;
+		auto timerStart = GetTickCount();
+
+		// Groups only have a header, their records follow it directly. That makes the whole file
+		// one flat list of records.
+		for (size_t offset = 0; offset + RecordHeaderSize <= file->Size;)
+		{
+			const uint8_t *header = file->View + offset;
+			uint32_t dataSize = *(const uint32_t *)(header + 4);
+			uint32_t flags = *(const uint32_t *)(header + 8);
+
+			if (!memcmp(header, "GRUP", 4))
+			{
+				offset += RecordHeaderSize;
+				continue;
+			}
+
+			if (offset + RecordHeaderSize + dataSize > file->Size)
+				break;
+
+			// Data is the decompressed size followed by the zlib stream
+			if ((flags & CompressedFlag) && dataSize > sizeof(uint32_t) + 6)
+			{
+				const uint8_t *data = header + RecordHeaderSize;
+
+				batch.push_back({ data + sizeof(uint32_t), dataSize - (uint32_t)sizeof(uint32_t), *(const uint32_t *)data });
+				recordCount++;
+
+				if (batch.size() >= BatchSize && !FlushBatch(file, batch))
+					return;
+			}
+
+			offset += RecordHeaderSize + dataSize;
+		}
+
+		if (!FlushBatch(file, batch))
+			return;
+
+		LogWindow::Log("Decompressed %u records from '%s' ahead of time in %u ms\n", recordCount, FilePath, GetTickCount() - timerStart);
+	}
+
+	void PrefetchWorker()
+	{
+		uint32_t lastTakeCount = 0;
+		DWORD idleStart = GetTickCount();
+
+		for (;;)
+		{
+			std::string filePath;
+
+			{
+				std::unique_lock<std::mutex> lock(QueueMutex);
+
+				if (!QueueCondition.wait_for(lock, std::chrono::seconds(1), [] { return !FileQueue.empty(); }))
+				{
+					// Loading finished and some records were never requested
+					if (uint32_t takeCount = TakeCount.load(); takeCount != lastTakeCount)
+					{
+						lastTakeCount = takeCount;
+						idleStart = GetTickCount();
+					}
+					else if (CachedCount.load() > 0 && GetTickCount() - idleStart > StallTimeout)
+					{
+						DropCache();
+					}
+
+					continue;
+				}
+
+				filePath = std::move(FileQueue.front());
+				FileQueue.pop_front();
+			}
+
+			PrefetchRecords(filePath.c_str());
+			idleStart = GetTickCount();
+		}
+	}
+
+	void PrefetchFile(const char *FilePath)
+	{
+		std::lock_guard<std::mutex> lock(QueueMutex);
+
+		// Files are announced more than once while loading
+		if (!QueuedFiles.emplace(FilePath).second)
+			return;
+
+		FileQueue.emplace_back(FilePath);
+		QueueCondition.notify_one();
+
+		if (!WorkerStarted)
+		{
+			WorkerStarted = true;
+			std::thread(PrefetchWorker).detach();
+		}
+	}
+
+	bool TakePrefetched(const void *Input, size_t InputSize, void *Output, size_t OutputSize, size_t *OutputBytes)
+	{
+		if (CachedCount.load(std::memory_order_relaxed) == 0 || InputSize <= sizeof(uint32_t))
+			return false;
+
+		uint64_t key = GetCacheKey(Input, InputSize);
+		CachedRecord *match = nullptr;
+		bool wasFull = false;
+
+		AcquireSRWLockExclusive(&CacheLock);
+		{
+			if (CachedRecord **head = Cache.find(key))
+			{
+				for (CachedRecord **link = head; *link; link = &(*link)->Next)
+				{
+					CachedRecord *record = *link;
+
+					if (record->OutputSize > OutputSize || memcmp(record->Input, Input, InputSize) != 0)
+						continue;
+
+					// Each record is handed out once, the loader doesn't read it twice
+					*link = record->Next;
+					match = record;
+
+					if (!*head)
+						Cache.erase(key);
+
+					wasFull = CachedBytes.load() > MaxCachedBytes;
+					CachedCount--;
+					CachedBytes -= record->OutputSize;
+					break;
+				}
+			}
+		}
+		ReleaseSRWLockExclusive(&CacheLock);
+
+		if (!match)
+			return false;
+
+		memcpy(Output, match->Output.get(), match->OutputSize);
+		*OutputBytes = match->OutputSize;
+
+		// FlushBatch() only waits while the cache is over budget. The lock makes sure it's either
+		// still checking or already waiting, so the wakeup can't get lost.
+		if (wasFull)
+		{
+			{
+				std::lock_guard<std::mutex> lock(DrainMutex);
+				TakeCount++;
+			}
+
+			DrainCondition.notify_one();
+		}
+		else
+		{
+			TakeCount++;
+		}
+
+		delete match;
+		return true;
+	}
+}
\ No newline at end of file
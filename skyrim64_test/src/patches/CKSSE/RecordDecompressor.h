@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <libdeflate/libdeflate.h>
+
+//
+// zlib decompression for compressed form records (flag 0x00040000). Every thread keeps its own
+// libdeflate decompressor instead of allocating one per record.
+//
+// PrefetchFile() walks a plugin on a background thread and decompresses its records in parallel
+// batches. hk_inflate then copies a finished record out of the cache when the engine asks for the
+// same compressed bytes, or decompresses it inline on a miss.
+//
+namespace RecordDecompressor
+{
+	struct BatchEntry
+	{
+		const uint8_t *Input;				// zlib stream
+		uint32_t InputSize;
+		uint32_t SizeHint;					// Decompressed size stored in front of the stream. Grown if it's wrong.
+		std::unique_ptr<uint8_t[]> Output;
+		uint32_t OutputSize;
+		libdeflate_result Result;
+	};
+
+	libdeflate_result Decompress(const void *Input, size_t InputSize, void *Output, size_t OutputSize, size_t *OutputBytes);
+	void DecompressBatch(BatchEntry *Entries, size_t Count);
+
+	// Chunked input for callers that don't pass the whole stream at once. Keyed by z_stream pointer.
+	void BeginPendingInput(const void *Stream, const void *Input, size_t InputSize);
+	bool ContinuePendingInput(const void *Stream, const void *Input, size_t InputSize, const void **Data, size_t *DataSize);
+	void ReleasePendingInput(const void *Stream);
+
+	void PrefetchFile(const char *FilePath);
+	bool TakePrefetched(const void *Input, size_t InputSize, void *Output, size_t OutputSize, size_t *OutputBytes);
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "../../common.h"
 #include "TESFile_CK.h"
 #include "LogWindow.h"
+#include "RecordDecompressor.h"
 
 int TESFile_CK::hk_LoadTESInfo()
 {
@@ -9,6 +10,15 @@ int TESFile_CK::hk_LoadTESInfo()
 	if (error != 0)
 		return error;
 
+	// Start decompressing this file's records while the loader is still busy with earlier files
+	if (PrefetchCompressedRecords && (m_RecordFlags & FILE_RECORD_CHECKED) == FILE_RECORD_CHECKED)
+	{
+		char filePath[MAX_PATH * 2];
+		sprintf_s(filePath, "%s%s", m_FilePath, m_FileName);
+
+		RecordDecompressor::PrefetchFile(filePath);
+	}
+
 	const bool masterFile = (m_RecordFlags & FILE_RECORD_ESM) == FILE_RECORD_ESM;
 	const bool activeFile = (m_RecordFlags & FILE_RECORD_ACTIVE) == FILE_RECORD_ACTIVE;
 
@@ -26,6 +26,7 @@ public:
 	inline static __int64 (* WriteTESInfo)(TESFile_CK *);
 	inline static bool AllowSaveESM;
 	inline static bool AllowMasterESP;
+	inline static bool PrefetchCompressedRecords;
 
 	int hk_LoadTESInfo();
 	__int64 hk_WriteTESInfo();
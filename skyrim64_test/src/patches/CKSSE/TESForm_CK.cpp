@@ -1,11 +1,17 @@
 #include "../../common.h"
-#include <unordered_set>
+#include "../TES/ShardedScatterTable.h"
 #include "TESForm_CK.h"
 
 static_assert(sizeof(TESForm_CK::Array) == 0x18);
 
-std::unordered_set<TESForm_CK *> AlteredFormListShadow;
-std::unordered_map<uint64_t, TESForm_CK::Array *> FormReferenceMap;
+// Reference arrays are allocated and owned by the engine, so only the pointers are stored here
+ShardedScatterTable<TESForm_CK *, bool, std::hash<TESForm_CK *>> AlteredFormListShadow;
+ShardedScatterTable<uint64_t, TESForm_CK::Array *> FormReferenceMap;
+
+void FormReferenceMap_DestroyArray(TESForm_CK::Array *Array)
+{
+	((void(__fastcall *)(TESForm_CK::Array *, int))OFFSET(0x149F560, 1530))(Array, 1);
+}
 
 bool TESForm_CK::GetActive() const
 {
@@ -38,7 +44,7 @@ void TESForm_CK::AlteredFormList_RemoveAllEntries(TESForm_CK::Array *Array, bool
 
 void TESForm_CK::AlteredFormList_Insert(TESForm_CK::Array *Array, TESForm_CK *&Entry)
 {
-	AlteredFormListShadow.insert(Entry);
+	AlteredFormListShadow.insert(Entry, true);
 
 	((void(__fastcall *)(TESForm_CK::Array *, TESForm_CK *&))OFFSET(0x146A660, 1530))(Array, Entry);
 }
@@ -52,65 +58,57 @@ void TESForm_CK::AlteredFormList_RemoveEntry(TESForm_CK::Array *Array, uint32_t
 
 bool TESForm_CK::AlteredFormList_ElementExists(TESForm_CK::Array *Array, TESForm_CK *&Entry)
 {
-	return AlteredFormListShadow.count(Entry) > 0;
+	return AlteredFormListShadow.contains(Entry);
 }
 
 void FormReferenceMap_RemoveAllEntries()
 {
-	for (auto [k, v] : FormReferenceMap)
+	FormReferenceMap.drain([](const auto *Batch, uint32_t Count)
 	{
-		if (v)
-			((void(__fastcall *)(TESForm_CK::Array *, int))OFFSET(0x149F560, 1530))(v, 1);
-	}
-
-	FormReferenceMap.clear();
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			if (Batch[i].second)
+				FormReferenceMap_DestroyArray(Batch[i].second);
+		}
+	});
 }
 
 TESForm_CK::Array *FormReferenceMap_FindOrCreate(uint64_t Key, bool Create)
 {
-	auto itr = FormReferenceMap.find(Key);
+	if (!Create)
+	{
+		TESForm_CK::Array *ptr = nullptr;
+		FormReferenceMap.get(Key, ptr);
 
-	if (itr != FormReferenceMap.end() && itr->second)
-		return itr->second;
+		return ptr;
+	}
 
-	if (Create)
+	// Null entries are replaced, same as the original insert_or_assign
+	return FormReferenceMap.find_or_insert(Key, [](TESForm_CK::Array *Value)
+	{
+		return Value != nullptr;
+	},
+	[]()
 	{
 		auto *ptr = ((TESForm_CK::Array *(__fastcall *)(size_t))OFFSET(0x1219450, 1530))(24);
 
 		if (ptr)
 			ptr = ((TESForm_CK::Array *(__fastcall *)(TESForm_CK::Array *))OFFSET(0x1397CD0, 1530))(ptr);
 
-		FormReferenceMap.insert_or_assign(Key, ptr);
 		return ptr;
-	}
-
-	return nullptr;
+	});
 }
 
 void FormReferenceMap_RemoveEntry(uint64_t Key)
 {
-	auto itr = FormReferenceMap.find(Key);
-
-	if (itr != FormReferenceMap.end())
-	{
-		TESForm_CK::Array *ptr = itr->second;
-		FormReferenceMap.erase(itr);
+	TESForm_CK::Array *ptr = nullptr;
 
-		if (ptr)
-			((void(__fastcall *)(TESForm_CK::Array *, int))OFFSET(0x149F560, 1530))(ptr, 1);
-	}
+	if (FormReferenceMap.erase(Key, &ptr) && ptr)
+		FormReferenceMap_DestroyArray(ptr);
 }
 
 bool FormReferenceMap_Get(uint64_t Unused, uint64_t Key, TESForm_CK::Array **Value)
 {
 	// Function doesn't care if entry is nullptr, only if it exists
-	auto itr = FormReferenceMap.find(Key);
-
-	if (itr != FormReferenceMap.end())
-	{
-		*Value = itr->second;
-		return true;
-	}
-
-	return false;
+	return FormReferenceMap.get(Key, *Value);
 }
\ No newline at end of file
@@ -5,6 +5,9 @@
 #include "BSSpinLock.h"
 #include "BSBatchRenderer.h"
 #include "BSShader/Shaders/BSSkyShader.h"
+#include "BSShader/Shaders/BSLightingShader.h"
+#include "BSShader/Shaders/BSLightingShaderMaterial.h"
+#include "DrawSortKey.h"
 
 AutoPtr(BYTE, byte_1431F54CD, 0x31F54CD);
 AutoPtr(DWORD, dword_141E32FDC, 0x1E32FDC);
@@ -228,77 +231,81 @@ bool BSBatchRenderer::sub_14131E7B0(uint32_t& Technique, uint32_t& GroupIndex, B
 	return sub_14131E8F0(m_RenderPassMap.get(Technique), GroupIndex);
 }
 
-bool BSBatchRenderer::RenderBatches(uint32_t& Technique, uint32_t& GroupIndex, BSSimpleList<uint32_t> *&PassIndexList, uint32_t RenderFlags)
+bool BSBatchRenderer::SetupPassGroupState(uint32_t GroupIndex, uint32_t RenderFlags)
 {
 	auto renderer = BSGraphics::Renderer::QInstance();
 
 	bool alphaTest = false;
 	bool unknownFlag = (RenderFlags & 0x108) != 0;
 
-	// Set pass render state
+	int cullMode = -1;
+	int alphaToCoverage = -1;
+	bool useAlphaTestRef = false;
+
+	switch (GroupIndex)
 	{
-		int cullMode = -1;
-		int alphaToCoverage = -1;
-		bool useAlphaTestRef = false;
+	case 0:
+		if (!unknownFlag)
+			cullMode = 1;
 
-		switch (GroupIndex)
-		{
-		case 0:
-			if (!unknownFlag)
-				cullMode = 1;
+		useAlphaTestRef = false;
+		alphaToCoverage = 0;
+		break;
 
-			useAlphaTestRef = false;
-			alphaToCoverage = 0;
-			break;
+	case 1:
+		if (!unknownFlag)
+			cullMode = 1;
 
-		case 1:
-			if (!unknownFlag)
-				cullMode = 1;
+		useAlphaTestRef = true;
+		alphaTest = true;
 
-			useAlphaTestRef = true;
-			alphaTest = true;
+		if (byte_1431F54CD)
+			alphaToCoverage = 1;
+		break;
 
-			if (byte_1431F54CD)
-				alphaToCoverage = 1;
-			break;
+	case 2:
+		if (!unknownFlag)
+			cullMode = 0;
 
-		case 2:
-			if (!unknownFlag)
-				cullMode = 0;
+		useAlphaTestRef = false;
+		alphaToCoverage = 0;
+		break;
 
-			useAlphaTestRef = false;
-			alphaToCoverage = 0;
-			break;
+	case 3:
+		if (!unknownFlag)
+			cullMode = 0;
 
-		case 3:
-			if (!unknownFlag)
-				cullMode = 0;
+		useAlphaTestRef = true;
+		alphaTest = true;
 
-			useAlphaTestRef = true;
-			alphaTest = true;
+		if (byte_1431F54CD)
+			alphaToCoverage = 1;
+		break;
 
-			if (byte_1431F54CD)
-				alphaToCoverage = 1;
-			break;
+	case 4:
+		if (!unknownFlag)
+			cullMode = 1;
 
-		case 4:
-			if (!unknownFlag)
-				cullMode = 1;
+		useAlphaTestRef = true;
+		alphaTest = true;
+		alphaToCoverage = 0;
+		break;
+	}
 
-			useAlphaTestRef = true;
-			alphaTest = true;
-			alphaToCoverage = 0;
-			break;
-		}
+	if (cullMode != -1)
+		BSGraphics::Renderer::QInstance()->RasterStateSetCullMode(cullMode);
 
-		if (cullMode != -1)
-			BSGraphics::Renderer::QInstance()->RasterStateSetCullMode(cullMode);
+	if (alphaToCoverage != -1)
+		BSGraphics::Renderer::QInstance()->AlphaBlendStateSetAlphaToCoverage(alphaToCoverage);
 
-		if (alphaToCoverage != -1)
-			BSGraphics::Renderer::QInstance()->AlphaBlendStateSetAlphaToCoverage(alphaToCoverage);
+	renderer->SetUseAlphaTestRef(useAlphaTestRef);
+	return alphaTest;
+}
 
-		renderer->SetUseAlphaTestRef(useAlphaTestRef);
-	}
+bool BSBatchRenderer::RenderBatches(uint32_t& Technique, uint32_t& GroupIndex, BSSimpleList<uint32_t> *&PassIndexList, uint32_t RenderFlags)
+{
+	// Set pass render state
+	bool alphaTest = SetupPassGroupState(GroupIndex, RenderFlags);
 
 	// Render this group with a specific render pass list
 	auto group = &m_RenderPass[m_RenderPassMap.get(Technique)];
@@ -323,6 +330,137 @@ bool BSBatchRenderer::RenderBatches(uint32_t& Technique, uint32_t& GroupIndex, B
 	return sub_14131E700(Technique, GroupIndex, PassIndexList);
 }
 
+//
+// Sorted submission. QueueBatches() walks the pass groups in the same order as RenderBatches(), but
+// only records each pass with a DrawSortKey. SubmitQueuedBatches() sorts them and issues the draws,
+// so passes sharing a texture set or material are drawn back to back and opaque geometry goes front
+// to back. State is only set up again when the technique or pass group changes.
+//
+// The queue is per thread and never outlives one BSShaderAccumulator::RenderBatches() call. Passes
+// are freed by ClearAndFreePasses() after it returns.
+//
+struct QueuedDraw
+{
+	BSRenderPass *Pass;
+	uint32_t Technique;
+	uint32_t GroupIndex;
+};
+
+struct DrawQueue
+{
+	std::vector<QueuedDraw> Draws;
+	std::vector<DrawSortKey::Entry> Keys;
+	std::vector<DrawSortKey::Entry> Scratch;
+	uint32_t LastTechnique = 0;
+	uint32_t TechniqueRank = 0;
+};
+
+thread_local DrawQueue TLSDrawQueue;
+
+bool BSBatchRenderer::QueueBatches(uint32_t& Technique, uint32_t& GroupIndex, BSSimpleList<uint32_t> *&PassIndexList, const NiPoint3& ViewPosition, uint32_t RenderFlags)
+{
+	auto& queue = TLSDrawQueue;
+
+	// Ranks only count up, in the order techniques are visited. Submit early if they run out.
+	if (!queue.Draws.empty() && Technique != queue.LastTechnique)
+	{
+		if (queue.TechniqueRank >= DrawSortKey::MaxTechniqueRank)
+			SubmitQueuedBatches(RenderFlags);
+		else
+			queue.TechniqueRank++;
+	}
+
+	queue.LastTechnique = Technique;
+
+	auto group = &m_RenderPass[m_RenderPassMap.get(Technique)];
+
+	// Blending depends on draw order. If any pass in the list blends, keep the whole list as submitted.
+	bool keepOrder = false;
+
+	for (auto pass = group->m_Passes[GroupIndex]; pass && !keepOrder; pass = pass->m_PassGroupNext)
+		keepOrder = pass->QAlphaProperty() && pass->QAlphaProperty()->GetAlphaBlending();
+
+	for (auto pass = group->m_Passes[GroupIndex]; pass; pass = pass->m_PassGroupNext)
+	{
+		uint64_t key;
+
+		if (keepOrder)
+		{
+			key = DrawSortKey::EncodeOrdered(queue.TechniqueRank, GroupIndex, queue.Draws.size());
+		}
+		else
+		{
+			BSShaderMaterial *material = pass->m_ShaderProperty ? pass->m_ShaderProperty->pMaterial : nullptr;
+			void *textureSet = nullptr;
+
+			if (material && pass->m_Shader == BSLightingShader::pInstance)
+				textureSet = static_cast<BSLightingShaderMaterialBase *>(material)->TextureSet;
+
+			const NiPoint3& center = pass->m_Geometry->m_kWorldBound.m_kCenter;
+			float dx = center.x - ViewPosition.x;
+			float dy = center.y - ViewPosition.y;
+			float dz = center.z - ViewPosition.z;
+
+			key = DrawSortKey::Encode(queue.TechniqueRank, GroupIndex, textureSet, material, dx * dx + dy * dy + dz * dz);
+		}
+
+		queue.Keys.push_back({ key, (uint32_t)queue.Draws.size() });
+		queue.Draws.push_back({ pass, Technique, GroupIndex });
+	}
+
+	// Zero the pointers only - the passes stay valid until the accumulator frees them
+	if (m_AutoClearPasses)
+	{
+		Assert(GroupIndex >= 0 && GroupIndex < ARRAYSIZE(group->m_Passes));
+
+		group->m_ValidPassBits &= ~(1 << GroupIndex);
+		group->m_Passes[GroupIndex] = nullptr;
+	}
+
+	GroupIndex++;
+	return sub_14131E700(Technique, GroupIndex, PassIndexList);
+}
+
+void BSBatchRenderer::SubmitQueuedBatches(uint32_t RenderFlags)
+{
+	auto& queue = TLSDrawQueue;
+
+	if (queue.Draws.empty())
+		return;
+
+	queue.Scratch.resize(queue.Keys.size());
+	const DrawSortKey::Entry *sorted = DrawSortKey::RadixSort(queue.Keys.data(), queue.Scratch.data(), queue.Keys.size());
+
+	const QueuedDraw *previous = nullptr;
+	bool alphaTest = false;
+
+	for (size_t i = 0; i < queue.Keys.size(); i++)
+	{
+		const QueuedDraw& draw = queue.Draws[sorted[i].Index];
+
+		if (!previous || draw.Technique != previous->Technique || draw.GroupIndex != previous->GroupIndex)
+		{
+			if (previous)
+			{
+				EndPass();
+				BSGraphics::Renderer::QInstance()->AlphaBlendStateSetAlphaToCoverage(0);
+			}
+
+			alphaTest = SetupPassGroupState(draw.GroupIndex, RenderFlags);
+		}
+
+		RenderPassImmediately(draw.Pass, draw.Technique, alphaTest, RenderFlags);
+		previous = &draw;
+	}
+
+	EndPass();
+	BSGraphics::Renderer::QInstance()->AlphaBlendStateSetAlphaToCoverage(0);
+
+	queue.Draws.clear();
+	queue.Keys.clear();
+	queue.TechniqueRank = 0;
+}
+
 void BSBatchRenderer::ClearRenderPasses()
 {
 	MemoryContextTracker tracker(MemoryContextTracker::RENDER_ACCUMULATOR, "BSBatchRenderer.cpp");
@@ -473,21 +611,30 @@ void BSBatchRenderer::RenderPassImmediately_Skinned(BSRenderPass *Pass, bool Alp
 		SkinRenderData skinData(static_cast<NiBoneMatrixSetterI *>(Pass->m_Shader), Pass->m_Geometry, nullptr, Pass->m_LODMode.SingleLevel, Pass->m_LODMode.Index);
 
 		// Runtime-updated vertices are sent to a GPU vertex buffer directly (non-static objects like trees/characters)
+		auto renderer = BSGraphics::Renderer::QInstance();
 		BSDynamicTriShape *dynamicTri = Pass->m_Geometry->IsDynamicTriShape();
 
 		if (dynamicTri)
 		{
 			const uint32_t size = dynamicTri->QDynamicDataSize();
-			void *vertexBuffer = BSGraphics::Renderer::QInstance()->AllocateAndMapDynamicVertexBuffer(size, &skinData.m_VertexBufferOffset);
+			void *vertexBuffer = renderer->AllocateAndMapDynamicVertexBuffer(size, &skinData.m_VertexBufferOffset);
 
 			memcpy(vertexBuffer, dynamicTri->LockDynamicDataForRead(), size);
 
 			dynamicTri->UnlockDynamicData();
-			BSGraphics::Renderer::QInstance()->UnmapDynamicVertexBuffer();
+			renderer->UnmapDynamicVertexBuffer();
 		}
 
+		// Skinned draws bind the engine's current dynamic buffer. Point it at the one holding the data.
+		ID3D11Buffer *& engineBuffer = renderer->Globals.m_DynamicVertexBuffers[renderer->Globals.m_CurrentDynamicVertexBuffer];
+		ID3D11Buffer *oldEngineBuffer = engineBuffer;
+
+		if (dynamicTri)
+			engineBuffer = renderer->GetDynamicVertexBuffer();
+
 		// Renders multiple skinned instances (SetupTechnique, SetBoneMatrix)
 		Pass->m_Geometry->QSkinInstance()->Render(&skinData);
+		engineBuffer = oldEngineBuffer;
 	}
 
 	Pass->m_Shader->RestoreGeometry(Pass, RenderFlags);
@@ -64,8 +64,11 @@ public:
 	bool DiscardBatches(uint32_t& Technique, uint32_t& GroupIndex, BSSimpleList<uint32_t> *&PassIndexList);
 	bool sub_14131E7B0(uint32_t& Technique, uint32_t& GroupIndex, BSSimpleList<uint32_t> *&PassIndexList);
 	bool RenderBatches(uint32_t& Technique, uint32_t& GroupIndex, BSSimpleList<uint32_t> *&PassIndexList, uint32_t RenderFlags);
+	bool QueueBatches(uint32_t& Technique, uint32_t& GroupIndex, BSSimpleList<uint32_t> *&PassIndexList, const NiPoint3& ViewPosition, uint32_t RenderFlags);
 	void ClearRenderPasses();
 
+	static bool SetupPassGroupState(uint32_t GroupIndex, uint32_t RenderFlags);
+	static void SubmitQueuedBatches(uint32_t RenderFlags);
 	static void RenderPersistentPassList(PersistentPassList *PassList, uint32_t RenderFlags);
 	static void RenderPassImmediately(BSRenderPass *Pass, uint32_t Technique, bool AlphaTest, uint32_t RenderFlags);
 	static void ShaderSetup(BSRenderPass *Pass, BSShader *Shader, bool AlphaTest, uint32_t RenderFlags);
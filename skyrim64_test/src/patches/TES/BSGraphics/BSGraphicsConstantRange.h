@@ -0,0 +1,155 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+namespace BSGraphics
+{
+	//
+	// Tracks which bytes of a constant group have been written since it was allocated. Allocations
+	// aren't cleared up front, so every byte that wasn't written has to be zeroed before the group
+	// is used, same as the old memset of the whole allocation. Only [0, BoundSize()) is bound and
+	// D3D11.1 returns zero for reads past it. Bindings always start at offset 0 because shaders
+	// address constants relative to it.
+	//
+	// Written bytes are kept as a short sorted list of disjoint ranges. When it fills up, the gaps
+	// below the last range are zeroed right away and the list collapses into one range. That's safe
+	// because anything written into those gaps later lands after the clear.
+	//
+	// Data is the group's memory. It's null for engine-owned groups, which are never cleared.
+	//
+	struct ConstantRange
+	{
+		const static uint32_t MaxRanges = 8;
+
+		uint32_t Count = 0;
+		uint32_t Begin[MaxRanges];
+		uint32_t End[MaxRanges];
+
+		uint32_t GetEnd() const
+		{
+			return Count ? End[Count - 1] : 0;
+		}
+
+		void Reset()
+		{
+			Count = 0;
+		}
+
+		// Zeroes every byte in [From, To) that hasn't been written
+		void ClearGaps(void *Data, uint32_t From, uint32_t To) const
+		{
+			if (!Data)
+				return;
+
+			uint32_t position = From;
+
+			for (uint32_t i = 0; i < Count && position < To; i++)
+			{
+				if (End[i] <= position)
+					continue;
+
+				if (Begin[i] > position)
+					memset((uint8_t *)Data + position, 0, std::min(Begin[i], To) - position);
+
+				position = std::max(position, End[i]);
+			}
+
+			if (position < To)
+				memset((uint8_t *)Data + position, 0, To - position);
+		}
+
+		void Mark(void *Data, uint32_t Offset, uint32_t Size)
+		{
+			if (Size == 0)
+				return;
+
+			const uint32_t end = Offset + Size;
+
+			// Sequential writes extend the last range
+			if (Count > 0 && Offset >= Begin[Count - 1] && Offset <= End[Count - 1])
+			{
+				End[Count - 1] = std::max(End[Count - 1], end);
+				return;
+			}
+
+			// First range ending at or after Offset, and the first one starting past end
+			uint32_t first = 0;
+			uint32_t last = 0;
+
+			while (first < Count && End[first] < Offset)
+				first++;
+
+			last = first;
+
+			while (last < Count && Begin[last] <= end)
+				last++;
+
+			if (first == last && Count == MaxRanges)
+			{
+				// No room for another range
+				const uint32_t lastEnd = GetEnd();
+				ClearGaps(Data, 0, lastEnd);
+
+				Begin[0] = 0;
+				End[0] = lastEnd;
+				Count = 1;
+
+				Mark(Data, Offset, Size);
+				return;
+			}
+
+			uint32_t newBegin = Offset;
+			uint32_t newEnd = end;
+
+			if (first < last)
+			{
+				// Merge everything it overlaps or touches
+				newBegin = std::min(newBegin, Begin[first]);
+				newEnd = std::max(newEnd, End[last - 1]);
+			}
+
+			const uint32_t removed = last - first;
+
+			if (removed == 0)
+			{
+				for (uint32_t i = Count; i > first; i--)
+				{
+					Begin[i] = Begin[i - 1];
+					End[i] = End[i - 1];
+				}
+
+				Count++;
+			}
+			else if (removed > 1)
+			{
+				for (uint32_t i = last; i < Count; i++)
+				{
+					Begin[i - removed + 1] = Begin[i];
+					End[i - removed + 1] = End[i];
+				}
+
+				Count -= removed - 1;
+			}
+
+			Begin[first] = newBegin;
+			End[first] = newEnd;
+		}
+
+		// For pointers handed out without knowing what gets written: zero what's still unwritten
+		void Cover(void *Data, uint32_t Offset, uint32_t Size)
+		{
+			ClearGaps(Data, Offset, Offset + Size);
+			Mark(Data, Offset, Size);
+		}
+
+		// The last write rounded up to whole constant blocks, at least one block and never past the
+		// allocation. Granularity must be a power of two.
+		uint32_t BoundSize(uint32_t Granularity, uint32_t AllocationSize) const
+		{
+			uint32_t size = std::max(Granularity, (GetEnd() + Granularity - 1) & ~(Granularity - 1));
+			return std::min(size, AllocationSize);
+		}
+	};
+}
\ No newline at end of file
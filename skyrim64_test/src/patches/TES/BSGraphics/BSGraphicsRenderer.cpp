@@ -1,9 +1,12 @@
 #include "../../../common.h"
-#include <mutex>
+#include <execution>
 #include "../../rendering/GpuCircularBuffer.h"
 #include "../NiMain/BSGeometry.h"
+#include "../InsertOnlyScatterTable.h"
 #include "BSGraphicsRenderer.h"
 #include "BSGraphicsRenderTargetManager.h"
+#include "BSGraphicsShaderCache.h"
+#include "../MOC.h"
 
 #define CHECK_RESULT(ReturnVar, Statement) do { (ReturnVar) = (Statement); AssertMsgVa(SUCCEEDED(ReturnVar), "Renderer target '%s' creation failed. HR = 0x%X.", Name, (ReturnVar)); } while (0)
 
@@ -11,11 +14,14 @@ thread_local D3D_PRIMITIVE_TOPOLOGY TopoOverride;
 
 namespace BSGraphics
 {
-	std::mutex InputLayoutLock;
-	std::unordered_map<uint64_t, ID3D11InputLayout *> InputLayoutMap;
-	std::unordered_map<void *, std::pair<std::unique_ptr<uint8_t[]>, size_t>> ShaderBytecodeMap;
+	// Read on every draw state flush, written once per new vertex format or shader
+	InsertOnlyScatterTable<uint64_t, ID3D11InputLayout *> InputLayoutMap;
+	InsertOnlyScatterTable<uintptr_t, std::pair<std::unique_ptr<uint8_t[]>, size_t> *> ShaderBytecodeMap;
+	InsertOnlyScatterTable<uintptr_t, uint32_t> ConstantGroupSizes;
+	SRWLOCK ParticleInputLayoutLock = SRWLOCK_INIT;
 
 	const uint32_t ShaderConstantRingBufferSize = 32 * 1024 * 1024;
+	const uint32_t DynamicGeometryRingBufferSize = 16 * 1024 * 1024;
 	const uint32_t RingBufferMaxFrames = 4;
 	uint32_t CurrentFrameIndex = 0;
 
@@ -23,6 +29,7 @@ namespace BSGraphics
 	bool FrameCompletedQueryPending[RingBufferMaxFrames];
 
 	GpuCircularBuffer *ShaderConstantBuffer;
+	DynamicGeometryRing *DynamicGeometryBuffer;
 
 	void BeginEvent(wchar_t *Name)
 	{
@@ -48,7 +55,8 @@ namespace BSGraphics
 			Assert(SUCCEEDED(Data.pDevice->CreateQuery(&desc, &FrameCompletedQueries[i])));
 		}
 
-		ShaderConstantBuffer = new GpuCircularBuffer(Data.pDevice, D3D11_BIND_CONSTANT_BUFFER, ShaderConstantRingBufferSize, RingBufferMaxFrames);
+		ShaderConstantBuffer = new GpuCircularBuffer(Data.pDevice, Data.pContext, D3D11_BIND_CONSTANT_BUFFER, ShaderConstantRingBufferSize, RingBufferMaxFrames);
+		DynamicGeometryBuffer = new DynamicGeometryRing(Data.pDevice, DynamicGeometryRingBufferSize, RingBufferMaxFrames);
 	}
 
 	void Renderer::OnNewFrame()
@@ -60,6 +68,7 @@ namespace BSGraphics
 		FrameCompletedQueryPending[CurrentFrameIndex] = true;
 
 		ShaderConstantBuffer->SwapFrame(CurrentFrameIndex);
+		DynamicGeometryBuffer->SwapFrame(CurrentFrameIndex);
 
 		// "Pop" the query from the oldest rendered frame
 		int prevQueryIndex = CurrentFrameIndex - (RingBufferMaxFrames - 1);
@@ -76,9 +85,16 @@ namespace BSGraphics
 			AssertMsg(SUCCEEDED(hr) && data == TRUE, "DeviceContext::GetData() MUST SUCCEED BY NOW");
 
 			ShaderConstantBuffer->FreeOldFrame(prevQueryIndex);
+			DynamicGeometryBuffer->FreeOldFrame(prevQueryIndex);
 			FrameCompletedQueryPending[prevQueryIndex] = false;
 		}
 
+		// Sized after the retired frame's space is back. Overflow pages are mapped here since the
+		// context can't be used from the recording threads.
+		ShaderConstantBuffer->BeginFrame();
+		ShaderConstantBuffer->ReservePages();
+		DynamicGeometryBuffer->BeginFrame();
+
 		CurrentFrameIndex++;
 
 		if (CurrentFrameIndex >= RingBufferMaxFrames)
@@ -505,7 +521,7 @@ namespace BSGraphics
 
 		ID3D11Buffer *buffers[2];
 		buffers[0] = ShapeData->m_VertexBuffer;
-		buffers[1] = Globals.m_DynamicVertexBuffers[Globals.m_CurrentDynamicVertexBuffer];
+		buffers[1] = DynamicGeometryBuffer->GetBuffer();
 
 		uint32_t strides[2];
 		strides[0] = BSGeometry::CalculateVertexSize(ShapeData->m_VertexDesc);
@@ -538,8 +554,10 @@ namespace BSGraphics
 
 		SetDirtyStates(false);
 
-		InputLayoutLock.lock();
+		if (!Globals.m_ParticleShaderInputLayout)
 		{
+			AcquireSRWLockExclusive(&ParticleInputLayoutLock);
+
 			if (!Globals.m_ParticleShaderInputLayout)
 			{
 				constexpr static D3D11_INPUT_ELEMENT_DESC inputDesc[] =
@@ -558,16 +576,21 @@ namespace BSGraphics
 					&Globals.m_ParticleShaderInputLayout)));
 			}
 
-			uint64_t desc = state->m_VertexDesc & state->m_CurrentVertexShader->m_VertexDescription;
-			InputLayoutMap.try_emplace(desc, Globals.m_ParticleShaderInputLayout);
+			ReleaseSRWLockExclusive(&ParticleInputLayoutLock);
 		}
-		InputLayoutLock.unlock();
+
+		uint64_t desc = state->m_VertexDesc & state->m_CurrentVertexShader->m_VertexDescription;
+		ID3D11InputLayout *layout;
+
+		if (!InputLayoutMap.find(desc, &layout))
+			InputLayoutMap.insert(desc, Globals.m_ParticleShaderInputLayout);
 
 		Data.pContext->IASetInputLayout(Globals.m_ParticleShaderInputLayout);
 		state->m_StateUpdateFlags |= DIRTY_VERTEX_DESC;
 
 		Data.pContext->IASetIndexBuffer(Globals.m_SharedParticleIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-		Data.pContext->IASetVertexBuffers(0, 1, &Globals.m_DynamicVertexBuffers[Globals.m_CurrentDynamicVertexBuffer], &vertexStride, &vertexOffset);
+		ID3D11Buffer *vertexBuffer = DynamicGeometryBuffer->GetBuffer();
+		Data.pContext->IASetVertexBuffers(0, 1, &vertexBuffer, &vertexStride, &vertexOffset);
 		Data.pContext->DrawIndexed(6 * (Count / 4), 0, 0);
 	}
 
@@ -611,6 +634,8 @@ namespace BSGraphics
 		{
 			if (flags & DIRTY_RENDERTARGET)
 			{
+				ProfileCounterInc("Dirty Render Target");
+
 				// Build active render target view array
 				ID3D11RenderTargetView *renderTargetViews[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
 				uint32_t viewCount = 0;
@@ -704,12 +729,16 @@ namespace BSGraphics
 			// OMSetDepthStencilState
 			if (flags & (DIRTY_DEPTH_STENCILREF_MODE | DIRTY_DEPTH_MODE))
 			{
+				ProfileCounterInc("Dirty Depth");
+
 				context->OMSetDepthStencilState(Globals.m_DepthStates[state->m_DepthStencilDepthMode][state->m_DepthStencilStencilMode], state->m_StencilRef);
 			}
 
 			// RSSetState
 			if (flags & (DIRTY_UNKNOWN2 | DIRTY_RASTER_DEPTH_BIAS | DIRTY_RASTER_CULL_MODE | DIRTY_UNKNOWN1))
 			{
+				ProfileCounterInc("Dirty Raster");
+
 				context->RSSetState(Globals.m_RasterStates[state->m_RasterStateFillMode][state->m_RasterStateCullMode][state->m_RasterStateDepthBiasMode][state->m_RasterStateScissorMode]);
 
 				if (flags & DIRTY_RASTER_DEPTH_BIAS)
@@ -738,6 +767,8 @@ namespace BSGraphics
 			// OMSetBlendState
 			if (flags & DIRTY_ALPHA_BLEND)
 			{
+				ProfileCounterInc("Dirty Blend");
+
 				const float blendFactor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 
 				context->OMSetBlendState(Globals.m_BlendStates[state->m_AlphaBlendMode][state->m_AlphaBlendAlphaToCoverage][state->m_AlphaBlendWriteMode][state->m_AlphaBlendModeExtra], blendFactor, 0xFFFFFFFF);
@@ -745,6 +776,8 @@ namespace BSGraphics
 
 			if (flags & (DIRTY_ALPHA_ENABLE_TEST | DIRTY_ALPHA_TEST_REF))
 			{
+				ProfileCounterInc("Dirty Alpha Test");
+
 				D3D11_MAPPED_SUBRESOURCE resource;
 				context->Map(Globals.m_AlphaTestRefCB, 0, D3D11_MAP_WRITE_DISCARD, 0, &resource);
 
@@ -759,29 +792,21 @@ namespace BSGraphics
 			// Shader input layout creation + updates
 			if (!IsComputeShader && (flags & DIRTY_VERTEX_DESC))
 			{
-				InputLayoutLock.lock();
-				{
-					uint64_t desc = state->m_VertexDesc & state->m_CurrentVertexShader->m_VertexDescription;
-
-					// Does the entry exist already?
-					if (auto e = InputLayoutMap.find(desc); e != InputLayoutMap.end())
-					{
-						// It does. We're done now.
-						context->IASetInputLayout(e->second);
-					}
-					else
-					{
-						// Create and insert
-						AutoFunc(__int64(__fastcall *)(unsigned __int64 a1), sub_140D705F0, 0xD70620);
-						ID3D11InputLayout *layout = (ID3D11InputLayout *)sub_140D705F0(desc);
+				uint64_t desc = state->m_VertexDesc & state->m_CurrentVertexShader->m_VertexDescription;
+				ID3D11InputLayout *layout;
 
-						if (layout || desc != 0x300000000407)
-							InputLayoutMap.emplace(desc, layout);
+				// Does the entry exist already? If not, create and insert. When two threads race on
+				// the same description the first insert wins and both bind that layout.
+				if (!InputLayoutMap.find(desc, &layout))
+				{
+					AutoFunc(__int64(__fastcall *)(unsigned __int64 a1), sub_140D705F0, 0xD70620);
+					layout = (ID3D11InputLayout *)sub_140D705F0(desc);
 
-						context->IASetInputLayout(layout);
-					}
+					if (layout || desc != 0x300000000407)
+						layout = InputLayoutMap.insert(desc, layout);
 				}
-				InputLayoutLock.unlock();
+
+				context->IASetInputLayout(layout);
 			}
 
 			// IASetPrimitiveTopology
@@ -817,6 +842,7 @@ namespace BSGraphics
 		if (uint32_t bits = state->m_PSSamplerModifiedBits; bits != 0)
 		{
 			AssertMsg((bits & 0xFFFF0000) == 0, "PSSamplerModifiedBits must not exceed 15th index");
+			ProfileCounterAdd("Dirty Samplers", __popcnt(bits));
 
 			for_each_bit(i, bits)
 				context->PSSetSamplers(i, 1, &Renderer::Globals.m_SamplerStates[state->m_PSTextureAddressMode[i]][state->m_PSTextureFilterMode[i]]);
@@ -848,6 +874,7 @@ namespace BSGraphics
 		if (uint32_t bits = state->m_CSSamplerModifiedBits; bits != 0)
 		{
 			AssertMsg((bits & 0xFFFF0000) == 0, "CSSamplerModifiedBits must not exceed 15th index");
+			ProfileCounterAdd("Dirty Samplers", __popcnt(bits));
 
 			for_each_bit(i, bits)
 				context->CSSetSamplers(i, 1, &Renderer::Globals.m_SamplerStates[state->m_CSTextureAddressMode[i]][state->m_CSTextureFilterMode[i]]);
@@ -1253,15 +1280,35 @@ namespace BSGraphics
 		ComPtr<ID3DBlob> shaderBlob;
 		ComPtr<ID3DBlob> shaderErrors;
 
+		// Skip the compiler entirely if this exact permutation was built before
+		uint64_t cacheKey;
+		bool cacheable = ShaderCache::GetKey(FilePath, macros.data(), "main", ProgramType, flags, &cacheKey);
+
+		if (cacheable && ShaderCache::Find(cacheKey, &shaderBlob))
+			return shaderBlob;
+
 		if (FAILED(D3DCompileFromFile(FilePath, macros.data(), D3D_COMPILE_STANDARD_FILE_INCLUDE, "main", ProgramType, flags, 0, &shaderBlob, &shaderErrors)))
 		{
 			AssertMsgVa(false, "Shader compilation failed:\n\n%s", shaderErrors ? (const char *)shaderErrors->GetBufferPointer() : "Unknown error");
 			return nullptr;
 		}
 
+		if (cacheable)
+			ShaderCache::Insert(cacheKey, shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize());
+
 		return shaderBlob;
 	}
 
+	void Renderer::PrecompileShaders(const std::vector<ShaderCompileRequest>& Requests)
+	{
+		// D3DCompile is thread safe. Only the bytecode is produced here, device objects and
+		// reflection are still created one by one when the shaders are requested.
+		std::for_each(std::execution::par, Requests.begin(), Requests.end(), [this](const ShaderCompileRequest& Request)
+		{
+			CompileShader(Request.FilePath.c_str(), Request.Defines, Request.ProgramType);
+		});
+	}
+
 	VertexShader *Renderer::CompileVertexShader(const wchar_t *FilePath, const std::vector<std::pair<const char *, const char *>>& Defines, std::function<const char *(int Index)> GetConstant)
 	{
 		auto shaderBlob = CompileShader(FilePath, Defines, "vs_5_0");
@@ -1520,72 +1567,53 @@ namespace BSGraphics
 		auto codeCopy = std::make_unique<uint8_t[]>(BytecodeLength);
 		memcpy(codeCopy.get(), Bytecode, BytecodeLength);
 
-		ShaderBytecodeMap.emplace(Shader, std::make_pair(std::move(codeCopy), BytecodeLength));
+		// Shaders are created from several loader threads at once
+		auto entry = new std::pair<std::unique_ptr<uint8_t[]>, size_t>(std::move(codeCopy), BytecodeLength);
+
+		if (ShaderBytecodeMap.insert((uintptr_t)Shader, entry) != entry)
+			delete entry;
 	}
 
 	const std::pair<std::unique_ptr<uint8_t[]>, size_t>& Renderer::GetShaderBytecode(void *Shader)
 	{
-		return ShaderBytecodeMap.at(Shader);
+		std::pair<std::unique_ptr<uint8_t[]>, size_t> *entry = nullptr;
+		AssertMsg(ShaderBytecodeMap.find((uintptr_t)Shader, &entry), "Shader bytecode was never registered");
+
+		return *entry;
 	}
 
-	void *Renderer::AllocateAndMapDynamicVertexBuffer(uint32_t Size, uint32_t *OutOffset)
+	void Renderer::ReserveInputLayouts(uint32_t Count)
 	{
-		AssertMsg(Size > 0, "Size must be > 0");
-
-		uint32_t frameDataOffset = Globals.m_CurrentDynamicVertexBufferOffset;
-		uint32_t frameBufferIndex = Globals.m_CurrentDynamicVertexBuffer;
-		uint32_t newFrameDataSzie = Globals.m_CurrentDynamicVertexBufferOffset + Size;
-
-		//
-		// Check if this request would exceed the allocated buffer size for the currently executing command list. If it does,
-		// we end the current query and move on to the next buffer.
-		//
-		if (newFrameDataSzie > 0x400000)
-		{
-			AssertMsg(Size <= 0x400000, "Dynamic geometry buffer overflow.");
-
-			newFrameDataSzie = Size;
-			frameDataOffset = 0;
-
-			Globals.m_DynamicEventQueryFinished[Globals.m_CurrentDynamicVertexBuffer] = false;
-			Data.pContext->End(Globals.m_DynamicVertexBufferAvailQuery[Globals.m_CurrentDynamicVertexBuffer]);
-
-			frameBufferIndex++;
-
-			if (frameBufferIndex >= ARRAYSIZE(Globals.m_DynamicVertexBufferAvailQuery))
-				frameBufferIndex = 0;
-		}
+		InputLayoutMap.reserve(InputLayoutMap.size() + Count);
+	}
 
+	void *Renderer::AllocateAndMapDynamicVertexBuffer(uint32_t Size, uint32_t *OutOffset)
+	{
 		//
-		// This will suspend execution until the buffer we want is no longer in use. The query waits on a list of commands
-		// using said buffer.
+		// The engine rotated three fixed buffers here and slept until the next one was free. Data
+		// now comes from one ring that's retired with the frame completion queries in OnNewFrame().
 		//
-		if (!Globals.m_DynamicEventQueryFinished[frameBufferIndex])
-		{
-			ID3D11Query *query = Globals.m_DynamicVertexBufferAvailQuery[frameBufferIndex];
-			BOOL data;
-
-			HRESULT hr = Data.pContext->GetData(query, &data, sizeof(data), 0);
-
-			for (; FAILED(hr) || data == FALSE; hr = Data.pContext->GetData(query, &data, sizeof(data), D3D11_ASYNC_GETDATA_DONOTFLUSH))
-				Sleep(1);
-
-			Globals.m_DynamicEventQueryFinished[frameBufferIndex] = (data == TRUE);
-		}
+		return DynamicGeometryBuffer->MapData(Data.pContext, Size, OutOffset);
+	}
 
-		D3D11_MAPPED_SUBRESOURCE resource;
-		Data.pContext->Map(Globals.m_DynamicVertexBuffers[frameBufferIndex], 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &resource);
+	void BSGraphics::Renderer::UnmapDynamicVertexBuffer()
+	{
+		DynamicGeometryBuffer->UnmapData(Data.pContext);
+	}
 
-		Globals.m_CurrentDynamicVertexBuffer = frameBufferIndex;
-		Globals.m_CurrentDynamicVertexBufferOffset = newFrameDataSzie;
-		*OutOffset = frameDataOffset;
+	ID3D11Buffer *Renderer::GetDynamicVertexBuffer()
+	{
+		return DynamicGeometryBuffer->GetBuffer();
+	}
 
-		return (void *)((uintptr_t)resource.pData + frameDataOffset);
+	void Renderer::GetDynamicVertexBufferStats(DynamicGeometryRing::Stats *Stats)
+	{
+		DynamicGeometryBuffer->GetStats(Stats);
 	}
 
-	void BSGraphics::Renderer::UnmapDynamicVertexBuffer()
+	void Renderer::GetShaderConstantBufferStats(GpuCircularAllocator::Stats *Stats)
 	{
-		Data.pContext->Unmap(Globals.m_DynamicVertexBuffers[Globals.m_CurrentDynamicVertexBuffer], 0);
+		ShaderConstantBuffer->GetStats(Stats);
 	}
 
 	void *Renderer::MapDynamicTriShapeDynamicData(BSDynamicTriShape *DynTriShape, DynamicTriShape *TriShape, DynamicTriShapeDrawData *DrawData, uint32_t VertexSize)
@@ -1603,16 +1631,33 @@ namespace BSGraphics
 
 	CustomConstantGroup Renderer::GetShaderConstantGroup(uint32_t Size, ConstantGroupLevel Level)
 	{
+		// Not cleared: shader setup code writes the constants it uses. The bound range covers the
+		// whole aligned allocation.
 		CustomConstantGroup temp;
-		temp.m_Buffer = ShaderConstantBuffer->D3DBuffer;
-		temp.m_Map.pData = ShaderConstantBuffer->MapData(Data.pContext, Size, &temp.m_UnifiedByteOffset, false);
+		temp.m_Map.pData = ShaderConstantBuffer->MapData(Size, &temp.m_Buffer, &temp.m_UnifiedByteOffset);
 		temp.m_Map.DepthPitch = Size;
-		temp.m_Map.RowPitch = Size;
+		temp.m_Map.RowPitch = ShaderConstantBuffer->AlignSize(Size);
+		temp.m_Unified = true;
 
-		memset(temp.m_Map.pData, 0, Size);
 		return temp;
 	}
 
+	uint32_t Renderer::GetConstantGroupSize(ID3D11Buffer *Buffer)
+	{
+		// Shaders point at one of a few pool buffers. Only their size is needed here.
+		uint32_t size;
+
+		if (!ConstantGroupSizes.find((uintptr_t)Buffer, &size))
+		{
+			D3D11_BUFFER_DESC desc;
+			Buffer->GetDesc(&desc);
+
+			size = ConstantGroupSizes.insert((uintptr_t)Buffer, desc.ByteWidth);
+		}
+
+		return size;
+	}
+
 	VertexCGroup Renderer::GetShaderConstantGroup(VertexShader *Shader, ConstantGroupLevel Level)
 	{
 		ConstantGroup<VertexShader> temp;
@@ -1620,24 +1665,12 @@ namespace BSGraphics
 
 		if (group->m_Buffer)
 		{
-			D3D11_BUFFER_DESC desc;
-
-			if ((uintptr_t)group->m_Buffer > 0x10000)
-			{
-				group->m_Buffer->GetDesc(&desc);
-				group->m_Buffer = (ID3D11Buffer *)desc.ByteWidth;
-			}
-			else
-			{
-				desc.ByteWidth = (uint32_t)group->m_Buffer;
-			}
-
-			temp = GetShaderConstantGroup(desc.ByteWidth, Level);
+			temp = GetShaderConstantGroup(GetConstantGroupSize(group->m_Buffer), Level);
 		}
 		else
 		{
+			// Engine-owned memory, size is unknown here
 			temp.m_Map.pData = group->m_Data;
-			// Size to memset() is unknown here
 		}
 
 		temp.m_Shader = Shader;
@@ -1651,24 +1684,12 @@ namespace BSGraphics
 
 		if (group->m_Buffer)
 		{
-			D3D11_BUFFER_DESC desc;
-
-			if ((uintptr_t)group->m_Buffer > 0x10000)
-			{
-				group->m_Buffer->GetDesc(&desc);
-				group->m_Buffer = (ID3D11Buffer *)desc.ByteWidth;
-			}
-			else
-			{
-				desc.ByteWidth = (uint32_t)group->m_Buffer;
-			}
-
-			temp = GetShaderConstantGroup(desc.ByteWidth, Level);
+			temp = GetShaderConstantGroup(GetConstantGroupSize(group->m_Buffer), Level);
 		}
 		else
 		{
+			// Engine-owned memory, size is unknown here
 			temp.m_Map.pData = group->m_Data;
-			// Size to memset() is unknown here
 		}
 
 		temp.m_Shader = Shader;
@@ -1677,6 +1698,17 @@ namespace BSGraphics
 
 	void Renderer::FlushConstantGroup(CustomConstantGroup *Group)
 	{
+		if (Group->m_Unified && Group->m_Map.pData != (void *)0xFEFEFEFEFEFEFEFE)
+		{
+			// Bind up to the last written constant. Reads past the bound range return zero, and every
+			// unwritten byte before that (skipped constants and the tail of the last block) is cleared.
+			uint32_t blockSize = ShaderConstantBuffer->GetAlignment();
+			uint32_t boundSize = Group->m_Written.BoundSize(blockSize, Group->m_Map.RowPitch);
+
+			Group->m_Written.ClearGaps(Group->m_Map.pData, 0, boundSize);
+			Group->m_Map.RowPitch = boundSize;
+		}
+
 		// Invalidate the data pointer only - ApplyConstantGroup still needs RowPitch info
 		Group->m_Map.pData = (void *)0xFEFEFEFEFEFEFEFE;
 	}
@@ -1725,6 +1757,9 @@ namespace BSGraphics
 	{
 		if (InterlockedDecrement(&Shape->m_RefCount) == 0)
 		{
+			// The address can be reused by the next shape
+			MOC::RemoveCachedVerticesAndIndices(Shape);
+
 			if (Shape->m_VertexBuffer)
 				Shape->m_VertexBuffer->Release();
 
@@ -8,6 +8,8 @@
 #include "BSGraphicsState.h"
 #include "BSGraphicsTypes.h"
 #include "../BSShader/BSShaderRenderTargets.h"
+#include "../../rendering/DynamicGeometryRing.h"
+#include "../../rendering/GpuCircularAllocator.h"
 
 namespace BSGraphics
 {
@@ -30,6 +32,9 @@ namespace BSGraphics
 		// is sufficient space. If there's no space left, delay execution until m_DynamicVertexBufferAvailQuery[] says a buffer
 		// is no longer in use.
 		//
+		// Renderer::AllocateAndMapDynamicVertexBuffer no longer touches these (see DynamicGeometryRing). Engine code
+		// that binds them directly must be pointed at Renderer::GetDynamicVertexBuffer() first.
+		//
 		ID3D11Buffer		*m_DynamicVertexBuffers[3];			// DYNAMIC (VERTEX | INDEX) CPU_ACCESS_WRITE
 		uint32_t			m_CurrentDynamicVertexBuffer;
 
@@ -180,6 +185,13 @@ namespace BSGraphics
 		char _pad0[0xC];
 	};
 
+	struct ShaderCompileRequest
+	{
+		std::wstring FilePath;
+		std::vector<std::pair<const char *, const char *>> Defines;
+		const char *ProgramType;
+	};
+
 	class Renderer
 	{
 	public:
@@ -275,6 +287,7 @@ namespace BSGraphics
 		// Shaders
 		//
 		ComPtr<ID3DBlob> CompileShader(const wchar_t *FilePath, const std::vector<std::pair<const char *, const char *>>& Defines, const char *ProgramType);
+		void PrecompileShaders(const std::vector<ShaderCompileRequest>& Requests);
 		VertexShader *CompileVertexShader(const wchar_t *FilePath, const std::vector<std::pair<const char *, const char *>>& Defines, std::function<const char *(int Index)> GetConstant);
 		PixelShader *CompilePixelShader(const wchar_t *FilePath, const std::vector<std::pair<const char *, const char *>>& Defines, std::function<const char *(int Index)> GetSampler, std::function<const char *(int Index)> GetConstant);
 		HullShader *CompileHullShader(const wchar_t *FilePath, const std::vector<std::pair<const char *, const char *>>& Defines);
@@ -288,23 +301,28 @@ namespace BSGraphics
 		void ValidateShaderReplacement(void *Original, void *Replacement, const GUID& Guid);
 		void RegisterShaderBytecode(void *Shader, const void *Bytecode, size_t BytecodeLength);
 		const std::pair<std::unique_ptr<uint8_t[]>, size_t>& Renderer::GetShaderBytecode(void *Shader);
+		void ReserveInputLayouts(uint32_t Count);
 
 		//
 		// Buffers
 		//
 		void *AllocateAndMapDynamicVertexBuffer(uint32_t Size, uint32_t *OutOffset);
 		void UnmapDynamicVertexBuffer();
+		ID3D11Buffer *GetDynamicVertexBuffer();
+		void GetDynamicVertexBufferStats(DynamicGeometryRing::Stats *Stats);
 		void *MapDynamicTriShapeDynamicData(BSDynamicTriShape *DynTriShape, DynamicTriShape *TriShape, DynamicTriShapeDrawData *DrawData, uint32_t VertexSize);
 		void UnmapDynamicTriShapeDynamicData(DynamicTriShape *TriShape, DynamicTriShapeDrawData *DrawData);
 
 		CustomConstantGroup GetShaderConstantGroup(uint32_t Size, ConstantGroupLevel Level);
 		VertexCGroup GetShaderConstantGroup(VertexShader *Shader, ConstantGroupLevel Level);
 		PixelCGroup GetShaderConstantGroup(PixelShader *Shader, ConstantGroupLevel Level);
+		uint32_t GetConstantGroupSize(ID3D11Buffer *Buffer);
 		void FlushConstantGroup(CustomConstantGroup *Group);
 		void FlushConstantGroupVSPS(VertexCGroup *VertexGroup, PixelCGroup *PixelGroup);
 		void ApplyConstantGroupVS(const CustomConstantGroup *Group, ConstantGroupLevel Level);
 		void ApplyConstantGroupPS(const CustomConstantGroup *Group, ConstantGroupLevel Level);
 		void ApplyConstantGroupVSPS(const VertexCGroup *VertexGroup, const PixelCGroup *PixelGroup, ConstantGroupLevel Level);
+		void GetShaderConstantBufferStats(GpuCircularAllocator::Stats *Stats);
 
 		void IncRef(TriShape *Shape);
 		void DecRef(TriShape *Shape);
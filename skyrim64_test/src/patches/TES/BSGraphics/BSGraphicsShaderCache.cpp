@@ -0,0 +1,277 @@
+#include "../../../common.h"
+#include <d3dcompiler.h>
+#include <wrl/client.h>
+#include "../FlatScatterTable.h"
+#include "BSGraphicsShaderCache.h"
+
+namespace BSGraphics::ShaderCache
+{
+	const static char *PackFilePath		= "skyrim64_shadercache.bin";
+	const static uint32_t PackMagic		= 'CSKS';
+	const static uint32_t PackVersion	= 1;
+
+	struct PackHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+	};
+
+	struct RecordHeader
+	{
+		uint64_t Key;
+		uint32_t Size;
+		uint32_t Checksum;	// Low half of the bytecode hash
+	};
+
+	struct CacheEntry
+	{
+		const uint8_t *Data;
+		uint32_t Size;
+	};
+
+	SRWLOCK CacheLock = SRWLOCK_INIT;
+	FlatScatterTable<uint64_t, CacheEntry> Entries;
+	std::vector<std::unique_ptr<uint8_t[]>> InsertedData;	// Entries compiled since the pack was mapped
+
+	HANDLE PackFile = INVALID_HANDLE_VALUE;
+	HANDLE PackMapping;
+	const uint8_t *PackView;
+	uint64_t PackLength;
+
+	uint64_t AlignRecord(uint64_t Size)
+	{
+		return (Size + 7) & ~7ull;
+	}
+
+	uint64_t ScanPack(const uint8_t *Data, uint64_t Length)
+	{
+		// Returns the length of the valid prefix
+		uint64_t offset = sizeof(PackHeader);
+
+		while (offset + sizeof(RecordHeader) <= Length)
+		{
+			auto record = (const RecordHeader *)(Data + offset);
+			const uint8_t *bytecode = Data + offset + sizeof(RecordHeader);
+
+			if (record->Size == 0 || offset + AlignRecord(sizeof(RecordHeader) + record->Size) > Length)
+				break;
+
+			if ((uint32_t)XUtil::MurmurHash64A(bytecode, record->Size) != record->Checksum)
+				break;
+
+			Entries.insert_or_assign(record->Key, { bytecode, record->Size });
+			offset += AlignRecord(sizeof(RecordHeader) + record->Size);
+		}
+
+		return offset;
+	}
+
+	bool MapPack()
+	{
+		PackMapping = CreateFileMappingA(PackFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+		if (!PackMapping)
+			return false;
+
+		PackView = (const uint8_t *)MapViewOfFile(PackMapping, FILE_MAP_READ, 0, 0, 0);
+		return PackView != nullptr;
+	}
+
+	void UnmapPack()
+	{
+		Entries.clear();
+
+		if (PackView)
+			UnmapViewOfFile(PackView);
+
+		if (PackMapping)
+			CloseHandle(PackMapping);
+
+		PackView = nullptr;
+		PackMapping = nullptr;
+	}
+
+	bool ResetPack()
+	{
+		UnmapPack();
+
+		LARGE_INTEGER start = {};
+		PackHeader header = { PackMagic, PackVersion };
+		DWORD bytesWritten;
+
+		if (!SetFilePointerEx(PackFile, start, nullptr, FILE_BEGIN) || !SetEndOfFile(PackFile))
+			return false;
+
+		if (!WriteFile(PackFile, &header, sizeof(header), &bytesWritten, nullptr) || bytesWritten != sizeof(header))
+			return false;
+
+		PackLength = sizeof(header);
+		return true;
+	}
+
+	bool OpenPack()
+	{
+		PackFile = CreateFileA(PackFilePath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+		if (PackFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+
+		if (!GetFileSizeEx(PackFile, &fileSize))
+			return false;
+
+		if ((uint64_t)fileSize.QuadPart <= sizeof(PackHeader))
+			return ResetPack();
+
+		if (!MapPack())
+			return ResetPack();
+
+		auto header = (const PackHeader *)PackView;
+
+		if (header->Magic != PackMagic || header->Version != PackVersion)
+			return ResetPack();
+
+		PackLength = ScanPack(PackView, fileSize.QuadPart);
+
+		if (PackLength < (uint64_t)fileSize.QuadPart)
+		{
+			// Cut off the torn record. The file can't shrink while it's mapped.
+			UnmapPack();
+
+			LARGE_INTEGER end;
+			end.QuadPart = PackLength;
+
+			if (!SetFilePointerEx(PackFile, end, nullptr, FILE_BEGIN) || !SetEndOfFile(PackFile) || !MapPack())
+				return ResetPack();
+
+			ScanPack(PackView, PackLength);
+		}
+
+		return true;
+	}
+
+	bool Initialize()
+	{
+		static bool initialized = []()
+		{
+			if (OpenPack())
+				return true;
+
+			UnmapPack();
+
+			if (PackFile != INVALID_HANDLE_VALUE)
+				CloseHandle(PackFile);
+
+			PackFile = INVALID_HANDLE_VALUE;
+			return false;
+		}();
+
+		return initialized;
+	}
+
+	bool GetKey(const wchar_t *FilePath, const D3D_SHADER_MACRO *Macros, const char *EntryPoint, const char *ProgramType, uint32_t Flags, uint64_t *Key)
+	{
+		HANDLE file = CreateFileW(FilePath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+		std::unique_ptr<char[]> source;
+		DWORD bytesRead = 0;
+
+		if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart < std::numeric_limits<DWORD>::max())
+		{
+			source.reset(new char[(size_t)fileSize.QuadPart]);
+
+			if (!ReadFile(file, source.get(), (DWORD)fileSize.QuadPart, &bytesRead, nullptr) || bytesRead != fileSize.QuadPart)
+				source.reset();
+		}
+
+		CloseHandle(file);
+
+		if (!source)
+			return false;
+
+		// Preprocessing is cheap compared to a compile and pulls every include into the hash
+		char sourceName[MAX_PATH];
+		sprintf_s(sourceName, "%S", FilePath);
+
+		Microsoft::WRL::ComPtr<ID3DBlob> preprocessed;
+
+		if (FAILED(D3DPreprocess(source.get(), bytesRead, sourceName, Macros, D3D_COMPILE_STANDARD_FILE_INCLUDE, &preprocessed, nullptr)))
+			return false;
+
+		uint64_t hash = XUtil::MurmurHash64A(preprocessed->GetBufferPointer(), preprocessed->GetBufferSize(), D3D_COMPILER_VERSION);
+		hash = XUtil::MurmurHash64A(EntryPoint, strlen(EntryPoint), hash);
+		hash = XUtil::MurmurHash64A(ProgramType, strlen(ProgramType), hash);
+		hash = XUtil::MurmurHash64A(&Flags, sizeof(Flags), hash);
+
+		*Key = hash;
+		return true;
+	}
+
+	bool Find(uint64_t Key, ID3DBlob **Blob)
+	{
+		if (!Initialize())
+			return false;
+
+		bool found = false;
+
+		AcquireSRWLockShared(&CacheLock);
+		{
+			if (CacheEntry *entry = Entries.find(Key))
+			{
+				if (SUCCEEDED(D3DCreateBlob(entry->Size, Blob)))
+				{
+					memcpy((*Blob)->GetBufferPointer(), entry->Data, entry->Size);
+					found = true;
+				}
+			}
+		}
+		ReleaseSRWLockShared(&CacheLock);
+
+		return found;
+	}
+
+	void Insert(uint64_t Key, const void *Bytecode, size_t BytecodeLength)
+	{
+		if (!Initialize() || BytecodeLength == 0 || BytecodeLength >= std::numeric_limits<uint32_t>::max())
+			return;
+
+		auto data = std::make_unique<uint8_t[]>(BytecodeLength);
+		memcpy(data.get(), Bytecode, BytecodeLength);
+
+		RecordHeader header;
+		header.Key = Key;
+		header.Size = (uint32_t)BytecodeLength;
+		header.Checksum = (uint32_t)XUtil::MurmurHash64A(Bytecode, BytecodeLength);
+
+		const static uint8_t padding[8] = {};
+		uint64_t paddingLength = AlignRecord(sizeof(header) + BytecodeLength) - (sizeof(header) + BytecodeLength);
+
+		AcquireSRWLockExclusive(&CacheLock);
+		{
+			if (!Entries.find(Key))
+			{
+				// A failed write only loses this entry, the next scan stops at the broken record
+				LARGE_INTEGER end;
+				end.QuadPart = PackLength;
+				DWORD bytesWritten;
+
+				if (SetFilePointerEx(PackFile, end, nullptr, FILE_BEGIN) &&
+					WriteFile(PackFile, &header, sizeof(header), &bytesWritten, nullptr) &&
+					WriteFile(PackFile, Bytecode, (DWORD)BytecodeLength, &bytesWritten, nullptr) &&
+					WriteFile(PackFile, padding, (DWORD)paddingLength, &bytesWritten, nullptr))
+				{
+					PackLength += sizeof(header) + BytecodeLength + paddingLength;
+				}
+
+				Entries.insert(Key, { data.get(), header.Size });
+				InsertedData.emplace_back(std::move(data));
+			}
+		}
+		ReleaseSRWLockExclusive(&CacheLock);
+	}
+}
\ No newline at end of file
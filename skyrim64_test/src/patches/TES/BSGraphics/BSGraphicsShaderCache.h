@@ -0,0 +1,18 @@
+#pragma once
+
+#include <d3dcommon.h>
+
+//
+// Content addressed cache for compiled shader bytecode. The key covers the preprocessed source
+// (every include and define already expanded), entry point, target profile, compile flags and
+// compiler version. Nothing ever goes stale: an edit anywhere in the source changes the key.
+//
+// Entries live in an append-only pack file that is memory mapped on startup. A record torn by a
+// crash is cut off the next time the pack is opened.
+//
+namespace BSGraphics::ShaderCache
+{
+	bool GetKey(const wchar_t *FilePath, const D3D_SHADER_MACRO *Macros, const char *EntryPoint, const char *ProgramType, uint32_t Flags, uint64_t *Key);
+	bool Find(uint64_t Key, ID3DBlob **Blob);
+	void Insert(uint64_t Key, const void *Bytecode, size_t BytecodeLength);
+}
\ No newline at end of file
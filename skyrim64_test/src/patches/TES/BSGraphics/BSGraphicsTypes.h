@@ -1,5 +1,7 @@
 #pragma once
 
+#include "BSGraphicsConstantRange.h"
+
 #define MAX_SHARED_PARTICLES_SIZE 2048
 #define MAX_PARTICLE_STRIP_COUNT 51200
 
@@ -231,12 +233,34 @@ namespace BSGraphics
 		ID3D11Buffer *m_Buffer = nullptr;
 		bool m_Unified = false;				// True if buffer is from global ring buffer
 		uint32_t m_UnifiedByteOffset = 0;	// Offset into ring buffer
+		mutable ConstantRange m_Written;	// Unwritten bytes are zeroed in FlushConstantGroup()
+
+		// Only ring buffer memory is cleared, engine-owned groups never were
+		inline void *GetClearTarget() const
+		{
+			return m_Unified ? m_Map.pData : nullptr;
+		}
 
 	public:
+		// Untyped access: the whole allocation is zeroed where it wasn't written yet
 		inline void *RawData() const
 		{
+			m_Written.Cover(GetClearTarget(), 0, m_Map.DepthPitch);
 			return m_Map.pData;
 		}
+
+		template<typename U>
+		U *Data() const
+		{
+			m_Written.Cover(GetClearTarget(), 0, sizeof(U));
+			return (U *)m_Map.pData;
+		}
+
+		void Write(uint32_t Offset, const void *Source, uint32_t Size)
+		{
+			m_Written.Mark(GetClearTarget(), Offset, Size);
+			memcpy((void *)((uintptr_t)m_Map.pData + Offset), Source, Size);
+		}
 	};
 
 	template<typename T>
@@ -252,10 +276,11 @@ namespace BSGraphics
 		{
 			static_assert(sizeof(U) <= sizeof(EmptyWriteBuffer));
 
-			if (RawData() == nullptr || Offset == INVALID_CONSTANT_BUFFER_OFFSET)
+			if (m_Map.pData == nullptr || Offset == INVALID_CONSTANT_BUFFER_OFFSET)
 				return *(U *)EmptyWriteBuffer;
 
-			return *(U *)((uintptr_t)RawData() + (Offset * sizeof(float)));
+			m_Written.Mark(GetClearTarget(), Offset * sizeof(float), sizeof(U));
+			return *(U *)((uintptr_t)m_Map.pData + (Offset * sizeof(float)));
 		}
 
 	public:
@@ -283,6 +308,7 @@ namespace BSGraphics
 			m_Buffer = Other.m_Buffer;
 			m_Unified = Other.m_Unified;
 			m_UnifiedByteOffset = Other.m_UnifiedByteOffset;
+			m_Written = Other.m_Written;
 			m_Shader = nullptr;
 
 			return *this;
@@ -118,47 +118,198 @@ const std::unordered_map<uintptr_t, std::string> BSJobs::JobNameMap =
 	{ 0xC33790, "JobListEnd" },
 };
 
-std::unordered_map<uintptr_t, BSJobs::TrackingInfo> BSJobs::JobTracker;
+uintptr_t *BSJobs::TrackerOffsets;
+BSJobs::TrackingInfo *BSJobs::TrackerEntries;
+uint32_t BSJobs::TrackerCount;
 #if SKYRIM64_USE_TRACY
-std::unordered_map<uintptr_t, tracy::SourceLocationData> TracySourceMap;
+tracy::SourceLocationData *TracySourceLocations;
 #endif
 
-void BSJobs::DispatchJobCallback(void *Parameter, void(*Function)(void *))
+void BSJobs::InitializeTracker()
 {
 	// Populate the static tables once - abuse thread safe statics to call a function instead
 	static int threadSafeInit = []() -> int
 	{
+		std::vector<std::pair<uintptr_t, const char *>> sortedNames;
+
 		for (auto& nameEntry : BSJobs::JobNameMap)
-		{
+			sortedNames.emplace_back(nameEntry.first, nameEntry.second.c_str());
+
+		std::sort(sortedNames.begin(), sortedNames.end());
+
+		// Value initialization zeroes every counter and histogram bucket
+		TrackerCount = (uint32_t)sortedNames.size();
+		TrackerOffsets = new uintptr_t[TrackerCount];
+		TrackerEntries = new TrackingInfo[TrackerCount]();
 #if SKYRIM64_USE_TRACY
-			tracy::SourceLocationData srcLocation{ nameEntry.second.c_str(), nameEntry.second.c_str(), "<unknown>", 0, 0 };
-			TracySourceMap.insert_or_assign(nameEntry.first, srcLocation);
+		TracySourceLocations = new tracy::SourceLocationData[TrackerCount];
 #endif
 
-			// These only need to be initialized to zero (hacky code here)
-			BSJobs::JobTracker[nameEntry.first] = {};
+		for (uint32_t i = 0; i < TrackerCount; i++)
+		{
+			TrackerOffsets[i] = sortedNames[i].first;
+			TrackerEntries[i].Name = sortedNames[i].second;
 
-			auto& ref = BSJobs::JobTracker[nameEntry.first];
-			ref.Name = nameEntry.second;
-			ref.TotalCount.store(0);
-			ref.ActiveCount.store(0);
+#if SKYRIM64_USE_TRACY
+			TracySourceLocations[i] = { sortedNames[i].second, sortedNames[i].second, "<unknown>", 0, 0 };
+#endif
 		}
 
 		return 0;
 	}();
+}
+
+BSJobs::TrackingInfo *BSJobs::GetTrackingInfo(uintptr_t Offset)
+{
+	InitializeTracker();
+
+	uintptr_t *entry = std::lower_bound(TrackerOffsets, TrackerOffsets + TrackerCount, Offset);
+
+	if (entry == TrackerOffsets + TrackerCount || *entry != Offset)
+		return nullptr;
+
+	return &TrackerEntries[entry - TrackerOffsets];
+}
+
+BSJobs::TrackingInfo *BSJobs::GetTrackingInfo(void(*Function)(void *))
+{
+	return GetTrackingInfo((uintptr_t)Function - g_ModuleBase);
+}
+
+void BSJobs::RunTracked(TrackingInfo *Info, void *Parameter, void(*Function)(void *))
+{
+	Info->TotalCount.fetch_add(1, std::memory_order_relaxed);
+	Info->FrameCount.fetch_add(1, std::memory_order_relaxed);
+	Info->ActiveCount.fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t start = GetTimestamp();
+	Function(Parameter);
+	uint64_t end = GetTimestamp();
 
-	// Now do actual work
-	uintptr_t offset = (uintptr_t)Function - g_ModuleBase;
-	auto counterEntry = JobTracker.find(offset);
+	Info->ActiveCount.fetch_sub(1, std::memory_order_relaxed);
+	Info->Latency.Record(TimestampToNanoseconds(end - start));
+}
 
-	AssertMsgVa(counterEntry != JobTracker.end(), "Unknown job callback 0x%p", offset);
+void BSJobs::DispatchJobCallback(void *Parameter, void(*Function)(void *))
+{
+	TrackingInfo *info = GetTrackingInfo(Function);
 
-	counterEntry->second.TotalCount++;
-	counterEntry->second.ActiveCount++;
+	AssertMsgVa(info, "Unknown job callback 0x%p", (uintptr_t)Function - g_ModuleBase);
 
 #if SKYRIM64_USE_TRACY
-	tracy::ScopedZone ___tracy_scoped_zone(&TracySourceMap[offset]);
+	tracy::ScopedZone ___tracy_scoped_zone(&TracySourceLocations[info - TrackerEntries]);
 #endif
 
-	Function(Parameter);
+	RunTracked(info, Parameter, Function);
+}
+
+uint64_t BSJobs::GetTimestamp()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	return counter.QuadPart;
+}
+
+uint64_t BSJobs::TimestampToNanoseconds(uint64_t Delta)
+{
+	static double nanosecondsPerTick = []()
+	{
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+
+		return 1000000000.0 / (double)frequency.QuadPart;
+	}();
+
+	return (uint64_t)((double)Delta * nanosecondsPerTick);
+}
+
+uint32_t BSJobs::LatencyHistogram::ValueToBucket(uint64_t Value)
+{
+	Value = std::min<uint64_t>(Value, (1ull << MaxValueBits) - 1);
+
+	if (Value < 2 * SubBucketCount)
+		return (uint32_t)Value;
+
+	// The top SubBucketBits + 1 bits select the bucket, everything below them is dropped
+	unsigned long msb;
+	_BitScanReverse64(&msb, Value);
+
+	uint32_t shift = msb - SubBucketBits;
+	return (shift * SubBucketCount) + (uint32_t)(Value >> shift);
+}
+
+uint64_t BSJobs::LatencyHistogram::BucketToValue(uint32_t Bucket)
+{
+	if (Bucket < 2 * SubBucketCount)
+		return Bucket;
+
+	// Highest value that still maps to this bucket
+	uint32_t shift = (Bucket / SubBucketCount) - 1;
+	uint64_t subBucket = (Bucket % SubBucketCount) + SubBucketCount;
+
+	return ((subBucket + 1) << shift) - 1;
+}
+
+void BSJobs::LatencyHistogram::Record(uint64_t Value)
+{
+	Buckets[ValueToBucket(Value)].fetch_add(1, std::memory_order_relaxed);
+
+	for (uint64_t max = MaxValue.load(std::memory_order_relaxed); Value > max;)
+	{
+		if (MaxValue.compare_exchange_weak(max, Value, std::memory_order_relaxed))
+			break;
+	}
+}
+
+void BSJobs::LatencyHistogram::Reset()
+{
+	for (auto& bucket : Buckets)
+		bucket.store(0, std::memory_order_relaxed);
+
+	MaxValue.store(0, std::memory_order_relaxed);
+}
+
+uint64_t BSJobs::LatencyHistogram::GetTotalCount() const
+{
+	uint64_t total = 0;
+
+	for (auto& bucket : Buckets)
+		total += bucket.load(std::memory_order_relaxed);
+
+	return total;
+}
+
+uint64_t BSJobs::LatencyHistogram::GetPercentile(double Percentile) const
+{
+	// Buckets keep changing while this runs. The result is approximate either way.
+	uint64_t counts[BucketCount];
+	uint64_t total = 0;
+
+	for (uint32_t i = 0; i < BucketCount; i++)
+	{
+		counts[i] = Buckets[i].load(std::memory_order_relaxed);
+		total += counts[i];
+	}
+
+	if (total == 0)
+		return 0;
+
+	uint64_t target = std::max<uint64_t>((uint64_t)((std::clamp(Percentile, 0.0, 100.0) / 100.0) * (double)total + 0.5), 1);
+	uint64_t seen = 0;
+
+	for (uint32_t i = 0; i < BucketCount; i++)
+	{
+		seen += counts[i];
+
+		if (seen >= target)
+			return std::min(BucketToValue(i), GetMax());
+	}
+
+	return GetMax();
+}
+
+uint64_t BSJobs::LatencyHistogram::GetMax() const
+{
+	return MaxValue.load(std::memory_order_relaxed);
 }
\ No newline at end of file
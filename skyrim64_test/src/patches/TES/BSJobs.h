@@ -6,23 +6,66 @@
 class BSJobs
 {
 public:
+	//
+	// Log-linear latency histogram (HDR style). Values below 2 * SubBucketCount get exact buckets,
+	// every power of two above that is split into SubBucketCount linear sub-buckets, so the
+	// relative error stays under 1 / SubBucketCount at any magnitude. Recording never takes a lock.
+	//
+	struct LatencyHistogram
+	{
+		const static uint32_t SubBucketBits		= 4;
+		const static uint32_t SubBucketCount	= 1u << SubBucketBits;
+		const static uint32_t MaxValueBits		= 36;	// ~68 seconds in nanoseconds, larger values are clamped
+		const static uint32_t BucketCount		= ((MaxValueBits - SubBucketBits - 1) * SubBucketCount) + (2 * SubBucketCount);
+
+		std::atomic_uint64_t Buckets[BucketCount];
+		std::atomic_uint64_t MaxValue;
+
+		void Record(uint64_t Value);
+		void Reset();
+		uint64_t GetTotalCount() const;
+		uint64_t GetPercentile(double Percentile) const;
+		uint64_t GetMax() const;
+
+		static uint32_t ValueToBucket(uint64_t Value);
+		static uint64_t BucketToValue(uint32_t Bucket);
+	};
+
 	struct TrackingInfo
 	{
-		std::string Name;
+		const char *Name;
 		std::atomic_uint64_t TotalCount;	// Total number of invocations
 		std::atomic_uint32_t ActiveCount;	// Currently running # of instances
-
-		TrackingInfo& operator=(const TrackingInfo& Other)
-		{
-			Name = Other.Name;
-			TotalCount = Other.TotalCount.load();
-			ActiveCount = Other.ActiveCount.load();
-			return *this;
-		}
+		std::atomic_uint32_t FrameCount;	// Invocations since the Job List window last read it with exchange(0)
+		LatencyHistogram Latency;			// Run time in nanoseconds
 	};
 
 	const static std::unordered_map<uintptr_t, std::string> JobNameMap;
-	static std::unordered_map<uintptr_t, BSJobs::TrackingInfo> JobTracker;
 
 	static void DispatchJobCallback(void *Parameter, void(*Function)(void *));
+
+	static TrackingInfo *GetTrackingInfo(uintptr_t Offset);
+	static TrackingInfo *GetTrackingInfo(void(*Function)(void *));
+	static void RunTracked(TrackingInfo *Info, void *Parameter, void(*Function)(void *));
+
+	template<typename Callback>
+	static void ForEachTrackingInfo(Callback&& Functor)
+	{
+		InitializeTracker();
+
+		for (uint32_t i = 0; i < TrackerCount; i++)
+			Functor(TrackerOffsets[i], TrackerEntries[i]);
+	}
+
+	static uint64_t GetTimestamp();
+	static uint64_t TimestampToNanoseconds(uint64_t Delta);
+
+private:
+	// Read-only after InitializeTracker(): lookups are a binary search over sorted offsets
+	// without any locks
+	static uintptr_t *TrackerOffsets;
+	static TrackingInfo *TrackerEntries;
+	static uint32_t TrackerCount;
+
+	static void InitializeTracker();
 };
\ No newline at end of file
@@ -75,8 +75,8 @@ void BSShader::SetBoneMatrix(NiSkinInstance *SkinInstance, NiSkinPartition::Part
 	auto boneDataConstants = renderer->GetShaderConstantGroup(v11, BSGraphics::CONSTANT_GROUP_LEVEL_BONES);
 	auto prevBoneDataConstants = renderer->GetShaderConstantGroup(v11, BSGraphics::CONSTANT_GROUP_LEVEL_PREVIOUS_BONES);
 
-	memcpy_s(boneDataConstants.RawData(), v11, SkinInstance->m_pvBoneMatrices, v11);
-	memcpy_s(prevBoneDataConstants.RawData(), v11, SkinInstance->m_pvPrevBoneMatrices, v11);
+	boneDataConstants.Write(0, SkinInstance->m_pvBoneMatrices, v11);
+	prevBoneDataConstants.Write(0, SkinInstance->m_pvPrevBoneMatrices, v11);
 
 	renderer->FlushConstantGroup(&boneDataConstants);
 	renderer->FlushConstantGroup(&prevBoneDataConstants);
@@ -169,11 +169,36 @@ void BSShader::CreateDomainShader(uint32_t Technique, const char *SourceFile, co
 	DomainShaders[Technique] = domainShader;
 }
 
+void BSShader::PrecompileShaders(const char *SourceFile, const std::vector<std::vector<std::pair<const char *, const char *>>>& DefineSets, const std::vector<const char *>& ProgramTypes)
+{
+	wchar_t fxpPath[MAX_PATH];
+	swprintf_s(fxpPath, L"C:\\SA\\ShaderSource\\%S.hlsl", SourceFile);
+
+	std::vector<BSGraphics::ShaderCompileRequest> requests;
+
+	for (auto& defines : DefineSets)
+	{
+		for (const char *programType : ProgramTypes)
+			requests.push_back({ fxpPath, defines, programType });
+	}
+
+	BSGraphics::Renderer::QInstance()->PrecompileShaders(requests);
+}
+
 void BSShader::hk_Load(BSIStream *Stream)
 {
 	// Load original shaders first
 	(this->*Load)(Stream);
 
+	// Geometry usually matches a vertex shader's inputs exactly, so each distinct description is
+	// likely to need an input layout. Size the table now instead of growing it mid-frame.
+	std::unordered_set<uint64_t> vertexDescs;
+
+	for (auto itr = m_VertexShaderTable.begin(); itr != m_VertexShaderTable.end(); itr++)
+		vertexDescs.insert(itr->m_VertexDescription);
+
+	BSGraphics::Renderer::QInstance()->ReserveInputLayouts((uint32_t)vertexDescs.size());
+
 	// Dump everything for debugging
 	for (auto itr = m_VertexShaderTable.begin(); itr != m_VertexShaderTable.end(); itr++)
 	{
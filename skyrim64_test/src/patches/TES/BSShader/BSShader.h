@@ -131,6 +131,11 @@ private:
 		{
 			return m_Value->m_TechniqueID;
 		}
+
+		void Set(uint32_t Key, const T& Value)
+		{
+			m_Value = Value;
+		}
 	};
 
 	template<typename T, typename Storage = TechniqueIDStorage<T>>
@@ -179,6 +184,13 @@ public:
 	void CreateHullShader(uint32_t Technique, const char *SourceFile, const std::vector<std::pair<const char *, const char *>>& Defines);
 	void CreateDomainShader(uint32_t Technique, const char *SourceFile, const std::vector<std::pair<const char *, const char *>>& Defines);
 
+	// Fills the shader cache for every define set and program type in parallel. Create*Shader calls
+	// for the same permutations are then cache hits.
+	void PrecompileShaders(
+		const char *SourceFile,
+		const std::vector<std::vector<std::pair<const char *, const char *>>>& DefineSets,
+		const std::vector<const char *>& ProgramTypes);
+
 	void hk_Load(BSIStream *Stream);
 
 	bool BeginTechnique(uint32_t VertexShaderID, uint32_t PixelShaderID, bool IgnorePixelShader);
@@ -6,6 +6,7 @@
 #include "BSShaderAccumulator.h"
 #include "../BSReadWriteLock.h"
 #include "../MOC.h"
+#include "../NiMain/NiCamera.h"
 
 AutoPtr(BSShaderAccumulator *, ZPrePassAccumulator, 0x3257A68);
 AutoPtr(BSShaderAccumulator *, MainPassAccumulator, 0x3257A70);
@@ -539,6 +540,10 @@ void BSShaderAccumulator::RenderBatches(uint32_t StartTechnique, uint32_t EndTec
 		batch->m_CurrentFirstPass = StartTechnique;
 		batch->m_CurrentLastPass = EndTechnique;
 
+		// Sorting only needs the camera for depth. Without one, draws still group by state.
+		const bool sortDraws = ui::opt::EnableDrawSorting;
+		const NiPoint3 viewPosition = m_pkCamera ? m_pkCamera->GetWorldLocation() : NiPoint3::ZERO;
+
 		m_CurrentBucket = 0;
 		m_CurrentActive = batch->sub_14131E700(m_CurrentPass, m_CurrentBucket, activeListHead);
 
@@ -546,9 +551,14 @@ void BSShaderAccumulator::RenderBatches(uint32_t StartTechnique, uint32_t EndTec
 		{
 			if (IsGrassShadowBlacklist(m_CurrentPass) && (m_1stPerson || *(BYTE *)((__int64)this + 297)))// if (is grass shadow) ???
 				m_CurrentActive = batch->DiscardBatches(m_CurrentPass, m_CurrentBucket, activeListHead);
+			else if (sortDraws)
+				m_CurrentActive = batch->QueueBatches(m_CurrentPass, m_CurrentBucket, activeListHead, viewPosition, RenderFlags);
 			else
 				m_CurrentActive = batch->RenderBatches(m_CurrentPass, m_CurrentBucket, activeListHead, RenderFlags);
 		}
+
+		if (sortDraws)
+			BSBatchRenderer::SubmitQueuedBatches(RenderFlags);
 	}
 	else
 	{
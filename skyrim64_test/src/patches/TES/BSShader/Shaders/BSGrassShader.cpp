@@ -129,7 +129,7 @@ void BSGrassShader::SetupGeometry(BSRenderPass *Pass, uint32_t RenderFlags)
 	auto state = renderer->GetRendererShadowState();
 
 	auto vertexCG = renderer->GetShaderConstantGroup(state->m_CurrentVertexShader, BSGraphics::CONSTANT_GROUP_LEVEL_GEOMETRY);
-	auto data = (VertexConstantData *)vertexCG.RawData();
+	auto data = vertexCG.Data<VertexConstantData>();
 
 	UpdateGeometryProjections(data, Pass->m_Geometry->GetWorldTransform());
 	data->FogNearColor = TLS_FogNearColor;
@@ -276,9 +276,9 @@ void BSGrassShader::UpdateGeometryInstanceData(const BSGeometry *Geometry, BSSha
 	uint32_t neededSize = instanceDataCount * sizeof(float);
 	auto constantGroup = renderer->GetShaderConstantGroup(neededSize, BSGraphics::CONSTANT_GROUP_LEVEL_INSTANCE);
 
-	// Already zero initialized, just copy
+	// Not zero initialized: FlushConstantGroup() binds only the copied instances
 	if (instanceDataCount > 0)
-		memcpy(constantGroup.RawData(), propertyInstanceData->QBuffer(), neededSize);
+		constantGroup.Write(0, propertyInstanceData->QBuffer(), neededSize);
 
 	renderer->FlushConstantGroup(&constantGroup);
 	renderer->ApplyConstantGroupVS(&constantGroup, BSGraphics::CONSTANT_GROUP_LEVEL_INSTANCE);
@@ -1028,6 +1028,9 @@ void BSLightingShader::RestoreGeometry(BSRenderPass *Pass, uint32_t RenderFlags)
 
 void BSLightingShader::CreateAllShaders()
 {
+	std::vector<uint32_t> techniques;
+	std::vector<std::vector<std::pair<const char *, const char *>>> defineSets;
+
 	for (auto itr = m_VertexShaderTable.begin(); itr != m_VertexShaderTable.end(); itr++)
 	{
 		// Apply to parallax shaders only
@@ -1046,12 +1049,20 @@ void BSLightingShader::CreateAllShaders()
 			continue;
 		}
 
-		auto defines = GetSourceDefines(itr->m_TechniqueID);
-		auto getConstant = [](int i) { return ShaderConfigLighting.ByConstantIndexVS.count(i) ? ShaderConfigLighting.ByConstantIndexVS.at(i)->Name : nullptr; };
+		techniques.push_back(itr->m_TechniqueID);
+		defineSets.push_back(GetSourceDefines(itr->m_TechniqueID));
+	}
+
+	// Compile all permutations up front, the loop below only creates device objects
+	PrecompileShaders("Lighting", defineSets, { "vs_5_0", "hs_5_0", "ds_5_0" });
 
-		CreateVertexShader(itr->m_TechniqueID, "Lighting", defines, getConstant);
-		CreateHullShader(itr->m_TechniqueID, "Lighting", defines);
-		CreateDomainShader(itr->m_TechniqueID, "Lighting", defines);
+	auto getConstant = [](int i) { return ShaderConfigLighting.ByConstantIndexVS.count(i) ? ShaderConfigLighting.ByConstantIndexVS.at(i)->Name : nullptr; };
+
+	for (size_t j = 0; j < techniques.size(); j++)
+	{
+		CreateVertexShader(techniques[j], "Lighting", defineSets[j], getConstant);
+		CreateHullShader(techniques[j], "Lighting", defineSets[j]);
+		CreateDomainShader(techniques[j], "Lighting", defineSets[j]);
 	}
 }
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "MemoryManager.h"
+
 // Special thanks to himika (https://github.com/himika/libSkyrim/blob/2559175f7f30189b7d3681d01b3e055505c3e0d7/Skyrim/include/Skyrim/BSCore/BSTScatterTable.h)
 // for providing most of this (iterators) as a reference.
 
@@ -16,6 +18,12 @@ public:
 	{
 		return m_Key;
 	}
+
+	void Set(const Key& NewKey, const T& NewValue)
+	{
+		m_Key = NewKey;
+		m_Value = NewValue;
+	}
 };
 
 template<typename Key, typename T, class Storage = BSTScatterTableDefaultKVStorage<Key, T>>
@@ -45,7 +53,12 @@ struct BSTScatterTableHeapAllocator
 
 	T *Allocate(size_t Count)
 	{
-		throw;
+		return (T *)MemoryManager::Allocate(nullptr, Count * sizeof(T), alignof(T), true);
+	}
+
+	void Deallocate(T *Memory)
+	{
+		MemoryManager::Deallocate(nullptr, Memory, true);
 	}
 };
 
@@ -62,6 +75,10 @@ struct BSTFixedSizeScatterTableAllocator
 
 		return m_StaticBuffer;
 	}
+
+	void Deallocate(T *Memory)
+	{
+	}
 };
 
 // struct BSTScatterTableDefaultHashPolicy<
@@ -119,6 +136,8 @@ struct BSTScatterTableTraits
 	using const_pointer = typename Allocator::const_pointer;
 
 	using table_entry = typename Allocator::table_entry;
+
+	const static uint32_t initial_size = InitialSize;
 };
 
 template<class Traits>
@@ -147,6 +166,11 @@ class BSTScatterTableBase : public BSTScatterTableKernel<Traits>, public Traits:
 	//
 	// Same invisible padding as BSTScatterTableKernel in here
 	//
+	// Collisions are resolved with coalesced chaining: a chain spills into free slots elsewhere
+	// in the table, found by walking m_LastFree downwards. A slot holding an entry that doesn't
+	// belong to its own bucket gets evicted when that bucket's first key is inserted. This has to
+	// match the game's implementation exactly since both sides modify the same tables.
+	//
 private:
 	const static uint32_t InternalEndOfListMarker = 0x0EFBEADDE;
 
@@ -158,10 +182,16 @@ protected:
 	using pointer = typename Traits::pointer;
 	using const_pointer = typename Traits::const_pointer;
 	using table_entry = typename Traits::table_entry;
+	using allocator_type = typename Traits::allocator_type;
 
 	table_entry *m_Table;
 
 public:
+	using BSTScatterTableKernel<Traits>::m_Size;
+	using BSTScatterTableKernel<Traits>::m_Free;
+	using BSTScatterTableKernel<Traits>::m_LastFree;
+	using BSTScatterTableKernel<Traits>::m_Terminator;
+
 	BSTScatterTableBase()
 	{
 		m_Size			= 0;
@@ -173,9 +203,15 @@ public:
 
 	~BSTScatterTableBase()
 	{
-		AssertMsg(false, "Destructor not implemented");
+		if (m_Table)
+			allocator_type::Deallocate(m_Table);
+
+		m_Table = nullptr;
 	}
 
+	BSTScatterTableBase(const BSTScatterTableBase&) = delete;
+	BSTScatterTableBase& operator=(const BSTScatterTableBase&) = delete;
+
 	class const_iterator
 	{
 		friend class BSTScatterTableBase;
@@ -259,23 +295,25 @@ public:
 		return const_iterator(&m_Table[m_Size]);
 	}
 
-	const_iterator find(const key_type& Key) const
+	uint32_t size() const
 	{
-		if (m_Table)
-		{
-			table_entry *entry = &m_Table[hasher()(Key) & (m_Size - 1)];
+		return m_Size - m_Free;
+	}
 
-			if (!entry->IsEmpty())
-			{
-				while (entry != m_Terminator)
-				{
-					if (entry->GetKey() == Key)
-						return const_iterator(entry, &m_Table[m_Size]);
+	uint32_t capacity() const
+	{
+		return m_Size;
+	}
 
-					entry = entry->m_Next;
-				}
-			}
-		}
+	bool empty() const
+	{
+		return size() == 0;
+	}
+
+	const_iterator find(const key_type& Key) const
+	{
+		if (table_entry *entry = FindEntry(Key))
+			return const_iterator(entry, &m_Table[m_Size]);
 
 		// Key not found
 		return end();
@@ -283,23 +321,10 @@ public:
 
 	bool get(const key_type& Key, mapped_type& Out) const
 	{
-		if (m_Table)
+		if (table_entry *entry = FindEntry(Key))
 		{
-			table_entry *entry = &m_Table[hasher()(Key) & (m_Size - 1)];
-
-			if (!entry->IsEmpty())
-			{
-				while (entry != m_Terminator)
-				{
-					if (entry->GetKey() == Key)
-					{
-						Out = entry->m_Value;
-						return true;
-					}
-
-					entry = entry->m_Next;
-				}
-			}
+			Out = entry->m_Value;
+			return true;
 		}
 
 		// Key not found
@@ -314,6 +339,214 @@ public:
 		get(Key, temp);
 		return temp;
 	}
+
+	bool insert(const key_type& Key, const mapped_type& Value)
+	{
+		// Existing keys are left untouched, same as std::unordered_map::insert
+		if (FindEntry(Key))
+			return false;
+
+		if (m_Free == 0)
+			rehash(m_Table ? m_Size * 2 : Traits::initial_size);
+
+		table_entry temp;
+		temp.Set(Key, Value);
+
+		InsertEntry(temp);
+		return true;
+	}
+
+	void insert_or_assign(const key_type& Key, const mapped_type& Value)
+	{
+		if (table_entry *entry = FindEntry(Key))
+			entry->Set(Key, Value);
+		else
+			insert(Key, Value);
+	}
+
+	bool erase(const key_type& Key)
+	{
+		if (!m_Table)
+			return false;
+
+		table_entry *entry = GetBucket(Key);
+		table_entry *prev = nullptr;
+
+		if (entry->IsEmpty())
+			return false;
+
+		while (entry->GetKey() != Key)
+		{
+			prev = entry;
+			entry = entry->m_Next;
+
+			if (entry == m_Terminator)
+				return false;
+		}
+
+		if (prev)
+		{
+			// Middle or tail of a chain: unlink
+			prev->m_Next = entry->m_Next;
+			entry->m_Next = nullptr;
+		}
+		else if (entry->m_Next == m_Terminator)
+		{
+			// Only entry in the chain
+			entry->m_Next = nullptr;
+		}
+		else
+		{
+			// Head of a chain: the next entry moves into the bucket itself
+			table_entry *next = entry->m_Next;
+
+			*entry = *next;
+			next->m_Next = nullptr;
+		}
+
+		m_Free++;
+		return true;
+	}
+
+	void clear()
+	{
+		for (uint32_t i = 0; i < m_Size; i++)
+			m_Table[i].m_Next = nullptr;
+
+		m_Free = m_Size;
+		m_LastFree = m_Size;
+	}
+
+	void reserve(uint32_t Count)
+	{
+		if (Count > m_Size)
+			rehash(Count);
+	}
+
+	void rehash(uint32_t NewSize)
+	{
+		static_assert(std::is_trivially_copyable_v<table_entry>, "Entries are relocated with plain copies");
+
+		// Bucket count must stay a power of two
+		NewSize = std::max<uint32_t>({ NewSize, size(), Traits::initial_size });
+
+		if ((NewSize & (NewSize - 1)) != 0)
+		{
+			unsigned long index;
+			_BitScanReverse(&index, NewSize);
+			NewSize = 2u << index;
+		}
+
+		table_entry *oldTable = m_Table;
+		uint32_t oldSize = m_Size;
+		std::vector<table_entry> scratch;
+
+		table_entry *newTable = allocator_type::Allocate(NewSize);
+
+		// Fixed size allocators hand back the same buffer
+		if (oldTable && newTable == oldTable)
+		{
+			scratch.assign(oldTable, oldTable + oldSize);
+			oldTable = scratch.data();
+		}
+
+		for (uint32_t i = 0; i < NewSize; i++)
+			newTable[i].m_Next = nullptr;
+
+		m_Table = newTable;
+		m_Size = NewSize;
+		m_Free = NewSize;
+		m_LastFree = NewSize;
+
+		for (uint32_t i = 0; i < oldSize; i++)
+		{
+			if (!oldTable[i].IsEmpty())
+				InsertEntry(oldTable[i]);
+		}
+
+		if (oldTable && scratch.empty())
+			allocator_type::Deallocate(oldTable);
+	}
+
+private:
+	table_entry *GetBucket(const key_type& Key) const
+	{
+		return &m_Table[hasher()(Key) & (m_Size - 1)];
+	}
+
+	table_entry *FindEntry(const key_type& Key) const
+	{
+		if (!m_Table)
+			return nullptr;
+
+		table_entry *entry = GetBucket(Key);
+
+		if (entry->IsEmpty())
+			return nullptr;
+
+		while (entry != m_Terminator)
+		{
+			if (entry->GetKey() == Key)
+				return entry;
+
+			entry = entry->m_Next;
+		}
+
+		return nullptr;
+	}
+
+	table_entry *GetFreeEntry()
+	{
+		AssertDebug(m_Free > 0);
+
+		do
+		{
+			m_LastFree = (m_LastFree - 1) & (m_Size - 1);
+		} while (!m_Table[m_LastFree].IsEmpty());
+
+		return &m_Table[m_LastFree];
+	}
+
+	void InsertEntry(table_entry& Source)
+	{
+		// Caller guarantees the key isn't present and at least one slot is free
+		table_entry *bucket = GetBucket(Source.GetKey());
+
+		if (bucket->IsEmpty())
+		{
+			*bucket = Source;
+			bucket->m_Next = m_Terminator;
+		}
+		else
+		{
+			table_entry *freeEntry = GetFreeEntry();
+			table_entry *occupantBucket = GetBucket(bucket->GetKey());
+
+			if (occupantBucket != bucket)
+			{
+				// The slot is borrowed by another chain. Move that entry out and claim the bucket.
+				table_entry *prev = occupantBucket;
+
+				while (prev->m_Next != bucket)
+					prev = prev->m_Next;
+
+				*freeEntry = *bucket;
+				prev->m_Next = freeEntry;
+
+				*bucket = Source;
+				bucket->m_Next = m_Terminator;
+			}
+			else
+			{
+				// Same chain: link the new entry in right after the head
+				*freeEntry = Source;
+				freeEntry->m_Next = bucket->m_Next;
+				bucket->m_Next = freeEntry;
+			}
+		}
+
+		m_Free--;
+	}
 };
 
 // class BSTScatterTable<
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <utility>
+
+//
+// 64-bit draw ordering keys for BSBatchRenderer. From the most significant bit:
+//
+// | Technique rank (12) | Pass group (3) | Texture set (13) | Material (20) | Depth (16) |
+//
+// Technique rank and pass group keep the engine's order: ascending techniques, each split into the
+// five cull mode/alpha test groups. Inside a group, draws with the same texture set and material end
+// up next to each other, front to back. Texture set and material are pointer hashes. A collision
+// costs a redundant state change, never a wrong draw.
+//
+// Groups that blend must keep their submission order. EncodeOrdered() puts a sequence number in
+// place of the lower fields. RadixSort() is stable, so equal keys also keep their order.
+//
+namespace DrawSortKey
+{
+	const static uint32_t TechniqueBits		= 12;
+	const static uint32_t PassGroupBits		= 3;
+	const static uint32_t TextureSetBits	= 13;
+	const static uint32_t MaterialBits		= 20;
+	const static uint32_t DepthBits			= 16;
+
+	const static uint32_t DepthShift		= 0;
+	const static uint32_t MaterialShift		= DepthShift + DepthBits;
+	const static uint32_t TextureSetShift	= MaterialShift + MaterialBits;
+	const static uint32_t PassGroupShift	= TextureSetShift + TextureSetBits;
+	const static uint32_t TechniqueShift	= PassGroupShift + PassGroupBits;
+
+	const static uint32_t MaxTechniqueRank	= (1u << TechniqueBits) - 1;
+	const static uint64_t MaxSequence		= (1ull << PassGroupShift) - 1;
+
+	static_assert(TechniqueShift + TechniqueBits == 64);
+
+	struct Entry
+	{
+		uint64_t Key;
+		uint32_t Index;		// Caller's draw index
+	};
+
+	inline uint64_t HashPointer(const void *Pointer, uint32_t Bits)
+	{
+		// Fibonacci hashing. Null stays zero so draws without one sort first.
+		if (!Pointer)
+			return 0;
+
+		return (((uint64_t)Pointer * 0x9E3779B97F4A7C15ull) >> (64 - Bits)) | 1;
+	}
+
+	inline uint64_t EncodeDepth(float DistanceSquared)
+	{
+		// Non-negative IEEE floats order the same as their bit patterns. Keep sign, exponent and
+		// the top 7 mantissa bits.
+		uint32_t bits;
+		memcpy(&bits, &DistanceSquared, sizeof(bits));
+
+		if (bits & 0x80000000)
+			return 0;
+
+		return bits >> (32 - DepthBits);
+	}
+
+	inline uint64_t EncodeHeader(uint32_t TechniqueRank, uint32_t PassGroup)
+	{
+		return ((uint64_t)TechniqueRank << TechniqueShift) | ((uint64_t)PassGroup << PassGroupShift);
+	}
+
+	inline uint64_t Encode(uint32_t TechniqueRank, uint32_t PassGroup, const void *TextureSet, const void *Material, float DistanceSquared)
+	{
+		return EncodeHeader(TechniqueRank, PassGroup) |
+			(HashPointer(TextureSet, TextureSetBits) << TextureSetShift) |
+			(HashPointer(Material, MaterialBits) << MaterialShift) |
+			(EncodeDepth(DistanceSquared) << DepthShift);
+	}
+
+	inline uint64_t EncodeOrdered(uint32_t TechniqueRank, uint32_t PassGroup, uint64_t Sequence)
+	{
+		return EncodeHeader(TechniqueRank, PassGroup) | (Sequence & MaxSequence);
+	}
+
+	inline uint32_t DecodePassGroup(uint64_t Key)
+	{
+		return (uint32_t)(Key >> PassGroupShift) & ((1u << PassGroupBits) - 1);
+	}
+
+	//
+	// LSD radix sort with 8-bit digits. All eight histograms are built in one pass and digits that
+	// are the same for every key are skipped. Returns whichever of the two arrays holds the result.
+	//
+	inline Entry *RadixSort(Entry *Entries, Entry *Scratch, size_t Count)
+	{
+		const static uint32_t DigitCount = 8;
+		size_t histograms[DigitCount][256];
+
+		memset(histograms, 0, sizeof(histograms));
+
+		for (size_t i = 0; i < Count; i++)
+		{
+			uint64_t key = Entries[i].Key;
+
+			for (uint32_t digit = 0; digit < DigitCount; digit++)
+				histograms[digit][(key >> (digit * 8)) & 0xFF]++;
+		}
+
+		Entry *source = Entries;
+		Entry *dest = Scratch;
+
+		for (uint32_t digit = 0; digit < DigitCount && Count > 1; digit++)
+		{
+			size_t *histogram = histograms[digit];
+			uint32_t shift = digit * 8;
+
+			if (histogram[(source[0].Key >> shift) & 0xFF] == Count)
+				continue;
+
+			// Exclusive prefix sum gives each bucket's first slot
+			for (size_t bucket = 0, offset = 0; bucket < 256; bucket++)
+			{
+				size_t count = histogram[bucket];
+				histogram[bucket] = offset;
+				offset += count;
+			}
+
+			for (size_t i = 0; i < Count; i++)
+				dest[histogram[(source[i].Key >> shift) & 0xFF]++] = source[i];
+
+			std::swap(source, dest);
+		}
+
+		return source;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <emmintrin.h>
+#include <intrin.h>
+#include "BSTScatterTable.h"
+
+//
+// Open addressing hash map with SwissTable-style control bytes. Every slot has a one byte tag in
+// a separate array (7 bits of the hash, or empty/deleted) so a group of 16 slots is matched with a
+// single SSE2 compare before any key is touched. Probing walks whole groups.
+//
+// NOT layout compatible with BSTScatterTable. Only use this for tables that never cross into
+// game code.
+//
+template<typename Key, typename T, class Hash = BSTScatterTableDefaultHashPolicy<Key>>
+class FlatScatterTable
+{
+public:
+	struct value_type
+	{
+		Key first;
+		T second;
+	};
+
+private:
+	const static int8_t CtrlEmpty		= -128;
+	const static int8_t CtrlDeleted		= -2;
+	const static uint32_t GroupWidth	= 16;
+	const static uint32_t MinCapacity	= GroupWidth;
+
+	int8_t *m_Ctrl			= nullptr;
+	value_type *m_Slots		= nullptr;
+	uint32_t m_Capacity		= 0;
+	uint32_t m_Count		= 0;
+	uint32_t m_GrowthLeft	= 0;	// Inserts allowed before hitting the 7/8 load factor (tombstones count as used)
+
+public:
+	class iterator
+	{
+		friend class FlatScatterTable;
+
+	private:
+		const FlatScatterTable *m_Table;
+		uint32_t m_Index;
+
+		iterator(const FlatScatterTable *Table, uint32_t Index) : m_Table(Table), m_Index(Index)
+		{
+			SkipEmpty();
+		}
+
+		void SkipEmpty()
+		{
+			while (m_Index < m_Table->m_Capacity && m_Table->m_Ctrl[m_Index] < 0)
+				m_Index++;
+		}
+
+	public:
+		iterator& operator++()
+		{
+			m_Index++;
+			SkipEmpty();
+
+			return *this;
+		}
+
+		value_type& operator*() const
+		{
+			return m_Table->m_Slots[m_Index];
+		}
+
+		value_type *operator->() const
+		{
+			return &m_Table->m_Slots[m_Index];
+		}
+
+		bool operator==(const iterator& Rhs) const
+		{
+			return m_Index == Rhs.m_Index;
+		}
+
+		bool operator!=(const iterator& Rhs) const
+		{
+			return m_Index != Rhs.m_Index;
+		}
+	};
+
+	FlatScatterTable() = default;
+
+	FlatScatterTable(const FlatScatterTable&) = delete;
+	FlatScatterTable& operator=(const FlatScatterTable&) = delete;
+
+	~FlatScatterTable()
+	{
+		clear();
+		Free(m_Ctrl);
+	}
+
+	iterator begin() const
+	{
+		return iterator(this, 0);
+	}
+
+	iterator end() const
+	{
+		return iterator(this, m_Capacity);
+	}
+
+	uint32_t size() const
+	{
+		return m_Count;
+	}
+
+	uint32_t capacity() const
+	{
+		return m_Capacity;
+	}
+
+	bool empty() const
+	{
+		return m_Count == 0;
+	}
+
+	T *find(const Key& Lookup) const
+	{
+		if (!m_Capacity)
+			return nullptr;
+
+		uint64_t hash = HashKey(Lookup);
+		const __m128i tag = _mm_set1_epi8(GetTag(hash));
+		const __m128i empty = _mm_set1_epi8(CtrlEmpty);
+
+		uint32_t groupMask = (m_Capacity / GroupWidth) - 1;
+		uint32_t group = GetGroup(hash) & groupMask;
+
+		for (uint32_t step = 1;; step++)
+		{
+			__m128i ctrl = _mm_load_si128((const __m128i *)&m_Ctrl[group * GroupWidth]);
+			uint32_t matches = _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, tag));
+
+			for (unsigned long bit; _BitScanForward(&bit, matches); matches &= matches - 1)
+			{
+				value_type& slot = m_Slots[(group * GroupWidth) + bit];
+
+				if (slot.first == Lookup)
+					return &slot.second;
+			}
+
+			// An empty slot ends every probe sequence passing through this group
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, empty)) != 0)
+				return nullptr;
+
+			group = (group + step) & groupMask;
+		}
+	}
+
+	bool get(const Key& Lookup, T& Out) const
+	{
+		if (T *value = find(Lookup))
+		{
+			Out = *value;
+			return true;
+		}
+
+		return false;
+	}
+
+	T get(const Key& Lookup) const
+	{
+		// Return a default-constructed T if not found
+		T temp = T();
+
+		get(Lookup, temp);
+		return temp;
+	}
+
+	std::pair<T *, bool> insert(const Key& NewKey, const T& NewValue)
+	{
+		if (T *value = find(NewKey))
+			return std::make_pair(value, false);
+
+		return std::make_pair(InsertUnique(NewKey, NewValue), true);
+	}
+
+	T *insert_or_assign(const Key& NewKey, const T& NewValue)
+	{
+		if (T *value = find(NewKey))
+		{
+			*value = NewValue;
+			return value;
+		}
+
+		return InsertUnique(NewKey, NewValue);
+	}
+
+	T& operator[](const Key& Lookup)
+	{
+		if (T *value = find(Lookup))
+			return *value;
+
+		return *InsertUnique(Lookup, T());
+	}
+
+	bool erase(const Key& Lookup)
+	{
+		T *value = find(Lookup);
+
+		if (!value)
+			return false;
+
+		uint32_t index = (uint32_t)(((uintptr_t)value - (uintptr_t)m_Slots) / sizeof(value_type));
+		uint32_t groupStart = index & ~(GroupWidth - 1);
+
+		m_Slots[index].~value_type();
+		m_Count--;
+
+		// If the group still has an empty slot, no probe sequence continues past it and the slot
+		// can become empty again. Otherwise leave a tombstone.
+		__m128i ctrl = _mm_load_si128((const __m128i *)&m_Ctrl[groupStart]);
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(CtrlEmpty))) != 0)
+		{
+			m_Ctrl[index] = CtrlEmpty;
+			m_GrowthLeft++;
+		}
+		else
+		{
+			m_Ctrl[index] = CtrlDeleted;
+		}
+
+		return true;
+	}
+
+	void clear()
+	{
+		if (!m_Capacity)
+			return;
+
+		for (uint32_t i = 0; i < m_Capacity; i++)
+		{
+			if (m_Ctrl[i] >= 0)
+				m_Slots[i].~value_type();
+		}
+
+		memset(m_Ctrl, CtrlEmpty, m_Capacity);
+		m_Count = 0;
+		m_GrowthLeft = GetMaxLoad(m_Capacity);
+	}
+
+	void swap(FlatScatterTable& Other)
+	{
+		std::swap(m_Ctrl, Other.m_Ctrl);
+		std::swap(m_Slots, Other.m_Slots);
+		std::swap(m_Capacity, Other.m_Capacity);
+		std::swap(m_Count, Other.m_Count);
+		std::swap(m_GrowthLeft, Other.m_GrowthLeft);
+	}
+
+	void reserve(uint32_t Count)
+	{
+		if (Count > GetMaxLoad(m_Capacity))
+			rehash(Count + (Count / 7));
+	}
+
+	void rehash(uint32_t NewCapacity)
+	{
+		NewCapacity = std::max<uint32_t>({ NewCapacity, MinCapacity, m_Count + (m_Count / 7) + 1 });
+
+		if ((NewCapacity & (NewCapacity - 1)) != 0)
+		{
+			unsigned long index;
+			_BitScanReverse(&index, NewCapacity);
+			NewCapacity = 2u << index;
+		}
+
+		int8_t *oldCtrl = m_Ctrl;
+		value_type *oldSlots = m_Slots;
+		uint32_t oldCapacity = m_Capacity;
+
+		// Control bytes and slots share one allocation, slots start at the next 64 byte boundary
+		size_t slotOffset = (NewCapacity + 63) & ~63ull;
+		auto memory = (uint8_t *)MemoryManager::Allocate(nullptr, slotOffset + (NewCapacity * sizeof(value_type)), 64, true);
+
+		m_Ctrl = (int8_t *)memory;
+		m_Slots = (value_type *)(memory + slotOffset);
+		m_Capacity = NewCapacity;
+		m_Count = 0;
+		m_GrowthLeft = GetMaxLoad(NewCapacity);
+		memset(m_Ctrl, CtrlEmpty, NewCapacity);
+
+		for (uint32_t i = 0; i < oldCapacity; i++)
+		{
+			if (oldCtrl[i] < 0)
+				continue;
+
+			uint32_t index = FindInsertSlot(HashKey(oldSlots[i].first));
+			new (&m_Slots[index]) value_type{ std::move(oldSlots[i].first), std::move(oldSlots[i].second) };
+			oldSlots[i].~value_type();
+		}
+
+		Free(oldCtrl);
+	}
+
+private:
+	static void Free(int8_t *Memory)
+	{
+		if (Memory)
+			MemoryManager::Deallocate(nullptr, Memory, true);
+	}
+
+	static uint32_t GetMaxLoad(uint32_t Capacity)
+	{
+		return Capacity - (Capacity / 8);
+	}
+
+	static uint64_t HashKey(const Key& Value)
+	{
+		// Engine hash policies are often the identity function. Mix the bits so both the group
+		// index and the tag get entropy.
+		uint64_t hash = (uint64_t)Hash()(Value) * 0x9E3779B97F4A7C15ull;
+		return hash ^ (hash >> 32);
+	}
+
+	static int8_t GetTag(uint64_t HashValue)
+	{
+		return (int8_t)(HashValue & 0x7F);
+	}
+
+	static uint32_t GetGroup(uint64_t HashValue)
+	{
+		return (uint32_t)(HashValue >> 7);
+	}
+
+	uint32_t FindInsertSlot(uint64_t HashValue)
+	{
+		const __m128i empty = _mm_set1_epi8(CtrlEmpty);
+
+		uint32_t groupMask = (m_Capacity / GroupWidth) - 1;
+		uint32_t group = GetGroup(HashValue) & groupMask;
+
+		for (uint32_t step = 1;; step++)
+		{
+			// Empty and deleted are the only negative control values
+			__m128i ctrl = _mm_load_si128((const __m128i *)&m_Ctrl[group * GroupWidth]);
+			uint32_t available = _mm_movemask_epi8(ctrl);
+
+			if (available != 0)
+			{
+				unsigned long bit;
+				_BitScanForward(&bit, available);
+
+				uint32_t index = (group * GroupWidth) + bit;
+
+				if (m_Ctrl[index] == CtrlEmpty)
+					m_GrowthLeft--;
+
+				m_Ctrl[index] = GetTag(HashValue);
+				m_Count++;
+				return index;
+			}
+
+			group = (group + step) & groupMask;
+		}
+	}
+
+	T *InsertUnique(const Key& NewKey, const T& NewValue)
+	{
+		if (m_GrowthLeft == 0)
+		{
+			// Mostly tombstones: rebuild at the same size. Otherwise double.
+			rehash(m_Count * 2 < m_Capacity ? m_Capacity : m_Capacity * 2);
+		}
+
+		uint32_t index = FindInsertSlot(HashKey(NewKey));
+		new (&m_Slots[index]) value_type{ NewKey, NewValue };
+
+		return &m_Slots[index].second;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include "BSTScatterTable.h"
+
+//
+// Open addressing hash map for read-mostly tables whose entries are never removed or changed.
+// Lookups take no lock and finish in a bounded number of probes. Inserts are serialized by a
+// lock. Every slot is filled before its Ready flag is published, so a reader sees either a
+// complete entry or an empty slot.
+//
+// Growing the table publishes a copy. Old arrays stay allocated until the table is destroyed,
+// because readers may still be walking them. reserve() up front avoids the copies.
+//
+template<typename Key, typename T, class Hash = BSTScatterTableDefaultHashPolicy<Key>>
+class InsertOnlyScatterTable
+{
+private:
+	const static uint32_t MinCapacity = 64;
+
+	struct Slot
+	{
+		std::atomic_bool Ready;
+		Key SlotKey;
+		T Value;
+	};
+
+	struct Storage
+	{
+		uint32_t Capacity;
+		Storage *Previous;
+		Slot *Slots;
+	};
+
+	std::atomic<Storage *> m_Storage;
+	uint32_t m_Count = 0;
+	SRWLOCK m_WriteLock = SRWLOCK_INIT;
+
+public:
+	InsertOnlyScatterTable(uint32_t InitialCapacity = MinCapacity)
+	{
+		m_Storage.store(Allocate(GetCapacityFor(InitialCapacity), nullptr), std::memory_order_relaxed);
+	}
+
+	InsertOnlyScatterTable(const InsertOnlyScatterTable&) = delete;
+	InsertOnlyScatterTable& operator=(const InsertOnlyScatterTable&) = delete;
+
+	~InsertOnlyScatterTable()
+	{
+		for (Storage *storage = m_Storage.load(std::memory_order_relaxed); storage;)
+		{
+			Storage *previous = storage->Previous;
+
+			delete[] storage->Slots;
+			delete storage;
+
+			storage = previous;
+		}
+	}
+
+	bool find(const Key& Lookup, T *Value) const
+	{
+		const Storage *storage = m_Storage.load(std::memory_order_acquire);
+		const uint32_t mask = storage->Capacity - 1;
+
+		for (uint32_t i = 0, index = HashKey(Lookup) & mask; i < storage->Capacity; i++, index = (index + 1) & mask)
+		{
+			const Slot& slot = storage->Slots[index];
+
+			// Entries are never removed: an empty slot ends the probe sequence
+			if (!slot.Ready.load(std::memory_order_acquire))
+				return false;
+
+			if (slot.SlotKey == Lookup)
+			{
+				*Value = slot.Value;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Returns the value stored for NewKey. That's NewValue unless another thread inserted the key
+	// first.
+	T insert(const Key& NewKey, const T& NewValue)
+	{
+		T value;
+
+		AcquireSRWLockExclusive(&m_WriteLock);
+		{
+			if (find(NewKey, &value))
+			{
+				ReleaseSRWLockExclusive(&m_WriteLock);
+				return value;
+			}
+
+			Storage *storage = m_Storage.load(std::memory_order_relaxed);
+
+			// Keep the load factor at or below 1/2 so probe sequences stay short
+			if ((m_Count + 1) * 2 > storage->Capacity)
+				storage = Grow(storage->Capacity * 2);
+
+			Place(storage, NewKey, NewValue);
+			m_Count++;
+			value = NewValue;
+		}
+		ReleaseSRWLockExclusive(&m_WriteLock);
+
+		return value;
+	}
+
+	void reserve(uint32_t Count)
+	{
+		AcquireSRWLockExclusive(&m_WriteLock);
+		{
+			if (GetCapacityFor(Count) > m_Storage.load(std::memory_order_relaxed)->Capacity)
+				Grow(GetCapacityFor(Count));
+		}
+		ReleaseSRWLockExclusive(&m_WriteLock);
+	}
+
+	uint32_t size() const
+	{
+		return m_Count;
+	}
+
+private:
+	static Storage *Allocate(uint32_t Capacity, Storage *Previous)
+	{
+		Storage *storage = new Storage;
+		storage->Capacity = Capacity;
+		storage->Previous = Previous;
+		storage->Slots = new Slot[Capacity];
+
+		for (uint32_t i = 0; i < Capacity; i++)
+			storage->Slots[i].Ready.store(false, std::memory_order_relaxed);
+
+		return storage;
+	}
+
+	Storage *Grow(uint32_t NewCapacity)
+	{
+		// Called with the write lock held
+		Storage *oldStorage = m_Storage.load(std::memory_order_relaxed);
+		Storage *newStorage = Allocate(NewCapacity, oldStorage);
+
+		for (uint32_t i = 0; i < oldStorage->Capacity; i++)
+		{
+			const Slot& slot = oldStorage->Slots[i];
+
+			if (slot.Ready.load(std::memory_order_relaxed))
+				Place(newStorage, slot.SlotKey, slot.Value);
+		}
+
+		m_Storage.store(newStorage, std::memory_order_release);
+		return newStorage;
+	}
+
+	static void Place(Storage *Target, const Key& NewKey, const T& NewValue)
+	{
+		const uint32_t mask = Target->Capacity - 1;
+
+		for (uint32_t index = HashKey(NewKey) & mask;; index = (index + 1) & mask)
+		{
+			Slot& slot = Target->Slots[index];
+
+			if (slot.Ready.load(std::memory_order_relaxed))
+				continue;
+
+			slot.SlotKey = NewKey;
+			slot.Value = NewValue;
+			slot.Ready.store(true, std::memory_order_release);
+			return;
+		}
+	}
+
+	static uint32_t GetCapacityFor(uint32_t Count)
+	{
+		uint32_t capacity = MinCapacity;
+
+		while (capacity < Count * 2)
+			capacity *= 2;
+
+		return capacity;
+	}
+
+	static uint32_t HashKey(const Key& Value)
+	{
+		// Engine hash policies are often the identity function
+		uint64_t hash = (uint64_t)Hash()(Value) * 0x9E3779B97F4A7C15ull;
+		return (uint32_t)(hash >> 32);
+	}
+};
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "../../common.h"
+#include "LargeBlockHeap.h"
+
+namespace LargeBlockHeap
+{
+	size_t SlotCommitted[SlotCount];
+
+	SRWLOCK SlotLock = SRWLOCK_INIT;
+	uint32_t FreeSlots[SlotCount];
+	uint32_t FreeSlotCount;
+
+	__forceinline uint32_t GetSlotIndex(const void *Memory)
+	{
+		return (uint32_t)(((uintptr_t)Memory - HeapBase) / SlotSize);
+	}
+
+	__forceinline size_t RoundToPage(size_t Size)
+	{
+		return (Size + PageSize - 1) & ~(PageSize - 1);
+	}
+
+	void Initialize()
+	{
+		if (HeapBase)
+			return;
+
+		void *base = VirtualAlloc(nullptr, SlotCount * SlotSize, MEM_RESERVE, PAGE_NOACCESS);
+
+		if (!base)
+			return;
+
+		for (uint32_t i = 0; i < SlotCount; i++)
+			FreeSlots[i] = SlotCount - i - 1;
+
+		FreeSlotCount = SlotCount;
+		HeapBase = (uintptr_t)base;
+		HeapEnd = HeapBase + (SlotCount * SlotSize);
+	}
+
+	void *Allocate(size_t Size)
+	{
+		if (!HeapBase || Size > SlotSize)
+			return nullptr;
+
+		uint32_t index = UINT32_MAX;
+
+		AcquireSRWLockExclusive(&SlotLock);
+		if (FreeSlotCount > 0)
+			index = FreeSlots[--FreeSlotCount];
+		ReleaseSRWLockExclusive(&SlotLock);
+
+		if (index == UINT32_MAX)
+			return nullptr;
+
+		void *memory = (void *)(HeapBase + (index * (size_t)SlotSize));
+		size_t commitSize = RoundToPage(Size);
+
+		if (!VirtualAlloc(memory, commitSize, MEM_COMMIT, PAGE_READWRITE))
+		{
+			AcquireSRWLockExclusive(&SlotLock);
+			FreeSlots[FreeSlotCount++] = index;
+			ReleaseSRWLockExclusive(&SlotLock);
+
+			return nullptr;
+		}
+
+		SlotCommitted[index] = commitSize;
+		return memory;
+	}
+
+	bool TryResize(void *Memory, size_t Size)
+	{
+		uint32_t index = GetSlotIndex(Memory);
+		size_t committed = SlotCommitted[index];
+
+		if (Size <= committed)
+			return true;
+
+		if (Size > SlotSize)
+			return false;
+
+		// Grow geometrically so a run of small appends doesn't turn into a run of syscalls
+		size_t newCommitted = RoundToPage(std::min(std::max(Size, committed + (committed / 2)), SlotSize));
+
+		if (!VirtualAlloc((void *)((uintptr_t)Memory + committed), newCommitted - committed, MEM_COMMIT, PAGE_READWRITE))
+			return false;
+
+		SlotCommitted[index] = newCommitted;
+		return true;
+	}
+
+	void Free(void *Memory)
+	{
+		uint32_t index = GetSlotIndex(Memory);
+
+		VirtualFree(Memory, SlotCommitted[index], MEM_DECOMMIT);
+		SlotCommitted[index] = 0;
+
+		AcquireSRWLockExclusive(&SlotLock);
+		FreeSlots[FreeSlotCount++] = index;
+		ReleaseSRWLockExclusive(&SlotLock);
+	}
+
+	size_t BlockSize(const void *Memory)
+	{
+		return SlotCommitted[GetSlotIndex(Memory)];
+	}
+}
\ No newline at end of file
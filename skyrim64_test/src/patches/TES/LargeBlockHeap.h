@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// Reserve-and-commit heap for large blocks that are being grown by realloc. Each block owns a
+// fixed slot of reserved address space, so growing it only commits more pages in place (the
+// Windows equivalent of mremap). Freshly committed pages come back zeroed from the OS, which
+// means the newly exposed tail never needs a memset.
+//
+namespace LargeBlockHeap
+{
+	const static size_t PageSize		= 4096;
+	const static size_t SlotSize		= 256 * 1024 * 1024;
+	const static size_t SlotCount		= 4096;
+	const static size_t MinBlockSize	= 256 * 1024;	// Smaller blocks aren't worth a dedicated slot
+
+	inline uintptr_t HeapBase;
+	inline uintptr_t HeapEnd;
+
+	void Initialize();
+	void *Allocate(size_t Size);
+	bool TryResize(void *Memory, size_t Size);
+	void Free(void *Memory);
+	size_t BlockSize(const void *Memory);
+
+	inline bool Owns(const void *Memory)
+	{
+		return (uintptr_t)Memory >= HeapBase && (uintptr_t)Memory < HeapEnd;
+	}
+}
\ No newline at end of file
@@ -11,10 +11,12 @@
 #include "NiMain/NiNode.h"
 #include "NiMain/NiCamera.h"
 #include <smmintrin.h>
+#include <deque>
 using namespace DirectX;
 
 #include "MOC_ThreadedMerger.h"
-#include <meshoptimizer/src/meshoptimizer.h>
+#include "MOC_OccluderCache.h"
+#include "MOC_OccluderSelect.h"
 
 const int MOC_WIDTH = 1280;
 const int MOC_HEIGHT = 720;
@@ -28,92 +30,23 @@ namespace MOC
 
 	MOC_ThreadedMerger *ThreadedMOC;
 
-	struct IndexPair
+	OccluderCache::Entry *AcquireOccluder(BSGeometry *Geometry)
 	{
-		uint32_t *Data;
-		uint32_t Count;
-	};
-
-	std::unordered_map<void *, float *> m_VertMap;
-	std::unordered_map<void *, IndexPair> m_IndexMap;
-
-	uint32_t *ConvertIndices(const void *Input, uint32_t Count, uint32_t MaxVertexCount)
-	{
-		const uint16_t *in = (uint16_t *)Input;
-		uint32_t *out = new uint32_t[Count];
-
-		for (uint32_t i = 0; i < Count; i++)
-			out[i] = in[i];
-
-		return out;
-	}
-
-	float *ConvertVerts(const void *Input, uint32_t Count, uint32_t ByteStride)
-	{
-		float *in = (float *)Input;
-		float *out = new float[Count * 4];
-		float *base = out;
-
-		for (uint32_t i = 0; i < Count; i++)
-		{
-			//
-			// X -> X
-			// Y -> Y
-			// Z -> 1.0f
-			// W -> Z
-			// Remaining data discarded
-			//
-			out[0] = in[0];
-			out[1] = in[1];
-			out[2] = 1.0f;
-			out[3] = in[2];
-
-			in = (float *)((uintptr_t)in + ByteStride);
-			out += 4;
-		}
-
-		return base;
-	}
-
-	SRWLOCK vertLock = SRWLOCK_INIT;
-	void GetCachedVerticesAndIndices(BSGeometry *Geometry, IndexPair *Indices, float **Vertices)
-	{
-		void *dataPtr;
-
-		const void *indexData;
-		uint32_t indexCount;
-
-		const void *vertexData;
-		uint32_t vertexCount;
-		uint32_t vertexStride;
-
-		AcquireSRWLockExclusive(&vertLock);
+		const void *owner = nullptr;
+		OccluderCache::SourceMesh mesh = {};
 
 		if (Geometry->QType() == GEOMETRY_TYPE_TRISHAPE)
 		{
 			auto triShape = static_cast<BSTriShape *>(Geometry);
 			auto rendererData = reinterpret_cast<BSGraphics::TriShape *>(triShape->QRendererData());
-			dataPtr = rendererData;
+			owner = rendererData;
 
-			auto itrI = m_IndexMap.find(rendererData);
-			auto itrV = m_VertMap.find(rendererData);
+			mesh.Indices = (const uint16_t *)rendererData->m_RawIndexData;
+			mesh.IndexCount = triShape->m_TriangleCount * 3;
 
-			if (itrI != m_IndexMap.end())
-				*Indices = itrI->second;
-			else
-				Indices->Data = nullptr;
-
-			if (itrV != m_VertMap.end())
-				*Vertices = itrV->second;
-			else
-				*Vertices = nullptr;
-
-			indexData = rendererData->m_RawIndexData;
-			indexCount = triShape->m_TriangleCount * 3;
-
-			vertexData = rendererData->m_RawVertexData;
-			vertexCount = triShape->m_VertexCount;
-			vertexStride = BSGeometry::CalculateVertexSize(rendererData->m_VertexDesc);
+			mesh.Vertices = rendererData->m_RawVertexData;
+			mesh.VertexCount = triShape->m_VertexCount;
+			mesh.VertexStride = BSGeometry::CalculateVertexSize(rendererData->m_VertexDesc);
 		}
 		else if (Geometry->QType() == GEOMETRY_TYPE_DYNAMIC_TRISHAPE)
 		{
@@ -124,56 +57,13 @@ namespace MOC
 			Assert(false);
 		}
 
-		// If one wasn't found, it needs conversion
-		if (!Indices->Data)
-		{
-			IndexPair p;
-			p.Data = ConvertIndices(indexData, indexCount, vertexCount);
-			p.Count = indexCount;
-
-			if (indexCount > 300)
-				p.Count = meshopt_simplify(p.Data, p.Data, indexCount, (const float *)vertexData, vertexCount, vertexStride, (size_t)(indexCount * .50f), 1e-3f);// Target 33% of original triangles
-
-			m_IndexMap.insert_or_assign(dataPtr, p);
-			*Indices = p;
-		}
-
-		if (!*Vertices)
-		{
-			*Vertices = ConvertVerts(vertexData, vertexCount, vertexStride);
-			m_VertMap.insert_or_assign(dataPtr, *Vertices);
-		}
-
-		ReleaseSRWLockExclusive(&vertLock);
+		return OccluderCache::Acquire(owner, mesh);
 	}
 
 	void RemoveCachedVerticesAndIndices(void *RendererData)
 	{
-		uint32_t *indices = nullptr;
-		float *verts = nullptr;
-
-		AcquireSRWLockExclusive(&vertLock);
-
-		if (auto itr = m_IndexMap.find(RendererData); itr != m_IndexMap.end())
-		{
-			indices = itr->second.Data;
-			m_IndexMap.erase(itr);
-		}
-
-		if (auto itr = m_VertMap.find(RendererData); itr != m_VertMap.end())
-		{
-			verts = itr->second;
-			m_VertMap.erase(itr);
-		}
-
-		ReleaseSRWLockExclusive(&vertLock);
-
-		// Both buffers might be used outside the lock - I don't care right now (cell_unload() + moc_render() => BOOM)
-		if (indices)
-			delete[] indices;
-
-		if (verts)
-			delete[] verts;
+		// Entries are refcounted, so a worker still rendering this geometry keeps its copy alive
+		OccluderCache::Remove(RendererData);
 	}
 
 	void UpdateDepthViewTexture()
@@ -197,7 +87,7 @@ namespace MOC
 
 	void Init()
 	{
-		ThreadedMOC = new MOC_ThreadedMerger(MOC_WIDTH, MOC_HEIGHT, 4, true);
+		ThreadedMOC = new MOC_ThreadedMerger(MOC_WIDTH, MOC_HEIGHT, 4);
 
 		ThreadedMOC->SetTraverseSceneCallback(TraverseSceneGraphCallback);
 		ThreadedMOC->SetRenderGeometryCallback(RenderGeometryCallback);
@@ -423,13 +313,9 @@ namespace MOC
 		return true;
 	}
 
-	struct GeometryDistEntry
-	{
-		BSGeometry *Geometry;
-		float DistanceSquared;
-	};
-
-	std::vector<GeometryDistEntry> GeoList;
+	std::vector<OccluderSelect::Candidate> GeoList;
+	OccluderSelect::Selector GeoSelector;
+	FILE *GeoRecording;
 
 	void RegisterGeometry(BSGeometry *Geometry)
 	{
@@ -458,16 +344,19 @@ namespace MOC
 
 			if (rendererData && rendererData->m_RawIndexData && triShape->m_TriangleCount > 1)
 			{
-				GeometryDistEntry entry;
-				entry.Geometry = Geometry;
+				OccluderSelect::Candidate entry;
+				entry.Object = Geometry;
 				entry.DistanceSquared = XMVector3LengthSq(_mm_sub_ps(Geometry->m_kWorldBound.m_kCenter.AsXmm(), MyPosAdjust.AsXmm())).m128_f32[0];
+				entry.Radius = Geometry->m_kWorldBound.m_fRadius;
+				entry.TriangleCount = triShape->m_TriangleCount;	// Before simplification
+				entry.Score = 0.0f;
 
 				GeoList.push_back(entry);
 			}
 		}
 	}
 
-	void RenderGeometryCallback(MaskedOcclusionCulling *MOC, void *UserData)
+	void RenderGeometryCallback(MOC_ThreadedMerger *Merger, void *UserData)
 	{
 		ProfileTimer("MOC RenderGeometry");
 		ZoneScopedN("MOC RenderGeometry");
@@ -481,26 +370,27 @@ namespace MOC
 			winding = MaskedOcclusionCulling::BACKFACE_NONE;
 
 		// Grab LOD-ified mesh out
-		IndexPair indexRawData;
-		float *vertexRawData;
-		GetCachedVerticesAndIndices(geometry, &indexRawData, &vertexRawData);
+		OccluderCache::Entry *occluder = AcquireOccluder(geometry);
 
 		XMMATRIX worldProj = BSShaderUtil::GetXMFromNiPosAdjust(geometry->GetWorldTransform(), MyPosAdjust);
 		XMMATRIX worldViewProj = XMMatrixMultiply(worldProj, MyViewProj);
 
-		MOC->RenderTriangles(
-			vertexRawData,
-			indexRawData.Data,
-			indexRawData.Count / 3,
+		// Triangles are binned before this returns, so the occluder can be released right after
+		Merger->RenderTriangles(
+			occluder->Vertices,
+			occluder->Indices,
+			occluder->IndexCount / 3,
 			(float *)&worldViewProj,
 			winding,
 			MaskedOcclusionCulling::CLIP_PLANE_SIDES);
 
 		ProfileCounterInc("MOC ObjectsRendered");
-		ProfileCounterAdd("MOC TrianglesRendered", indexRawData.Count / 3);
+		ProfileCounterAdd("MOC TrianglesRendered", occluder->IndexCount / 3);
+
+		OccluderCache::Release(occluder);
 	}
 
-	bool CullObject(const NiAVObject *Object, fplanes& Frustum)
+	bool CullObjectFlags(const NiAVObject *Object)
 	{
 		if (!Object)
 			return true;
@@ -522,6 +412,14 @@ namespace MOC
 		if (name && name[0] == 'L' && name[1] == '2' && name[2] == '_')
 			return true;
 
+		return false;
+	}
+
+	bool CullObject(const NiAVObject *Object, fplanes& Frustum)
+	{
+		if (CullObjectFlags(Object))
+			return true;
+
 		//
 		// Frustum tests
 		//
@@ -553,11 +451,131 @@ namespace MOC
 		return false;
 	}
 
-	void RenderRecursive(fplanes& f, const NiAVObject *Object, bool FirstLevel)
+	//
+	// A node's children are frustum tested together instead of one CullObject() call each. Bounds
+	// are the same ones CullObject() uses, already made relative to MyPosAdjust.
+	//
+	struct ChildBatch
 	{
-		if (CullObject(Object, f))
-			return;
+		std::vector<const NiAVObject *> Boxes;
+		std::vector<float> BoxData[6];			// Center XYZ, half extents XYZ
+		std::vector<const NiAVObject *> Spheres;
+		std::vector<float> SphereData[4];		// Center XYZ, radius
+		std::vector<uint32_t> Indices;
+		std::vector<uint8_t> PlaneMasks;
+
+		void Clear()
+		{
+			Boxes.clear();
+			Spheres.clear();
 
+			for (auto& data : BoxData)
+				data.clear();
+
+			for (auto& data : SphereData)
+				data.clear();
+		}
+
+		void AddBox(const NiAVObject *Object, const BSMultiBoundAABB *Bounds)
+		{
+			Boxes.push_back(Object);
+			BoxData[0].push_back(Bounds->m_kCenter.x - MyPosAdjust.x);
+			BoxData[1].push_back(Bounds->m_kCenter.y - MyPosAdjust.y);
+			BoxData[2].push_back(Bounds->m_kCenter.z - MyPosAdjust.z);
+			BoxData[3].push_back(Bounds->m_kHalfExtents.x);
+			BoxData[4].push_back(Bounds->m_kHalfExtents.y);
+			BoxData[5].push_back(Bounds->m_kHalfExtents.z);
+		}
+
+		void AddSphere(const NiAVObject *Object)
+		{
+			Spheres.push_back(Object);
+			SphereData[0].push_back(Object->m_kWorldBound.m_kCenter.x - MyPosAdjust.x);
+			SphereData[1].push_back(Object->m_kWorldBound.m_kCenter.y - MyPosAdjust.y);
+			SphereData[2].push_back(Object->m_kWorldBound.m_kCenter.z - MyPosAdjust.z);
+			SphereData[3].push_back(Object->m_kWorldBound.m_fRadius);
+		}
+
+		FrustumCull::Output GetOutput(size_t Count)
+		{
+			Indices.resize(Count);
+			PlaneMasks.resize(Count);
+
+			return { Indices.data(), nullptr, PlaneMasks.data() };
+		}
+	};
+
+	void RenderRecursive(fplanes& f, const NiAVObject *Object, bool FirstLevel, uint32_t BoxPlanes, uint32_t SpherePlanes, uint32_t Depth);
+
+	//
+	// BoxPlanes and SpherePlanes are the planes still worth testing in each set. The two sets aren't
+	// built the same way, so a child fully inside one only clears planes from that set.
+	//
+	void RenderChildren(fplanes& f, const NiNode *Node, bool FirstLevel, uint32_t BoxPlanes, uint32_t SpherePlanes, uint32_t Depth)
+	{
+		// One batch per depth. Deque elements never move, so deeper calls can't invalidate this one.
+		thread_local std::deque<ChildBatch> batches;
+
+		if (batches.size() <= Depth)
+			batches.resize(Depth + 1);
+
+		ChildBatch& batch = batches[Depth];
+		batch.Clear();
+
+		for (uint32_t i = 0; i < Node->GetArrayCount(); i++)
+		{
+			const NiAVObject *child = Node->GetAt(i);
+
+			if (CullObjectFlags(child))
+				continue;
+
+			if (auto aabbNode = GetAABBNode(child))
+			{
+				// Not all objects have valid boundaries (certain global cells)
+				if (aabbNode->m_kHalfExtents.z > 1.0f)
+				{
+					batch.AddBox(child, aabbNode);
+					continue;
+				}
+			}
+			else if (child->m_kWorldBound.m_fRadius > 10.0f)
+			{
+				batch.AddSphere(child);
+				continue;
+			}
+
+			// Never frustum tested
+			RenderRecursive(f, child, FirstLevel, BoxPlanes, SpherePlanes, Depth + 1);
+		}
+
+		// Each visible child only tests the planes it crosses from here on down. Like CullObject(), this
+		// assumes a node's bounds contain everything under it.
+		if (!batch.Boxes.empty())
+		{
+			FrustumCull::AABBArrays boxes = { batch.BoxData[0].data(), batch.BoxData[1].data(), batch.BoxData[2].data(), batch.BoxData[3].data(), batch.BoxData[4].data(), batch.BoxData[5].data() };
+			uint32_t visibleCount = f.CullAABBs(boxes, (uint32_t)batch.Boxes.size(), BoxPlanes, batch.GetOutput(batch.Boxes.size()));
+
+			ProfileCounterAdd("MOC FrustumTests", batch.Boxes.size());
+
+			for (uint32_t i = 0; i < visibleCount; i++)
+				RenderRecursive(f, batch.Boxes[batch.Indices[i]], FirstLevel, batch.PlaneMasks[batch.Indices[i]], SpherePlanes, Depth + 1);
+		}
+
+		if (!batch.Spheres.empty())
+		{
+			FrustumCull::SphereArrays spheres = { batch.SphereData[0].data(), batch.SphereData[1].data(), batch.SphereData[2].data(), batch.SphereData[3].data() };
+			uint32_t visibleCount = f.CullSpheres(spheres, (uint32_t)batch.Spheres.size(), SpherePlanes, batch.GetOutput(batch.Spheres.size()));
+
+			ProfileCounterAdd("MOC FrustumTests", batch.Spheres.size());
+
+			for (uint32_t i = 0; i < visibleCount; i++)
+				RenderRecursive(f, batch.Spheres[batch.Indices[i]], FirstLevel, BoxPlanes, batch.PlaneMasks[batch.Indices[i]], Depth + 1);
+		}
+	}
+
+	void RenderRecursive(fplanes& f, const NiAVObject *Object, bool FirstLevel, uint32_t BoxPlanes, uint32_t SpherePlanes, uint32_t Depth)
+	{
+		// Already passed the frustum tests in RenderChildren()
 		bool validBounds = Object->m_kWorldBound.m_fRadius > 1.0f;
 
 		if (FirstLevel)
@@ -575,8 +593,7 @@ namespace MOC
 			if (!node->IsExactKindOf(NiRTTI::ms_BSLeafAnimNode))
 			{
 				// Enumerate children, but don't render this node specifically
-				for (uint32_t i = 0; i < node->GetArrayCount(); i++)
-					RenderRecursive(f, node->GetAt(i), false);
+				RenderChildren(f, node, false, BoxPlanes, SpherePlanes, Depth);
 			}
 		}
 		else if (geometry)
@@ -598,9 +615,35 @@ namespace MOC
 		if (!mocInit || !ui::opt::EnableOccluderRendering)
 			return;
 
-		ThreadedMOC->NotifyPreWork();
 		ThreadedMOC->SubmitSceneRender(Camera);
-		ThreadedMOC->ClearPreWorkNotify();
+	}
+
+	void RecordCandidates(const OccluderSelect::Settings& Settings)
+	{
+		// Every frame is appended while recording is enabled, so replays can check temporal reuse too
+		if (!ui::opt::RecordOccluderCandidates)
+		{
+			if (GeoRecording)
+				fclose(GeoRecording);
+
+			GeoRecording = nullptr;
+			return;
+		}
+
+		if (!GeoRecording && fopen_s(&GeoRecording, "skyrim64_occluders.bin", "wb") != 0)
+		{
+			ui::opt::RecordOccluderCandidates = false;
+			GeoRecording = nullptr;
+			return;
+		}
+
+		OccluderSelect::RecordingHeader header;
+		header.Magic = OccluderSelect::RecordingMagic;
+		header.Count = (uint32_t)GeoList.size();
+		header.FrameSettings = Settings;
+
+		fwrite(&header, sizeof(header), 1, GeoRecording);
+		fwrite(GeoList.data(), sizeof(OccluderSelect::Candidate), GeoList.size(), GeoRecording);
 	}
 
 	void TraverseSceneGraph(NiCamera *Camera)
@@ -645,7 +688,6 @@ namespace MOC
 		GeoList.clear();
 
 		ThreadedMOC->Clear();
-		ThreadedMOC->NotifyPreWork();
 
 		MyPosAdjust = Camera->GetWorldTranslate();
 		Camera->CalculateViewProjection(MyView, MyProj, MyViewProj);
@@ -684,32 +726,31 @@ namespace MOC
 
 			// Everything in these loops will be some kind of node
 			if (!CullObject(landNode, p))
-			{
-				for (uint32_t i = 0; i < landNode->GetArrayCount(); i++)
-					RenderRecursive(p, landNode->GetAt(i), true);
-			}
+				RenderChildren(p, landNode, true, FrustumCull::AllPlanes, FrustumCull::AllPlanes, 0);
 
 			if (!CullObject(staticNode, p))
-			{
-				for (uint32_t i = 0; i < staticNode->GetArrayCount(); i++)
-					RenderRecursive(p, staticNode->GetAt(i), true);
-			}
+				RenderChildren(p, staticNode, true, FrustumCull::AllPlanes, FrustumCull::AllPlanes, 0);
 		}
 
-		// Sort front to back (approx)
-		std::sort(GeoList.begin(), GeoList.end(),
-		[](GeometryDistEntry& a, GeometryDistEntry& b) -> bool
-		{
-			return a.DistanceSquared < b.DistanceSquared;
-		});
+		OccluderSelect::Settings settings;
+		settings.ProjScaleX = MyProj.r[0].m128_f32[0];
+		settings.ProjScaleY = MyProj.r[1].m128_f32[1];
+		settings.TriangleBudget = (uint32_t)std::max(ui::opt::OccluderTriangleBudget, 0);
+		settings.ReuseBonus = ui::opt::OccluderReuseBonus;
+
+		RecordCandidates(settings);
+
+		uint32_t selectedCount = GeoSelector.Select(GeoList, settings);
 
-		for (GeometryDistEntry& entry : GeoList)
-			ThreadedMOC->SubmitGeometry(entry.Geometry);
+		ProfileCounterAdd("MOC OccluderCandidates", GeoList.size());
+		ProfileCounterAdd("MOC OccludersSelected", selectedCount);
+		ProfileCounterAdd("MOC TrianglesSelected", GeoSelector.GetLastTriangleCount());
 
-		ThreadedMOC->ClearPreWorkNotify();
+		for (uint32_t i = 0; i < selectedCount; i++)
+			ThreadedMOC->SubmitGeometry((BSGeometry *)GeoList[i].Object);
 	}
 
-	void TraverseSceneGraphCallback(MaskedOcclusionCulling *MOC, void *UserData)
+	void TraverseSceneGraphCallback(MOC_ThreadedMerger *Merger, void *UserData)
 	{
 		NiCamera *camera = (NiCamera *)UserData;
 		TraverseSceneGraph(camera);
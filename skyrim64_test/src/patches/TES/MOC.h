@@ -3,8 +3,10 @@
 #include <immintrin.h>
 #include <smmintrin.h>
 #include <DirectXMath.h>
+#include "MOC_FrustumCull.h"
 
 class MaskedOcclusionCulling;
+class MOC_ThreadedMerger;
 
 namespace MOC
 {
@@ -16,8 +18,8 @@ namespace MOC
 	void UpdateDepthViewTexture();
 	void ForceFlush();
 
-	void RenderGeometryCallback(MaskedOcclusionCulling *MOC, void *UserData);
-	void TraverseSceneGraphCallback(MaskedOcclusionCulling *MOC, void *UserData);
+	void RenderGeometryCallback(MOC_ThreadedMerger *Merger, void *UserData);
+	void TraverseSceneGraphCallback(MOC_ThreadedMerger *Merger, void *UserData);
 
 	bool TestObject(class NiAVObject *Object);
 
@@ -37,6 +39,8 @@ namespace MOC
 
 		alignas(64) __m128 PlaneComponents[8];
 		alignas(64) float mPlanes[32];
+		FrustumCull::Planes SpherePlanes;	// PlaneComponents, one plane per row for the batch tests
+		FrustumCull::Planes AABBPlanes;		// mPlanes, same
 
 		void InitializeFrustumAABB(float nearClipDistance, float farClipDistance, float aspectRatio, float fov, XMVECTOR position, XMVECTOR look, XMVECTOR up)
 		{
@@ -112,6 +116,12 @@ namespace MOC
 					mPlanes[3 * 8 + i] = -1.0f;
 				}
 			}
+
+			for (int i = 0; i < FrustumCull::PlaneCount; i++)
+			{
+				for (int j = 0; j < 4; j++)
+					AABBPlanes.Plane[i][j] = mPlanes[j * 8 + i];
+			}
 		}
 
 		void InitializeFrustumSphere()
@@ -145,6 +155,12 @@ namespace MOC
 			PlaneComponents[5] = _mm_setr_ps(-planes[4][1], -planes[5][1], -planes[4][1], -planes[5][1]);
 			PlaneComponents[6] = _mm_setr_ps(-planes[4][2], -planes[5][2], -planes[4][2], -planes[5][2]);
 			PlaneComponents[7] = _mm_setr_ps(-planes[4][3], -planes[5][3], -planes[4][3], -planes[5][3]);
+
+			for (int i = 0; i < FrustumCull::PlaneCount; i++)
+			{
+				for (int j = 0; j < 4; j++)
+					SpherePlanes.Plane[i][j] = -planes[i][j];
+			}
 		}
 
 		bool SphereInFrustum(float Center[3], float Radius)
@@ -250,6 +266,16 @@ namespace MOC
 			return true;
 		}
 
+		uint32_t CullSpheres(const FrustumCull::SphereArrays& Spheres, uint32_t Count, uint32_t ActivePlanes, const FrustumCull::Output& Out) const
+		{
+			return FrustumCull::CullSpheres(SpherePlanes, Spheres, Count, ActivePlanes, Out);
+		}
+
+		uint32_t CullAABBs(const FrustumCull::AABBArrays& Boxes, uint32_t Count, uint32_t ActivePlanes, const FrustumCull::Output& Out) const
+		{
+			return FrustumCull::CullAABBs(AABBPlanes, Boxes, Count, ActivePlanes, Out);
+		}
+
 		__forceinline __m128 simd_madd(__m128 a, __m128 b, __m128 c)
 		{
 			return _mm_fmadd_ps(a, b, c);
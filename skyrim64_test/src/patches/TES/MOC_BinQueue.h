@@ -0,0 +1,257 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <algorithm>
+#include <immintrin.h>
+#include <MaskedOcclusionCulling/MaskedOcclusionCulling.h>
+
+//
+// Sort-middle rasterization for a single shared MaskedOcclusionCulling buffer, in the same spirit as the
+// library's CullingThreadpool. The screen is split into BinsW x BinsH bins. Triangles are transformed,
+// clipped and binned once, on whichever thread calls RenderTriangles(), into a job of per-bin lists.
+// Each bin then rasterizes its share of every job in submission order. Bins never overlap, so
+// different threads can rasterize different bins at the same time without any locking on the buffer.
+//
+// Unlike CullingThreadpool, any number of threads may submit at once. Jobs are reserved from a ring
+// with a single atomic increment. A submitter waiting for a free slot rasterizes bins itself instead of
+// spinning, so the ring always drains even when every thread is submitting.
+//
+// Only depends on the MOC library and std::atomic. It doesn't create threads.
+//
+class MOC_BinQueue
+{
+public:
+	const static uint32_t TrisPerJob = 128;		// Larger draw calls are split
+	const static uint32_t MaxJobs = 16;
+	const static uint32_t MaxClippedTris = 6;	// Worst case output of clipping one triangle against all planes
+
+private:
+	struct Job
+	{
+		std::atomic_uint32_t BinnedIndex;				// Sequence number of the job this slot holds once binning is done
+		MaskedOcclusionCulling::TriList *TriLists;		// One per bin
+	};
+
+	struct alignas(64) Bin
+	{
+		std::atomic_uint32_t RenderIndex;				// Next job to rasterize into this bin
+		std::atomic_uint32_t Locked;
+		MaskedOcclusionCulling::ScissorRect Rect;
+	};
+
+	MaskedOcclusionCulling *const m_MOC;
+	const uint32_t m_BinsW;
+	const uint32_t m_BinsH;
+	const uint32_t m_BinCount;
+
+	alignas(64) std::atomic_uint32_t m_WriteIndex;	// Next job to reserve
+	Bin *m_Bins;
+	Job m_Jobs[MaxJobs];
+	float *m_TriListData;
+
+public:
+	MOC_BinQueue(MaskedOcclusionCulling *MOC, uint32_t BinsW, uint32_t BinsH) :
+		m_MOC(MOC),
+		m_BinsW(BinsW),
+		m_BinsH(BinsH),
+		m_BinCount(BinsW * BinsH)
+	{
+		// Worst case: every binned triangle is clipped and lands in every bin. Each triangle is 3 vertices of (x, y, w).
+		const uint32_t maxTrisPerBin = TrisPerJob * MaxClippedTris;
+		const size_t binDataSize = maxTrisPerBin * 3 * 3;
+
+		m_Bins = new Bin[m_BinCount];
+		m_TriListData = new float[binDataSize * m_BinCount * MaxJobs];
+
+		for (uint32_t i = 0; i < MaxJobs; i++)
+		{
+			m_Jobs[i].BinnedIndex.store(UINT32_MAX, std::memory_order_relaxed);
+			m_Jobs[i].TriLists = new MaskedOcclusionCulling::TriList[m_BinCount];
+
+			for (uint32_t j = 0; j < m_BinCount; j++)
+			{
+				MaskedOcclusionCulling::TriList& list = m_Jobs[i].TriLists[j];
+
+				list.mNumTriangles = maxTrisPerBin;
+				list.mTriIdx = 0;
+				list.mPtr = m_TriListData + (i * m_BinCount + j) * binDataSize;
+			}
+		}
+
+		m_WriteIndex.store(0, std::memory_order_relaxed);
+		UpdateScissors();
+	}
+
+	~MOC_BinQueue()
+	{
+		for (uint32_t i = 0; i < MaxJobs; i++)
+			delete[] m_Jobs[i].TriLists;
+
+		delete[] m_TriListData;
+		delete[] m_Bins;
+	}
+
+	MOC_BinQueue(const MOC_BinQueue&) = delete;
+	MOC_BinQueue& operator=(const MOC_BinQueue&) = delete;
+
+	// Must be called after changing the buffer's resolution, with the queue idle
+	void UpdateScissors()
+	{
+		uint32_t width;
+		uint32_t height;
+		uint32_t binWidth;
+		uint32_t binHeight;
+
+		m_MOC->GetResolution(width, height);
+		m_MOC->ComputeBinWidthHeight(m_BinsW, m_BinsH, binWidth, binHeight);
+
+		for (uint32_t y = 0; y < m_BinsH; y++)
+		{
+			for (uint32_t x = 0; x < m_BinsW; x++)
+			{
+				Bin& bin = m_Bins[x + y * m_BinsW];
+
+				// The last row and column also cover whatever the rounded bin size leaves over
+				bin.Rect.mMinX = x * binWidth;
+				bin.Rect.mMaxX = (x + 1 == m_BinsW) ? width : (x + 1) * binWidth;
+				bin.Rect.mMinY = y * binHeight;
+				bin.Rect.mMaxY = (y + 1 == m_BinsH) ? height : (y + 1) * binHeight;
+				bin.RenderIndex.store(m_WriteIndex.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				bin.Locked.store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Thread-safe. Same parameters as MaskedOcclusionCulling::RenderTriangles().
+	void RenderTriangles(
+		const float *Vertices,
+		const uint32_t *Triangles,
+		int TriangleCount,
+		const float *ModelToClipMatrix,
+		MaskedOcclusionCulling::BackfaceWinding Winding,
+		MaskedOcclusionCulling::ClipPlanes ClipPlaneMask,
+		const MaskedOcclusionCulling::VertexLayout& Layout = MaskedOcclusionCulling::VertexLayout(16, 4, 12))
+	{
+		for (int first = 0; first < TriangleCount; first += TrisPerJob)
+		{
+			uint32_t index = m_WriteIndex.fetch_add(1, std::memory_order_relaxed);
+
+			// Wait for every bin to finish with the job that used this slot last
+			while (index - GetMinRenderIndex() >= MaxJobs)
+			{
+				if (!RenderAnyBin())
+					_mm_pause();
+			}
+
+			Job& job = m_Jobs[index % MaxJobs];
+
+			for (uint32_t i = 0; i < m_BinCount; i++)
+				job.TriLists[i].mTriIdx = 0;
+
+			m_MOC->BinTriangles(
+				Vertices,
+				Triangles + first * 3,
+				std::min<int>(TrisPerJob, TriangleCount - first),
+				job.TriLists,
+				m_BinsW,
+				m_BinsH,
+				ModelToClipMatrix,
+				Winding,
+				ClipPlaneMask,
+				Layout);
+
+			job.BinnedIndex.store(index, std::memory_order_release);
+		}
+	}
+
+	// Rasterizes at most one pending job into each bin in [FirstBin, LastBin). Returns true if any work was done.
+	bool RenderBinRange(uint32_t FirstBin, uint32_t LastBin)
+	{
+		bool rendered = false;
+
+		for (uint32_t i = FirstBin; i < LastBin; i++)
+			rendered |= RenderBin(i);
+
+		return rendered;
+	}
+
+	// Rasterizes one pending job into the least advanced bin nobody else is working on. Returns true if
+	// any work was done.
+	bool RenderAnyBin()
+	{
+		uint32_t writeIndex = m_WriteIndex.load(std::memory_order_relaxed);
+		uint32_t bestBin = UINT32_MAX;
+		int32_t bestBacklog = 0;
+
+		for (uint32_t i = 0; i < m_BinCount; i++)
+		{
+			int32_t backlog = (int32_t)(writeIndex - m_Bins[i].RenderIndex.load(std::memory_order_relaxed));
+
+			if (backlog > bestBacklog && !m_Bins[i].Locked.load(std::memory_order_relaxed))
+			{
+				bestBin = i;
+				bestBacklog = backlog;
+			}
+		}
+
+		return bestBin != UINT32_MAX && RenderBin(bestBin);
+	}
+
+	// True when every reserved job has been binned and rasterized into every bin
+	bool IsIdle() const
+	{
+		return GetMinRenderIndex() == m_WriteIndex.load(std::memory_order_acquire);
+	}
+
+	// Splits the bins into WorkerCount contiguous ranges, one per worker
+	void GetBinRange(uint32_t Worker, uint32_t WorkerCount, uint32_t *FirstBin, uint32_t *LastBin) const
+	{
+		*FirstBin = (Worker * m_BinCount) / WorkerCount;
+		*LastBin = ((Worker + 1) * m_BinCount) / WorkerCount;
+	}
+
+	uint32_t GetBinCount() const
+	{
+		return m_BinCount;
+	}
+
+private:
+	bool RenderBin(uint32_t BinIndex)
+	{
+		Bin& bin = m_Bins[BinIndex];
+
+		if (bin.Locked.load(std::memory_order_relaxed) || bin.Locked.exchange(1, std::memory_order_acquire))
+			return false;
+
+		uint32_t index = bin.RenderIndex.load(std::memory_order_relaxed);
+		Job& job = m_Jobs[index % MaxJobs];
+
+		// Not reserved yet, or still being binned
+		if (job.BinnedIndex.load(std::memory_order_acquire) != index)
+		{
+			bin.Locked.store(0, std::memory_order_release);
+			return false;
+		}
+
+		if (job.TriLists[BinIndex].mTriIdx > 0)
+			m_MOC->RenderTrilist(job.TriLists[BinIndex], &bin.Rect);
+
+		bin.RenderIndex.store(index + 1, std::memory_order_release);
+		bin.Locked.store(0, std::memory_order_release);
+		return true;
+	}
+
+	uint32_t GetMinRenderIndex() const
+	{
+		// Indices wrap, so compare distances from the write index instead of the values themselves. A bin
+		// can move past the snapshot of the write index while this runs (negative backlog). It's ignored.
+		uint32_t writeIndex = m_WriteIndex.load(std::memory_order_acquire);
+		int32_t maxBacklog = 0;
+
+		for (uint32_t i = 0; i < m_BinCount; i++)
+			maxBacklog = std::max(maxBacklog, (int32_t)(writeIndex - m_Bins[i].RenderIndex.load(std::memory_order_acquire)));
+
+		return writeIndex - maxBacklog;
+	}
+};
\ No newline at end of file
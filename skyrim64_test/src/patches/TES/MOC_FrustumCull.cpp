@@ -0,0 +1,156 @@
+#include <intrin.h>
+#include <cmath>
+#include "MOC_FrustumCull.h"
+
+namespace MOC::FrustumCull
+{
+	struct Kernels
+	{
+		SphereKernel Spheres;
+		AABBKernel AABBs;
+	};
+
+	Kernels SelectKernels()
+	{
+		int cpuinfo[4];
+		__cpuid(cpuinfo, 0);
+
+		if (cpuinfo[0] < 7)
+			return { CullSpheresScalar, CullAABBsScalar };
+
+		__cpuid(cpuinfo, 1);
+
+		const bool hasFMA = (cpuinfo[2] & (1 << 12)) != 0;
+		const bool hasOSXSAVE = (cpuinfo[2] & (1 << 27)) != 0;
+
+		if (!hasFMA || !hasOSXSAVE)
+			return { CullSpheresScalar, CullAABBsScalar };
+
+		__cpuidex(cpuinfo, 7, 0);
+
+		const bool hasAVX2 = (cpuinfo[1] & (1 << 5)) != 0;
+		const bool hasAVX512F = (cpuinfo[1] & (1 << 16)) != 0;
+
+		// The OS has to save the YMM (and for AVX-512, opmask and ZMM) state on context switches
+		const uint64_t xcr0 = _xgetbv(0);
+
+		if (hasAVX512F && (xcr0 & 0xE6) == 0xE6)
+			return { CullSpheresAVX512, CullAABBsAVX512 };
+
+		if (hasAVX2 && (xcr0 & 0x6) == 0x6)
+			return { CullSpheresAVX2, CullAABBsAVX2 };
+
+		return { CullSpheresScalar, CullAABBsScalar };
+	}
+
+	const Kernels& GetKernels()
+	{
+		static Kernels kernels = SelectKernels();
+		return kernels;
+	}
+
+	uint32_t CullSpheres(const Planes& Frustum, const SphereArrays& Spheres, uint32_t Count, uint32_t ActivePlanes, const Output& Out)
+	{
+		return GetKernels().Spheres(Frustum, Spheres, Count, ActivePlanes, Out);
+	}
+
+	uint32_t CullAABBs(const Planes& Frustum, const AABBArrays& Boxes, uint32_t Count, uint32_t ActivePlanes, const Output& Out)
+	{
+		return GetKernels().AABBs(Frustum, Boxes, Count, ActivePlanes, Out);
+	}
+
+	//
+	// Scalar fallback. Results can differ from the FMA paths in the last bit, which only matters for
+	// bounds exactly touching a plane.
+	//
+	template<typename TestFunc>
+	uint32_t CullScalar(uint32_t Count, uint32_t ActivePlanes, const Output& Out, TestFunc&& Test)
+	{
+		uint32_t visibleCount = 0;
+		uint32_t coherentPlane = 0;
+
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			// Test(Index, Plane) returns 0 for outside, 1 for crossing and 2 for fully inside
+			bool visible = true;
+			uint32_t crossed = 0;
+
+			if ((ActivePlanes & (1u << coherentPlane)) && Test(i, coherentPlane) == 0)
+				visible = false;
+
+			for (uint32_t p = 0; visible && p < PlaneCount; p++)
+			{
+				if (!(ActivePlanes & (1u << p)))
+					continue;
+
+				uint32_t result = Test(i, p);
+
+				if (result == 0)
+				{
+					visible = false;
+					coherentPlane = p;
+				}
+				else if (result == 1)
+				{
+					crossed |= 1u << p;
+				}
+			}
+
+			if (Out.VisibleBits)
+			{
+				if ((i & 63) == 0)
+					Out.VisibleBits[i / 64] = 0;
+
+				Out.VisibleBits[i / 64] |= (uint64_t)visible << (i & 63);
+			}
+
+			if (Out.PlaneMasks)
+				Out.PlaneMasks[i] = (uint8_t)crossed;
+
+			if (visible)
+			{
+				if (Out.Indices)
+					Out.Indices[visibleCount] = i;
+
+				visibleCount++;
+			}
+		}
+
+		return visibleCount;
+	}
+
+	uint32_t CullSpheresScalar(const Planes& Frustum, const SphereArrays& Spheres, uint32_t Count, uint32_t ActivePlanes, const Output& Out)
+	{
+		return CullScalar(Count, ActivePlanes, Out, [&](uint32_t i, uint32_t p)
+		{
+			const float *plane = Frustum.Plane[p];
+			float v = Spheres.CenterZ[i] * plane[2] + (Spheres.CenterY[i] * plane[1] + (Spheres.CenterX[i] * plane[0] + plane[3]));
+
+			if (v > Spheres.Radius[i])
+				return 0;
+
+			return (v < -Spheres.Radius[i]) ? 2 : 1;
+		});
+	}
+
+	uint32_t CullAABBsScalar(const Planes& Frustum, const AABBArrays& Boxes, uint32_t Count, uint32_t ActivePlanes, const Output& Out)
+	{
+		return CullScalar(Count, ActivePlanes, Out, [&](uint32_t i, uint32_t p)
+		{
+			const float *plane = Frustum.Plane[p];
+
+			// Same doubled extents as AABBInFrustum(), flipped toward the plane
+			float ex = std::signbit(plane[0]) ? -2.0f * Boxes.HalfX[i] : 2.0f * Boxes.HalfX[i];
+			float ey = std::signbit(plane[1]) ? -2.0f * Boxes.HalfY[i] : 2.0f * Boxes.HalfY[i];
+			float ez = std::signbit(plane[2]) ? -2.0f * Boxes.HalfZ[i] : 2.0f * Boxes.HalfZ[i];
+
+			float nearDot = (Boxes.CenterZ[i] - ez) * plane[2] + ((Boxes.CenterY[i] - ey) * plane[1] + ((Boxes.CenterX[i] - ex) * plane[0] + plane[3]));
+
+			if (!std::signbit(nearDot))
+				return 0;
+
+			float farDot = (Boxes.CenterZ[i] + ez) * plane[2] + ((Boxes.CenterY[i] + ey) * plane[1] + ((Boxes.CenterX[i] + ex) * plane[0] + plane[3]));
+			return std::signbit(farDot) ? 2 : 1;
+		});
+	}
+}
\ No newline at end of file
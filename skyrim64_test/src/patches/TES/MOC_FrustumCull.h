@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// Batched frustum tests over structure-of-arrays bounds. Each kernel tests 8 (AVX2) or 16 (AVX-512)
+// objects per iteration with the same math as fplanes::SphereInFrustum() and AABBInFrustum(), so
+// the SIMD paths return the same results. The kernel is picked once from CPUID. CPUs without AVX2
+// fall back to a scalar loop.
+//
+// Only the planes in ActivePlanes are tested. The rest are treated as if every object were fully
+// inside them. PlaneMasks reports which of the active planes each object crosses. An object whose
+// mask is zero is completely inside, and anything it contains can skip the test altogether.
+//
+// Consecutive objects tend to be culled by the same plane. Each group of lanes tests the plane that
+// culled the most lanes of the previous group first, and a group it rejects entirely skips the
+// other planes.
+//
+// Arrays don't need padding or alignment.
+//
+namespace MOC::FrustumCull
+{
+	const static uint32_t PlaneCount = 6;
+	const static uint32_t AllPlanes = (1u << PlaneCount) - 1;
+
+	struct Planes
+	{
+		// Spheres: (-N, -D), an object is outside when dot(-N, Center) - D > Radius
+		// AABBs: (N, D) facing out, an object is outside when its nearest corner has dot(N, Corner) + D >= 0
+		alignas(16) float Plane[PlaneCount][4];
+	};
+
+	struct SphereArrays
+	{
+		const float *CenterX;
+		const float *CenterY;
+		const float *CenterZ;
+		const float *Radius;
+	};
+
+	struct AABBArrays
+	{
+		const float *CenterX;
+		const float *CenterY;
+		const float *CenterZ;
+		const float *HalfX;
+		const float *HalfY;
+		const float *HalfZ;
+	};
+
+	struct Output
+	{
+		uint32_t *Indices;			// Optional, visible object indices in ascending order
+		uint64_t *VisibleBits;		// Optional, bit N set when object N is visible ((Count + 63) / 64 words)
+		uint8_t *PlaneMasks;		// Optional, active planes crossed by each object (Count bytes, undefined when culled)
+	};
+
+	typedef uint32_t (*SphereKernel)(const Planes& Frustum, const SphereArrays& Spheres, uint32_t Count, uint32_t ActivePlanes, const Output& Out);
+	typedef uint32_t (*AABBKernel)(const Planes& Frustum, const AABBArrays& Boxes, uint32_t Count, uint32_t ActivePlanes, const Output& Out);
+
+	// Both return the number of visible objects
+	uint32_t CullSpheres(const Planes& Frustum, const SphereArrays& Spheres, uint32_t Count, uint32_t ActivePlanes, const Output& Out);
+	uint32_t CullAABBs(const Planes& Frustum, const AABBArrays& Boxes, uint32_t Count, uint32_t ActivePlanes, const Output& Out);
+
+	// Kernel implementations, exposed for testing
+	uint32_t CullSpheresScalar(const Planes& Frustum, const SphereArrays& Spheres, uint32_t Count, uint32_t ActivePlanes, const Output& Out);
+	uint32_t CullAABBsScalar(const Planes& Frustum, const AABBArrays& Boxes, uint32_t Count, uint32_t ActivePlanes, const Output& Out);
+	uint32_t CullSpheresAVX2(const Planes& Frustum, const SphereArrays& Spheres, uint32_t Count, uint32_t ActivePlanes, const Output& Out);
+	uint32_t CullAABBsAVX2(const Planes& Frustum, const AABBArrays& Boxes, uint32_t Count, uint32_t ActivePlanes, const Output& Out);
+	uint32_t CullSpheresAVX512(const Planes& Frustum, const SphereArrays& Spheres, uint32_t Count, uint32_t ActivePlanes, const Output& Out);
+	uint32_t CullAABBsAVX512(const Planes& Frustum, const AABBArrays& Boxes, uint32_t Count, uint32_t ActivePlanes, const Output& Out);
+}
\ No newline at end of file
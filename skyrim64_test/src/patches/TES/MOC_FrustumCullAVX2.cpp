@@ -0,0 +1,226 @@
+#include <immintrin.h>
+#include <intrin.h>
+#include <string.h>
+#include "MOC_FrustumCull.h"
+
+//
+// Compiled with /arch:AVX2. Only called when CPUID reports AVX2 and FMA.
+//
+namespace MOC::FrustumCull
+{
+	namespace
+	{
+		const uint32_t Width = 8;
+
+		uint32_t GetPlaneOrder(uint32_t ActivePlanes, uint32_t First, uint32_t *Order)
+		{
+			uint32_t count = 0;
+
+			if (ActivePlanes & (1u << First))
+				Order[count++] = First;
+
+			for (uint32_t p = 0; p < PlaneCount; p++)
+			{
+				if ((ActivePlanes & (1u << p)) && p != First)
+					Order[count++] = p;
+			}
+
+			return count;
+		}
+
+		__m256 LoadLanes(const float *Data, uint32_t Index, uint32_t LaneCount)
+		{
+			if (LaneCount == Width)
+				return _mm256_loadu_ps(Data + Index);
+
+			const __m256i lanes = _mm256_cmpgt_epi32(_mm256_set1_epi32(LaneCount), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+			return _mm256_maskload_ps(Data + Index, lanes);
+		}
+
+		//
+		// Test(Lanes, Plane, Keep, Inside) sets Keep in every lane that isn't outside the plane
+		// and Inside in every lane that is completely inside it.
+		//
+		template<typename LoadFunc, typename TestFunc>
+		uint32_t Cull(uint32_t Count, uint32_t ActivePlanes, const Output& Out, LoadFunc&& Load, TestFunc&& Test)
+		{
+			uint32_t visibleCount = 0;
+			uint32_t order[PlaneCount] = {};
+			uint32_t orderCount = GetPlaneOrder(ActivePlanes, 0, order);
+
+			for (uint32_t i = 0; i < Count; i += Width)
+			{
+				const uint32_t laneCount = (Count - i < Width) ? Count - i : Width;
+				const uint32_t laneMask = (1u << laneCount) - 1;
+
+				auto lanes = Load(i, laneCount);
+
+				uint32_t culled = 0;
+				uint32_t bestPlane = order[0];
+				uint32_t bestCulled = 0;
+				__m256i crossed = _mm256_setzero_si256();
+
+				for (uint32_t k = 0; k < orderCount && (culled & laneMask) != laneMask; k++)
+				{
+					__m256 keep;
+					__m256 inside;
+					Test(lanes, order[k], &keep, &inside);
+
+					const uint32_t planeCulled = ~(uint32_t)_mm256_movemask_ps(keep) & laneMask;
+					const uint32_t planeCulledCount = _mm_popcnt_u32(planeCulled);
+
+					if (planeCulledCount > bestCulled)
+					{
+						bestPlane = order[k];
+						bestCulled = planeCulledCount;
+					}
+
+					culled |= planeCulled;
+					crossed = _mm256_or_si256(crossed, _mm256_and_si256(_mm256_castps_si256(_mm256_andnot_ps(inside, keep)), _mm256_set1_epi32(1 << order[k])));
+				}
+
+				// Lead with whichever plane culled the most this time
+				if (bestCulled > 0 && bestPlane != order[0])
+					orderCount = GetPlaneOrder(ActivePlanes, bestPlane, order);
+
+				uint32_t visible = ~culled & laneMask;
+
+				if (Out.VisibleBits)
+				{
+					if ((i & 63) == 0)
+						Out.VisibleBits[i / 64] = 0;
+
+					Out.VisibleBits[i / 64] |= (uint64_t)visible << (i & 63);
+				}
+
+				if (Out.PlaneMasks)
+				{
+					// Masks are at most 6 bits, so saturating packs don't change them
+					__m128i words = _mm_packus_epi32(_mm256_castsi256_si128(crossed), _mm256_extracti128_si256(crossed, 1));
+					__m128i bytes = _mm_packus_epi16(words, words);
+
+					if (laneCount == Width)
+					{
+						_mm_storel_epi64((__m128i *)&Out.PlaneMasks[i], bytes);
+					}
+					else
+					{
+						alignas(16) uint8_t masks[16];
+						_mm_store_si128((__m128i *)masks, bytes);
+						memcpy(&Out.PlaneMasks[i], masks, laneCount);
+					}
+				}
+
+				if (Out.Indices)
+				{
+					for (unsigned long bit; _BitScanForward(&bit, visible); visible &= visible - 1)
+						Out.Indices[visibleCount++] = i + bit;
+				}
+				else
+				{
+					visibleCount += _mm_popcnt_u32(visible);
+				}
+			}
+
+			return visibleCount;
+		}
+
+		struct SphereLanes
+		{
+			__m256 X;
+			__m256 Y;
+			__m256 Z;
+			__m256 Radius;
+		};
+
+		struct AABBLanes
+		{
+			__m256 X;
+			__m256 Y;
+			__m256 Z;
+			__m256 ExtentX;		// Doubled half extents, same as AABBInFrustum()
+			__m256 ExtentY;
+			__m256 ExtentZ;
+		};
+	}
+
+	uint32_t CullSpheresAVX2(const Planes& Frustum, const SphereArrays& Spheres, uint32_t Count, uint32_t ActivePlanes, const Output& Out)
+	{
+		auto load = [&](uint32_t Index, uint32_t LaneCount)
+		{
+			SphereLanes lanes;
+			lanes.X = LoadLanes(Spheres.CenterX, Index, LaneCount);
+			lanes.Y = LoadLanes(Spheres.CenterY, Index, LaneCount);
+			lanes.Z = LoadLanes(Spheres.CenterZ, Index, LaneCount);
+			lanes.Radius = LoadLanes(Spheres.Radius, Index, LaneCount);
+
+			return lanes;
+		};
+
+		auto test = [&](const SphereLanes& Lanes, uint32_t Plane, __m256 *Keep, __m256 *Inside)
+		{
+			const float *plane = Frustum.Plane[Plane];
+
+			// dot(-N, Center) - D, in the same order as SphereInFrustum()
+			__m256 v = _mm256_fmadd_ps(Lanes.X, _mm256_set1_ps(plane[0]), _mm256_set1_ps(plane[3]));
+			v = _mm256_fmadd_ps(Lanes.Y, _mm256_set1_ps(plane[1]), v);
+			v = _mm256_fmadd_ps(Lanes.Z, _mm256_set1_ps(plane[2]), v);
+
+			*Keep = _mm256_cmp_ps(v, Lanes.Radius, _CMP_NGT_UQ);
+			*Inside = _mm256_cmp_ps(v, _mm256_xor_ps(Lanes.Radius, _mm256_set1_ps(-0.0f)), _CMP_LT_OQ);
+		};
+
+		return Cull(Count, ActivePlanes, Out, load, test);
+	}
+
+	uint32_t CullAABBsAVX2(const Planes& Frustum, const AABBArrays& Boxes, uint32_t Count, uint32_t ActivePlanes, const Output& Out)
+	{
+		auto load = [&](uint32_t Index, uint32_t LaneCount)
+		{
+			AABBLanes lanes;
+			lanes.X = LoadLanes(Boxes.CenterX, Index, LaneCount);
+			lanes.Y = LoadLanes(Boxes.CenterY, Index, LaneCount);
+			lanes.Z = LoadLanes(Boxes.CenterZ, Index, LaneCount);
+
+			__m256 halfX = LoadLanes(Boxes.HalfX, Index, LaneCount);
+			__m256 halfY = LoadLanes(Boxes.HalfY, Index, LaneCount);
+			__m256 halfZ = LoadLanes(Boxes.HalfZ, Index, LaneCount);
+
+			lanes.ExtentX = _mm256_add_ps(halfX, halfX);
+			lanes.ExtentY = _mm256_add_ps(halfY, halfY);
+			lanes.ExtentZ = _mm256_add_ps(halfZ, halfZ);
+
+			return lanes;
+		};
+
+		auto test = [&](const AABBLanes& Lanes, uint32_t Plane, __m256 *Keep, __m256 *Inside)
+		{
+			const float *plane = Frustum.Plane[Plane];
+			const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+			const __m256 planeX = _mm256_set1_ps(plane[0]);
+			const __m256 planeY = _mm256_set1_ps(plane[1]);
+			const __m256 planeZ = _mm256_set1_ps(plane[2]);
+			const __m256 planeW = _mm256_set1_ps(plane[3]);
+
+			// Extents signed so that the corner below is the one closest to the inside
+			const __m256 extentX = _mm256_xor_ps(Lanes.ExtentX, _mm256_and_ps(planeX, signMask));
+			const __m256 extentY = _mm256_xor_ps(Lanes.ExtentY, _mm256_and_ps(planeY, signMask));
+			const __m256 extentZ = _mm256_xor_ps(Lanes.ExtentZ, _mm256_and_ps(planeZ, signMask));
+
+			__m256 nearDot = _mm256_fmadd_ps(_mm256_sub_ps(Lanes.X, extentX), planeX, planeW);
+			nearDot = _mm256_fmadd_ps(_mm256_sub_ps(Lanes.Y, extentY), planeY, nearDot);
+			nearDot = _mm256_fmadd_ps(_mm256_sub_ps(Lanes.Z, extentZ), planeZ, nearDot);
+
+			__m256 farDot = _mm256_fmadd_ps(_mm256_add_ps(Lanes.X, extentX), planeX, planeW);
+			farDot = _mm256_fmadd_ps(_mm256_add_ps(Lanes.Y, extentY), planeY, farDot);
+			farDot = _mm256_fmadd_ps(_mm256_add_ps(Lanes.Z, extentZ), planeZ, farDot);
+
+			// Negative means inside. Only the sign bit is checked, like AABBInFrustum().
+			*Keep = _mm256_castsi256_ps(_mm256_srai_epi32(_mm256_castps_si256(nearDot), 31));
+			*Inside = _mm256_castsi256_ps(_mm256_srai_epi32(_mm256_castps_si256(farDot), 31));
+		};
+
+		return Cull(Count, ActivePlanes, Out, load, test);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include <immintrin.h>
+#include "MOC_FrustumCull.h"
+
+//
+// Only called when CPUID reports AVX-512F and the OS saves ZMM state. The lane mask handles the
+// tail, so there's no scalar remainder.
+//
+namespace MOC::FrustumCull
+{
+	namespace
+	{
+		const uint32_t Width = 16;
+
+		uint32_t GetPlaneOrder(uint32_t ActivePlanes, uint32_t First, uint32_t *Order)
+		{
+			uint32_t count = 0;
+
+			if (ActivePlanes & (1u << First))
+				Order[count++] = First;
+
+			for (uint32_t p = 0; p < PlaneCount; p++)
+			{
+				if ((ActivePlanes & (1u << p)) && p != First)
+					Order[count++] = p;
+			}
+
+			return count;
+		}
+
+		//
+		// Test(Lanes, Plane, Keep, Inside) sets Keep for every lane that isn't outside the plane and
+		// Inside for every lane that is completely inside it.
+		//
+		template<typename LoadFunc, typename TestFunc>
+		uint32_t Cull(uint32_t Count, uint32_t ActivePlanes, const Output& Out, LoadFunc&& Load, TestFunc&& Test)
+		{
+			uint32_t visibleCount = 0;
+			uint32_t order[PlaneCount] = {};
+			uint32_t orderCount = GetPlaneOrder(ActivePlanes, 0, order);
+
+			const __m512i laneIndex = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+			for (uint32_t i = 0; i < Count; i += Width)
+			{
+				const uint32_t laneCount = (Count - i < Width) ? Count - i : Width;
+				const __mmask16 laneMask = (__mmask16)((1u << laneCount) - 1);
+
+				auto lanes = Load(i, laneMask);
+
+				__mmask16 culled = 0;
+				uint32_t bestPlane = order[0];
+				uint32_t bestCulled = 0;
+				__m512i crossed = _mm512_setzero_si512();
+
+				for (uint32_t k = 0; k < orderCount && (culled & laneMask) != laneMask; k++)
+				{
+					__mmask16 keep;
+					__mmask16 inside;
+					Test(lanes, order[k], &keep, &inside);
+
+					const __mmask16 planeCulled = (__mmask16)(~keep & laneMask);
+					const uint32_t planeCulledCount = _mm_popcnt_u32(planeCulled);
+
+					if (planeCulledCount > bestCulled)
+					{
+						bestPlane = order[k];
+						bestCulled = planeCulledCount;
+					}
+
+					culled |= planeCulled;
+					crossed = _mm512_mask_or_epi32(crossed, (__mmask16)(keep & ~inside), crossed, _mm512_set1_epi32(1 << order[k]));
+				}
+
+				// Lead with whichever plane culled the most this time
+				if (bestCulled > 0 && bestPlane != order[0])
+					orderCount = GetPlaneOrder(ActivePlanes, bestPlane, order);
+
+				const __mmask16 visible = (__mmask16)(~culled & laneMask);
+
+				if (Out.VisibleBits)
+				{
+					if ((i & 63) == 0)
+						Out.VisibleBits[i / 64] = 0;
+
+					Out.VisibleBits[i / 64] |= (uint64_t)visible << (i & 63);
+				}
+
+				if (Out.PlaneMasks)
+					_mm512_mask_cvtepi32_storeu_epi8(&Out.PlaneMasks[i], laneMask, crossed);
+
+				if (Out.Indices)
+					_mm512_mask_compressstoreu_epi32(&Out.Indices[visibleCount], visible, _mm512_add_epi32(laneIndex, _mm512_set1_epi32(i)));
+
+				visibleCount += _mm_popcnt_u32(visible);
+			}
+
+			return visibleCount;
+		}
+
+		struct SphereLanes
+		{
+			__m512 X;
+			__m512 Y;
+			__m512 Z;
+			__m512 Radius;
+		};
+
+		struct AABBLanes
+		{
+			__m512 X;
+			__m512 Y;
+			__m512 Z;
+			__m512 ExtentX;		// Doubled half extents, same as AABBInFrustum()
+			__m512 ExtentY;
+			__m512 ExtentZ;
+		};
+	}
+
+	uint32_t CullSpheresAVX512(const Planes& Frustum, const SphereArrays& Spheres, uint32_t Count, uint32_t ActivePlanes, const Output& Out)
+	{
+		auto load = [&](uint32_t Index, __mmask16 LaneMask)
+		{
+			SphereLanes lanes;
+			lanes.X = _mm512_maskz_loadu_ps(LaneMask, Spheres.CenterX + Index);
+			lanes.Y = _mm512_maskz_loadu_ps(LaneMask, Spheres.CenterY + Index);
+			lanes.Z = _mm512_maskz_loadu_ps(LaneMask, Spheres.CenterZ + Index);
+			lanes.Radius = _mm512_maskz_loadu_ps(LaneMask, Spheres.Radius + Index);
+
+			return lanes;
+		};
+
+		auto test = [&](const SphereLanes& Lanes, uint32_t Plane, __mmask16 *Keep, __mmask16 *Inside)
+		{
+			const float *plane = Frustum.Plane[Plane];
+
+			// dot(-N, Center) - D, in the same order as SphereInFrustum()
+			__m512 v = _mm512_fmadd_ps(Lanes.X, _mm512_set1_ps(plane[0]), _mm512_set1_ps(plane[3]));
+			v = _mm512_fmadd_ps(Lanes.Y, _mm512_set1_ps(plane[1]), v);
+			v = _mm512_fmadd_ps(Lanes.Z, _mm512_set1_ps(plane[2]), v);
+
+			*Keep = _mm512_cmp_ps_mask(v, Lanes.Radius, _CMP_NGT_UQ);
+			*Inside = _mm512_cmp_ps_mask(v, _mm512_sub_ps(_mm512_setzero_ps(), Lanes.Radius), _CMP_LT_OQ);
+		};
+
+		return Cull(Count, ActivePlanes, Out, load, test);
+	}
+
+	uint32_t CullAABBsAVX512(const Planes& Frustum, const AABBArrays& Boxes, uint32_t Count, uint32_t ActivePlanes, const Output& Out)
+	{
+		auto load = [&](uint32_t Index, __mmask16 LaneMask)
+		{
+			AABBLanes lanes;
+			lanes.X = _mm512_maskz_loadu_ps(LaneMask, Boxes.CenterX + Index);
+			lanes.Y = _mm512_maskz_loadu_ps(LaneMask, Boxes.CenterY + Index);
+			lanes.Z = _mm512_maskz_loadu_ps(LaneMask, Boxes.CenterZ + Index);
+
+			__m512 halfX = _mm512_maskz_loadu_ps(LaneMask, Boxes.HalfX + Index);
+			__m512 halfY = _mm512_maskz_loadu_ps(LaneMask, Boxes.HalfY + Index);
+			__m512 halfZ = _mm512_maskz_loadu_ps(LaneMask, Boxes.HalfZ + Index);
+
+			lanes.ExtentX = _mm512_add_ps(halfX, halfX);
+			lanes.ExtentY = _mm512_add_ps(halfY, halfY);
+			lanes.ExtentZ = _mm512_add_ps(halfZ, halfZ);
+
+			return lanes;
+		};
+
+		auto test = [&](const AABBLanes& Lanes, uint32_t Plane, __mmask16 *Keep, __mmask16 *Inside)
+		{
+			const float *plane = Frustum.Plane[Plane];
+
+			const __m512 planeX = _mm512_set1_ps(plane[0]);
+			const __m512 planeY = _mm512_set1_ps(plane[1]);
+			const __m512 planeZ = _mm512_set1_ps(plane[2]);
+			const __m512 planeW = _mm512_set1_ps(plane[3]);
+
+			// Extents signed so that the corner below is the one closest to the inside
+			const __m512i signMask = _mm512_set1_epi32(0x80000000);
+			const __m512 extentX = _mm512_castsi512_ps(_mm512_xor_epi32(_mm512_castps_si512(Lanes.ExtentX), _mm512_and_epi32(_mm512_castps_si512(planeX), signMask)));
+			const __m512 extentY = _mm512_castsi512_ps(_mm512_xor_epi32(_mm512_castps_si512(Lanes.ExtentY), _mm512_and_epi32(_mm512_castps_si512(planeY), signMask)));
+			const __m512 extentZ = _mm512_castsi512_ps(_mm512_xor_epi32(_mm512_castps_si512(Lanes.ExtentZ), _mm512_and_epi32(_mm512_castps_si512(planeZ), signMask)));
+
+			__m512 nearDot = _mm512_fmadd_ps(_mm512_sub_ps(Lanes.X, extentX), planeX, planeW);
+			nearDot = _mm512_fmadd_ps(_mm512_sub_ps(Lanes.Y, extentY), planeY, nearDot);
+			nearDot = _mm512_fmadd_ps(_mm512_sub_ps(Lanes.Z, extentZ), planeZ, nearDot);
+
+			__m512 farDot = _mm512_fmadd_ps(_mm512_add_ps(Lanes.X, extentX), planeX, planeW);
+			farDot = _mm512_fmadd_ps(_mm512_add_ps(Lanes.Y, extentY), planeY, farDot);
+			farDot = _mm512_fmadd_ps(_mm512_add_ps(Lanes.Z, extentZ), planeZ, farDot);
+
+			// Negative means inside. Only the sign bit is checked, like AABBInFrustum().
+			*Keep = _mm512_test_epi32_mask(_mm512_castps_si512(nearDot), signMask);
+			*Inside = _mm512_test_epi32_mask(_mm512_castps_si512(farDot), signMask);
+		};
+
+		return Cull(Count, ActivePlanes, Out, load, test);
+	}
+}
\ No newline at end of file
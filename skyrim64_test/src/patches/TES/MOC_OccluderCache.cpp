@@ -0,0 +1,353 @@
+#include "../../common.h"
+#include "FlatScatterTable.h"
+#include "MOC_OccluderCache.h"
+
+namespace MOC::OccluderCache
+{
+	const static char *PackFilePath = "skyrim64_occludercache.bin";
+
+	//
+	// Lookups by owner take the lock shared. Everything else is exclusive, but building, loading and
+	// verifying a record all happen with no lock held.
+	//
+	// A reference count only drops to zero with the lock held exclusively, so nobody can find an
+	// entry through a table and take a reference while it's being freed.
+	//
+	SRWLOCK CacheLock = SRWLOCK_INIT;
+	FlatScatterTable<uintptr_t, Entry *> Bindings;		// Owner -> entry, each binding holds a reference
+	FlatScatterTable<uint64_t, Entry *> LiveEntries;	// Key -> entry with at least one reference
+	FlatScatterTable<uint64_t, uint64_t> PackRecords;	// Key -> offset of its newest record in the pack
+
+	HANDLE PackFile = INVALID_HANDLE_VALUE;
+	HANDLE PackMapping;
+	const uint8_t *PackView;
+	uint64_t PackViewLength;							// Records appended after startup are past the end of the view
+	uint64_t PackLength;
+
+	bool MapPack(uint64_t Length)
+	{
+		PackMapping = CreateFileMappingA(PackFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+		if (!PackMapping)
+			return false;
+
+		PackView = (const uint8_t *)MapViewOfFile(PackMapping, FILE_MAP_READ, 0, 0, 0);
+		PackViewLength = PackView ? Length : 0;
+		return PackView != nullptr;
+	}
+
+	void UnmapPack()
+	{
+		PackRecords.clear();
+
+		if (PackView)
+			UnmapViewOfFile(PackView);
+
+		if (PackMapping)
+			CloseHandle(PackMapping);
+
+		PackView = nullptr;
+		PackViewLength = 0;
+		PackMapping = nullptr;
+	}
+
+	bool WriteAt(uint64_t Offset, const void *Data, uint64_t Length)
+	{
+		// Positioned I/O, so reads outside the lock never race on the file pointer
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)Offset;
+		overlapped.OffsetHigh = (DWORD)(Offset >> 32);
+		DWORD bytesWritten;
+
+		return WriteFile(PackFile, Data, (DWORD)Length, &bytesWritten, &overlapped) && bytesWritten == Length;
+	}
+
+	bool ReadAt(uint64_t Offset, void *Data, uint64_t Length)
+	{
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)Offset;
+		overlapped.OffsetHigh = (DWORD)(Offset >> 32);
+		DWORD bytesRead;
+
+		return ReadFile(PackFile, Data, (DWORD)Length, &bytesRead, &overlapped) && bytesRead == Length;
+	}
+
+	bool ResetPack()
+	{
+		UnmapPack();
+
+		LARGE_INTEGER start = {};
+		PackHeader header = { PackMagic, PackVersion };
+
+		if (!SetFilePointerEx(PackFile, start, nullptr, FILE_BEGIN) || !SetEndOfFile(PackFile))
+			return false;
+
+		if (!WriteAt(0, &header, sizeof(header)))
+			return false;
+
+		PackLength = sizeof(header);
+		return true;
+	}
+
+	void ScanPack()
+	{
+		// Newer records for the same key win
+		PackLength = Scan(PackView, PackViewLength, [](const RecordHeader *Record, uint64_t Offset)
+		{
+			PackRecords.insert_or_assign(Record->Key, Offset);
+		});
+	}
+
+	bool OpenPack()
+	{
+		PackFile = CreateFileA(PackFilePath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+		if (PackFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+
+		if (!GetFileSizeEx(PackFile, &fileSize))
+			return false;
+
+		if ((uint64_t)fileSize.QuadPart <= sizeof(PackHeader))
+			return ResetPack();
+
+		if (!MapPack(fileSize.QuadPart))
+			return ResetPack();
+
+		auto header = (const PackHeader *)PackView;
+
+		if (header->Magic != PackMagic || header->Version != PackVersion)
+			return ResetPack();
+
+		ScanPack();
+
+		if (PackLength < (uint64_t)fileSize.QuadPart)
+		{
+			// Cut off the torn record. The file can't shrink while it's mapped.
+			UnmapPack();
+
+			LARGE_INTEGER end;
+			end.QuadPart = PackLength;
+
+			if (!SetFilePointerEx(PackFile, end, nullptr, FILE_BEGIN) || !SetEndOfFile(PackFile) || !MapPack(PackLength))
+				return ResetPack();
+
+			ScanPack();
+		}
+
+		return true;
+	}
+
+	bool Initialize()
+	{
+		// Without a pack file everything still works, it just isn't persistent
+		static bool initialized = []()
+		{
+			if (OpenPack())
+				return true;
+
+			UnmapPack();
+
+			if (PackFile != INVALID_HANDLE_VALUE)
+				CloseHandle(PackFile);
+
+			PackFile = INVALID_HANDLE_VALUE;
+			return false;
+		}();
+
+		return initialized;
+	}
+
+	Entry *LoadEntry(uint64_t Key, uint64_t Offset)
+	{
+		auto entry = std::make_unique<Entry>();
+		const RecordHeader *record;
+
+		if (Offset < PackViewLength)
+		{
+			// Bounds were checked by the scan
+			record = (const RecordHeader *)(PackView + Offset);
+		}
+		else
+		{
+			// Appended by this process, so the header can be trusted
+			RecordHeader header;
+
+			if (!ReadAt(Offset, &header, sizeof(header)))
+				return nullptr;
+
+			entry->Storage.reset(new uint8_t[GetRecordSize(&header)]);
+
+			if (!ReadAt(Offset, entry->Storage.get(), GetRecordSize(&header)))
+				return nullptr;
+
+			record = (const RecordHeader *)entry->Storage.get();
+		}
+
+		if (record->Key != Key || record->Checksum != GetChecksum(record))
+			return nullptr;
+
+		GetRecordData(record, entry.get());
+		return entry.release();
+	}
+
+	Entry *BuildEntry(uint64_t Key, const SourceMesh& Mesh, std::vector<uint8_t>& Record)
+	{
+		Build(Key, Mesh, Record);
+
+		auto entry = new Entry();
+		entry->Storage.reset(new uint8_t[Record.size()]);
+		memcpy(entry->Storage.get(), Record.data(), Record.size());
+
+		GetRecordData((const RecordHeader *)entry->Storage.get(), entry);
+		return entry;
+	}
+
+	void Bind(const void *Owner, Entry *Ref)
+	{
+		Bindings.insert((uintptr_t)Owner, Ref);
+		Ref->RefCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Entry *Acquire(const void *Owner, const SourceMesh& Mesh)
+	{
+		Entry *entry = nullptr;
+
+		AcquireSRWLockShared(&CacheLock);
+		{
+			if (Entry **binding = Bindings.find((uintptr_t)Owner))
+			{
+				// The binding's own reference keeps the count above zero
+				entry = *binding;
+				entry->RefCount.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+		ReleaseSRWLockShared(&CacheLock);
+
+		if (entry)
+			return entry;
+
+		Initialize();
+
+		const uint64_t key = GetKey(Mesh);
+		uint64_t offset = 0;
+		bool inPack = false;
+
+		AcquireSRWLockExclusive(&CacheLock);
+		{
+			if (Entry **binding = Bindings.find((uintptr_t)Owner))
+			{
+				entry = *binding;
+			}
+			else if (Entry **live = LiveEntries.find(key))
+			{
+				entry = *live;
+				Bind(Owner, entry);
+			}
+			else
+			{
+				inPack = PackRecords.get(key, offset);
+			}
+
+			if (entry)
+				entry->RefCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		ReleaseSRWLockExclusive(&CacheLock);
+
+		if (entry)
+			return entry;
+
+		// Done unlocked. Another thread may be loading or building the same key, the loser's copy is thrown away.
+		std::vector<uint8_t> record;
+
+		if (inPack)
+			entry = LoadEntry(key, offset);
+
+		if (entry)
+		{
+			ProfileCounterInc("MOC OccludersLoaded");
+		}
+		else
+		{
+			ProfileTimer("MOC BuildOccluder");
+			ProfileCounterInc("MOC OccludersBuilt");
+
+			entry = BuildEntry(key, Mesh, record);
+		}
+
+		Entry *discard = nullptr;
+
+		AcquireSRWLockExclusive(&CacheLock);
+		{
+			if (Entry **binding = Bindings.find((uintptr_t)Owner))
+			{
+				discard = entry;
+				entry = *binding;
+			}
+			else if (Entry **live = LiveEntries.find(key))
+			{
+				discard = entry;
+				entry = *live;
+				Bind(Owner, entry);
+			}
+			else
+			{
+				// A failed write only loses the record. The next scan stops at it.
+				if (!record.empty() && PackFile != INVALID_HANDLE_VALUE && WriteAt(PackLength, record.data(), record.size()))
+				{
+					PackRecords.insert_or_assign(key, PackLength);
+					PackLength += record.size();
+				}
+
+				LiveEntries.insert(key, entry);
+				Bind(Owner, entry);
+			}
+
+			entry->RefCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		ReleaseSRWLockExclusive(&CacheLock);
+
+		delete discard;
+		return entry;
+	}
+
+	void Release(Entry *Ref)
+	{
+		uint32_t count = Ref->RefCount.load(std::memory_order_relaxed);
+
+		while (count > 1)
+		{
+			if (Ref->RefCount.compare_exchange_weak(count, count - 1, std::memory_order_release, std::memory_order_relaxed))
+				return;
+		}
+
+		// Possibly the last reference
+		AcquireSRWLockExclusive(&CacheLock);
+		{
+			if (Ref->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				LiveEntries.erase(Ref->Key);
+			else
+				Ref = nullptr;
+		}
+		ReleaseSRWLockExclusive(&CacheLock);
+
+		delete Ref;
+	}
+
+	void Remove(const void *Owner)
+	{
+		Entry *entry = nullptr;
+
+		AcquireSRWLockExclusive(&CacheLock);
+		{
+			if (Bindings.get((uintptr_t)Owner, entry))
+				Bindings.erase((uintptr_t)Owner);
+		}
+		ReleaseSRWLockExclusive(&CacheLock);
+
+		if (entry)
+			Release(entry);
+	}
+}
\ No newline at end of file
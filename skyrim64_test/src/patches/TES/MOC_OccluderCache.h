@@ -0,0 +1,186 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <meshoptimizer/src/meshoptimizer.h>
+
+namespace XUtil
+{
+	uint64_t MurmurHash64A(const void *Key, size_t Len, uint64_t Seed);
+}
+
+//
+// Content addressed cache for MOC-ready occluder meshes. Building one widens the 16-bit indices,
+// simplifies anything above SimplifyMinIndices indices, and stores the used vertices as
+// (X, Y, 1, Z). The result only depends on the source index and vertex data, so that's what the
+// key covers.
+//
+// Records go to an append-only pack file that is memory mapped on startup, the same way as the
+// shader cache. A cell only pays for simplification on its first visit. Records are checked when
+// they're loaded, not when the pack is opened, and one that fails is rebuilt.
+//
+// Game geometry is bound to a refcounted entry. Acquire() hands out a reference that stays valid
+// until Release(), even if the geometry is freed and Remove() drops the binding in the meantime.
+// Geometry with identical content shares one entry. An entry is freed with its last reference,
+// and its record stays in the pack.
+//
+// Only Acquire(), Release() and Remove() need Win32. The rest of this header is portable.
+//
+namespace MOC::OccluderCache
+{
+	const static uint32_t PackMagic				= 'COKS';
+	const static uint32_t PackVersion			= 1;		// Bump when Build() output changes
+	const static uint32_t SimplifyMinIndices	= 300;
+
+	struct SourceMesh
+	{
+		const uint16_t *Indices;
+		uint32_t IndexCount;
+		const void *Vertices;		// Position is the first three floats of each vertex
+		uint32_t VertexCount;
+		uint32_t VertexStride;
+	};
+
+	struct PackHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+	};
+
+	struct RecordHeader
+	{
+		uint64_t Key;
+		uint32_t VertexCount;		// Followed by VertexCount (X, Y, 1, Z) vertices
+		uint32_t IndexCount;		// and then IndexCount 32-bit indices
+		uint32_t Checksum;			// Low half of the payload hash, seeded with the key
+		uint32_t Reserved;
+	};
+
+	struct Entry
+	{
+		uint64_t Key;
+		const float *Vertices;
+		const uint32_t *Indices;
+		uint32_t VertexCount;
+		uint32_t IndexCount;
+		std::atomic_uint32_t RefCount;
+		std::unique_ptr<uint8_t[]> Storage;		// Null when the record is inside the mapped pack
+	};
+
+	Entry *Acquire(const void *Owner, const SourceMesh& Mesh);
+	void Release(Entry *Ref);
+	void Remove(const void *Owner);
+
+	inline uint64_t AlignRecord(uint64_t Size)
+	{
+		return (Size + 7) & ~7ull;
+	}
+
+	inline uint64_t GetPayloadSize(uint32_t VertexCount, uint32_t IndexCount)
+	{
+		return (uint64_t)VertexCount * (4 * sizeof(float)) + (uint64_t)IndexCount * sizeof(uint32_t);
+	}
+
+	inline uint64_t GetRecordSize(const RecordHeader *Record)
+	{
+		return AlignRecord(sizeof(RecordHeader) + GetPayloadSize(Record->VertexCount, Record->IndexCount));
+	}
+
+	inline uint32_t GetChecksum(const RecordHeader *Record)
+	{
+		return (uint32_t)XUtil::MurmurHash64A(Record + 1, GetPayloadSize(Record->VertexCount, Record->IndexCount), Record->Key);
+	}
+
+	inline uint64_t GetKey(const SourceMesh& Mesh)
+	{
+		uint64_t hash = XUtil::MurmurHash64A(Mesh.Indices, Mesh.IndexCount * sizeof(uint16_t), PackVersion);
+		hash = XUtil::MurmurHash64A(Mesh.Vertices, (size_t)Mesh.VertexCount * Mesh.VertexStride, hash);
+		hash = XUtil::MurmurHash64A(&Mesh.VertexStride, sizeof(Mesh.VertexStride), hash);
+
+		return hash;
+	}
+
+	// Points Out at a record's data. The record must stay alive as long as Out does.
+	inline void GetRecordData(const RecordHeader *Record, Entry *Out)
+	{
+		Out->Key = Record->Key;
+		Out->Vertices = (const float *)(Record + 1);
+		Out->Indices = (const uint32_t *)(Out->Vertices + Record->VertexCount * 4);
+		Out->VertexCount = Record->VertexCount;
+		Out->IndexCount = Record->IndexCount;
+	}
+
+	// Converts Mesh into a complete record: header, payload and padding
+	inline void Build(uint64_t Key, const SourceMesh& Mesh, std::vector<uint8_t>& Record)
+	{
+		std::vector<uint32_t> indices(Mesh.Indices, Mesh.Indices + Mesh.IndexCount);
+		size_t indexCount = Mesh.IndexCount;
+
+		if (indexCount > SimplifyMinIndices)
+			indexCount = meshopt_simplify(indices.data(), indices.data(), indexCount, (const float *)Mesh.Vertices, Mesh.VertexCount, Mesh.VertexStride, (size_t)(Mesh.IndexCount * .50f), 1e-3f);// Target 50% of original triangles
+
+		//
+		// X -> X
+		// Y -> Y
+		// Z -> 1.0f
+		// W -> Z
+		// Remaining data discarded
+		//
+		std::vector<float> vertices(Mesh.VertexCount * 4);
+		auto in = (const uint8_t *)Mesh.Vertices;
+
+		for (uint32_t i = 0; i < Mesh.VertexCount; i++, in += Mesh.VertexStride)
+		{
+			auto position = (const float *)in;
+
+			vertices[i * 4 + 0] = position[0];
+			vertices[i * 4 + 1] = position[1];
+			vertices[i * 4 + 2] = 1.0f;
+			vertices[i * 4 + 3] = position[2];
+		}
+
+		// Vertices dropped by simplification aren't stored. The rest are reordered by first use.
+		RecordHeader header = {};
+		header.Key = Key;
+		header.IndexCount = (uint32_t)indexCount;
+
+		Record.assign(AlignRecord(sizeof(RecordHeader) + GetPayloadSize(Mesh.VertexCount, header.IndexCount)), 0);
+
+		auto outVertices = (float *)(Record.data() + sizeof(RecordHeader));
+		header.VertexCount = (uint32_t)meshopt_optimizeVertexFetch(outVertices, indices.data(), indexCount, vertices.data(), Mesh.VertexCount, 4 * sizeof(float));
+
+		memcpy(outVertices + header.VertexCount * 4, indices.data(), indexCount * sizeof(uint32_t));
+		Record.resize(GetRecordSize(&header));
+
+		auto record = (RecordHeader *)Record.data();
+		*record = header;
+		record->Checksum = GetChecksum(record);
+	}
+
+	//
+	// Calls Callback(const RecordHeader *Record, uint64_t Offset) for every record that fits inside
+	// the pack and returns the length of that prefix. Checksums aren't verified here.
+	//
+	template<typename Func>
+	uint64_t Scan(const uint8_t *Data, uint64_t Length, Func&& Callback)
+	{
+		uint64_t offset = sizeof(PackHeader);
+
+		while (offset + sizeof(RecordHeader) <= Length)
+		{
+			auto record = (const RecordHeader *)(Data + offset);
+			uint64_t recordSize = GetRecordSize(record);
+
+			if (recordSize > Length - offset)
+				break;
+
+			Callback(record, offset);
+			offset += recordSize;
+		}
+
+		return offset;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+//
+// Picks which registered geometry gets rasterized as an occluder. Each candidate is scored by how
+// much of the screen its bounding sphere covers per triangle it costs, and the best ones are taken
+// until the frame's triangle budget runs out. Last frame's picks get a bonus so the set doesn't
+// flip between near equal candidates every frame, and their occluders are still in the cache.
+//
+// Only the winners are ever sorted. Each chunk of the next best candidates is split off the rest
+// with nth_element.
+//
+// Nothing here depends on the game, so recorded candidate lists can be replayed outside of it.
+//
+namespace MOC::OccluderSelect
+{
+	const static uint32_t RecordingMagic = 'OCSR';
+	const static uint32_t ChunkSize = 64;
+	const static float TriangleOverhead = 32.0f;	// Fixed cost of setting up any object, in triangles
+
+	struct Candidate
+	{
+		void *Object;				// Only compared, never dereferenced
+		float DistanceSquared;		// Bound center to camera
+		float Radius;
+		uint32_t TriangleCount;
+		float Score;				// Filled in by Select()
+	};
+
+	struct Settings
+	{
+		float ProjScaleX;			// Projection _11 and _22
+		float ProjScaleY;
+		uint32_t TriangleBudget;
+		float ReuseBonus;			// Score multiplier for last frame's picks
+	};
+
+	// Recordings are a series of frames, each one of these followed by Count candidates
+	struct RecordingHeader
+	{
+		uint32_t Magic;
+		uint32_t Count;
+		Settings FrameSettings;
+	};
+
+	inline float GetScreenCoverage(const Candidate& C, const Settings& S)
+	{
+		// Projected sphere area over the NDC square's area. Full screen once the camera is inside it.
+		if (C.DistanceSquared <= C.Radius * C.Radius)
+			return 1.0f;
+
+		float coverage = 0.785398f * C.Radius * C.Radius * S.ProjScaleX * S.ProjScaleY / C.DistanceSquared;
+		return std::min(coverage, 1.0f);
+	}
+
+	inline float GetScore(const Candidate& C, const Settings& S)
+	{
+		return GetScreenCoverage(C, S) / ((float)C.TriangleCount + TriangleOverhead);
+	}
+
+	class Selector
+	{
+	private:
+		std::vector<void *> m_LastSelected;		// Sorted
+		uint32_t m_LastTriangleCount = 0;
+
+	public:
+		//
+		// Moves the selected candidates to the front of the list, sorted front to back, and returns
+		// how many there are. Selection stops at the first candidate that doesn't fit the budget so
+		// the picks stay in one block.
+		//
+		uint32_t Select(std::vector<Candidate>& Candidates, const Settings& S)
+		{
+			for (Candidate& c : Candidates)
+			{
+				c.Score = GetScore(c, S);
+
+				if (std::binary_search(m_LastSelected.begin(), m_LastSelected.end(), c.Object))
+					c.Score *= S.ReuseBonus;
+			}
+
+			auto byScore = [](const Candidate& A, const Candidate& B)
+			{
+				return A.Score > B.Score;
+			};
+
+			uint32_t selectedCount = 0;
+			uint32_t triangleCount = 0;
+			bool budgetReached = false;
+
+			for (size_t chunkStart = 0; chunkStart < Candidates.size() && !budgetReached; chunkStart += ChunkSize)
+			{
+				auto chunkBegin = Candidates.begin() + chunkStart;
+				auto chunkEnd = Candidates.begin() + std::min<size_t>(chunkStart + ChunkSize, Candidates.size());
+
+				if (chunkEnd != Candidates.end())
+					std::nth_element(chunkBegin, chunkEnd, Candidates.end(), byScore);
+
+				std::sort(chunkBegin, chunkEnd, byScore);
+
+				for (auto itr = chunkBegin; itr != chunkEnd; itr++)
+				{
+					if (triangleCount + itr->TriangleCount > S.TriangleBudget)
+					{
+						budgetReached = true;
+						break;
+					}
+
+					triangleCount += itr->TriangleCount;
+					selectedCount++;
+				}
+			}
+
+			// Front to back (approx)
+			std::sort(Candidates.begin(), Candidates.begin() + selectedCount,
+			[](const Candidate& A, const Candidate& B)
+			{
+				return A.DistanceSquared < B.DistanceSquared;
+			});
+
+			m_LastSelected.clear();
+
+			for (uint32_t i = 0; i < selectedCount; i++)
+				m_LastSelected.push_back(Candidates[i].Object);
+
+			std::sort(m_LastSelected.begin(), m_LastSelected.end());
+			m_LastTriangleCount = triangleCount;
+
+			return selectedCount;
+		}
+
+		uint32_t GetLastTriangleCount() const
+		{
+			return m_LastTriangleCount;
+		}
+	};
+}
\ No newline at end of file
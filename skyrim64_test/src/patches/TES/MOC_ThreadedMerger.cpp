@@ -2,86 +2,74 @@
 #include "../../common.h"
 #include "MOC_ThreadedMerger.h"
 
-MOC_ThreadedMerger::MOC_ThreadedMerger(uint32_t Width, uint32_t Height, uint32_t Threads, bool EnableCPUConservation)
+MOC_ThreadedMerger::MOC_ThreadedMerger(uint32_t Width, uint32_t Height, uint32_t Threads)
 {
 	m_RenderWidth = Width;
 	m_RenderHeight = Height;
 	m_ThreadCount = Threads;
 
-	if (EnableCPUConservation)
-		m_EarlySignalEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
-	else
-		m_EarlySignalEvent = nullptr;
-
-	m_EarlySignalStack.store(0);
-
 	m_TraverseSceneCallback = nullptr;
 	m_RenderGeometryCallback = nullptr;
 
-	m_MOCInstances.resize(Threads);
-	m_ThreadInitialized = std::vector<std::atomic_bool>(m_ThreadCount);
-	m_ThreadWorking = std::vector<std::atomic_bool>(m_ThreadCount);
+	m_MOC = MaskedOcclusionCulling::Create();
+	m_MOC->SetResolution(m_RenderWidth, m_RenderHeight);
+	m_MOC->ClearBuffer();
 
-	for (uint32_t i = 0; i < m_ThreadCount; i++)
-	{
-		std::thread cullThread(&MOC_ThreadedMerger::CullThread, this, i);
-		cullThread.detach();
-	}
+	// 4 bins per thread so that threads finishing early have something to steal. Bins stay at least
+	// 88 pixels tall at 720p.
+	m_BinQueue = new MOC_BinQueue(m_MOC, 4, std::clamp<uint32_t>(Threads, 4, 8));
+
+	m_PendingPacketCount.store(0);
+	m_LastFlushStats = {};
+
+	Start(m_ThreadCount);
 }
 
 MOC_ThreadedMerger::~MOC_ThreadedMerger()
 {
-	for (uint32_t i = 0; i < m_ThreadCount; i++)
-	{
-		CullPacket p;
-		p.UserData = nullptr;
-		p.Type = CULL_TERMINATE_THREAD;
-
-		m_PendingPackets.push(p);
-	}
-	
-	CloseHandle(m_EarlySignalEvent);
+	// Joins every worker. Nothing can be freed before that.
+	Stop();
 
-	// Each thread will free remaining MaskedOcclusionCulling pointers. They will also exit before
-	// setting ThreadWorking to false.
-	for (uint32_t i = 0; i < m_ThreadCount; i++)
-	{
-		while (m_ThreadWorking[i].load())
-			_mm_pause();
-	}
+	delete m_BinQueue;
+	MaskedOcclusionCulling::Destroy(m_MOC);
 }
 
-void MOC_ThreadedMerger::SetTraverseSceneCallback(void(*Callback)(MaskedOcclusionCulling *MOC, void *UserData))
+void MOC_ThreadedMerger::SetTraverseSceneCallback(void(*Callback)(MOC_ThreadedMerger *Merger, void *UserData))
 {
 	InterlockedExchangePointer((volatile PVOID *)&m_TraverseSceneCallback, Callback);
 }
 
-void MOC_ThreadedMerger::SetRenderGeometryCallback(void(*Callback)(MaskedOcclusionCulling *MOC, void *UserData))
+void MOC_ThreadedMerger::SetRenderGeometryCallback(void(*Callback)(MOC_ThreadedMerger *Merger, void *UserData))
 {
 	InterlockedExchangePointer((volatile PVOID *)&m_RenderGeometryCallback, Callback);
 }
 
 void MOC_ThreadedMerger::Flush()
 {
-	NotifyPreWork();
+	// Pending packets can still bin more triangles. The caller rasterizes whatever bins the workers
+	// aren't busy with and sleeps once there's nothing left it can take.
+	WaitForCompletion();
 
-	CullPacket p;
-	p.UserData = nullptr;
-	p.Type = CULL_FLUSH;
-
-	m_FinalBuffer.store(nullptr);
-	m_PendingPackets.push(p);
+	MOC_WorkerPool::Stats stats;
+	GetStats(&stats);
 
-	while (!m_FinalBuffer.load())
-		_mm_pause();
+	ProfileCounterAdd("MOC WorkerWakeups", stats.Wakeups - m_LastFlushStats.Wakeups);
+	ProfileCounterAdd("MOC PacketsStarted", stats.LatencyCount - m_LastFlushStats.LatencyCount);
+	ProfileCounterAdd("MOC PacketLatencyNs", stats.LatencyTotal - m_LastFlushStats.LatencyTotal);
 
-	ClearPreWorkNotify();
+	m_LastFlushStats = stats;
 }
 
 void MOC_ThreadedMerger::Clear()
 {
-	for (uint32_t i = 0; i < m_ThreadCount; i++)
-		m_MOCInstances[i]->ClearBuffer();
+	// Anything left over from a frame that was never flushed must not land in the cleared buffer
+	while (!m_BinQueue->IsIdle())
+	{
+		if (!m_BinQueue->RenderAnyBin())
+			_mm_pause();
+	}
+
+	m_MOC->ClearBuffer();
 }
 
 void MOC_ThreadedMerger::UpdateDepthViewTexture(ID3D11DeviceContext *Context, ID3D11Texture2D *Texture)
@@ -146,100 +134,55 @@ void MOC_ThreadedMerger::DepthColorize(const float *FloatData, uint8_t *OutColor
 	}
 }
 
-void MOC_ThreadedMerger::CullThread(uint32_t ThreadIndex)
+void MOC_ThreadedMerger::OnWorkerStart(uint32_t ThreadIndex)
 {
 	XUtil::SetThreadName(GetCurrentThreadId(), "MOC_ThreadedMerger Worker");
+}
+
+bool MOC_ThreadedMerger::DoWork(uint32_t ThreadIndex)
+{
+	// The thread waiting in Flush() only rasterizes. A packet could hold it up for too long.
+	if (ThreadIndex == CallerThread)
+		return m_BinQueue->RenderAnyBin();
 
-	MaskedOcclusionCulling *moc = MaskedOcclusionCulling::Create();
-	moc->SetResolution(m_RenderWidth, m_RenderHeight);
-	moc->ClearBuffer();
+	// Rasterizing comes first. A binned job holds its ring slot until every bin is done with it. Each
+	// thread owns a contiguous range of bins and only takes other bins when it has nothing else to do.
+	uint32_t firstBin;
+	uint32_t lastBin;
+	m_BinQueue->GetBinRange(ThreadIndex, m_ThreadCount, &firstBin, &lastBin);
 
-	m_MOCInstances[ThreadIndex] = moc;
-	m_ThreadWorking[ThreadIndex].store(false);
-	m_ThreadInitialized[ThreadIndex].store(true);
+	if (m_BinQueue->RenderBinRange(firstBin, lastBin))
+		return true;
 
 	CullPacket p;
-	int idleCount = 0;
 
-	while (true)
+	if (!m_PendingPackets.try_pop(p))
+		return m_BinQueue->RenderAnyBin();
+
+	RecordLatency(p.SubmitTime);
+
+	switch (p.Type)
+	{
+	case CULL_TRAVERSE_SCENE:
+	{
+		if (m_TraverseSceneCallback)
+			m_TraverseSceneCallback(this, p.UserData);
+	}
+	break;
+
+	case CULL_RENDER_GEOMETRY:
 	{
-		if (!m_PendingPackets.try_pop(p))
-		{
-			// Range from a few nanoseconds to 1-2 milliseconds
-			if (idleCount <= 5)
-				_mm_pause();
-			else if (idleCount <= 100)
-				std::this_thread::yield();
-			else if (m_EarlySignalEvent)
-				WaitForSingleObject(m_EarlySignalEvent, 1);
-
-			idleCount++;
-			continue;
-		}
-
-		// Now doing some kind of operation
-		m_ThreadWorking[ThreadIndex].store(true);
-		idleCount = 0;
-
-	__fastloop:
-		switch (p.Type)
-		{
-		case CULL_TRAVERSE_SCENE:
-		{
-			if (m_TraverseSceneCallback)
-				m_TraverseSceneCallback(moc, p.UserData);
-		}
-		break;
-
-		case CULL_RENDER_GEOMETRY:
-		{
-			if (m_RenderGeometryCallback)
-				m_RenderGeometryCallback(moc, p.UserData);
-		}
-		break;
-
-		case CULL_FLUSH:
-		{
-			// Merge the buffer from every other thread into this one
-			while (true)
-			{
-				uint32_t threadsMerged = 1;
-
-				for (uint32_t i = 0; i < m_ThreadCount; i++)
-				{
-					if (i == ThreadIndex)
-						continue;
-
-					if (m_ThreadWorking[i].load())
-						continue;
-
-					moc->MergeBuffer(m_MOCInstances[i]);
-					threadsMerged++;
-				}
-
-				if (threadsMerged == m_ThreadCount)
-					break;
-			}
-
-			// Notify whoever was waiting for this
-			m_FinalBuffer.store(moc);
-		}
-		break;
-
-		case CULL_TERMINATE_THREAD:
-		{
-			// !!!!!!!!!!!!!!!!!!!!!!!!!!!
-			// !!!! THREAD EXITS HERE !!!!
-			// !!!!!!!!!!!!!!!!!!!!!!!!!!!
-			MaskedOcclusionCulling::Destroy(moc);
-			return;
-		}
-		break;
-		}
-
-		if (m_PendingPackets.try_pop(p))
-			goto __fastloop;
-
-		m_ThreadWorking[ThreadIndex].store(false);
+		if (m_RenderGeometryCallback)
+			m_RenderGeometryCallback(this, p.UserData);
+	}
+	break;
 	}
+
+	m_PendingPacketCount--;
+	return true;
+}
+
+bool MOC_ThreadedMerger::IsWorkComplete()
+{
+	return m_PendingPacketCount.load() == 0 && m_BinQueue->IsIdle();
 }
\ No newline at end of file
@@ -4,46 +4,44 @@
 #include <tbb/concurrent_queue.h>
 #include <MaskedOcclusionCulling/MaskedOcclusionCulling.h>
 #include "../../common.h"
+#include "MOC_BinQueue.h"
+#include "MOC_WorkerPool.h"
 
-class MOC_ThreadedMerger
+class MOC_ThreadedMerger : public MOC_WorkerPool
 {
 private:
 	enum CullType
 	{
 		CULL_TRAVERSE_SCENE,
 		CULL_RENDER_GEOMETRY,
-		CULL_FLUSH,
-		CULL_TERMINATE_THREAD,
 	};
 
 	struct CullPacket
 	{
 		CullType Type;
 		void *UserData;
+		uint64_t SubmitTime;
 	};
 
 	uint32_t m_RenderWidth;
 	uint32_t m_RenderHeight;
 	uint32_t m_ThreadCount;
-	HANDLE m_EarlySignalEvent;
-	std::atomic_uint m_EarlySignalStack;
 
-	void (*m_TraverseSceneCallback)(MaskedOcclusionCulling *MOC, void *UserData);
-	void (*m_RenderGeometryCallback)(MaskedOcclusionCulling *MOC, void *UserData);
+	void (*m_TraverseSceneCallback)(MOC_ThreadedMerger *Merger, void *UserData);
+	void (*m_RenderGeometryCallback)(MOC_ThreadedMerger *Merger, void *UserData);
 
-	std::vector<MaskedOcclusionCulling *> m_MOCInstances;	// Each thread has a MaskedOcclusionCulling instance
-	std::vector<std::atomic_bool> m_ThreadInitialized;		// True if thread is ready
-	std::vector<std::atomic_bool> m_ThreadWorking;			// True is thread is processing something
+	MaskedOcclusionCulling *m_MOC;							// Scene depth buffer shared by every thread
+	MOC_BinQueue *m_BinQueue;								// Binned triangles waiting to be rasterized into m_MOC
+	std::atomic_uint m_PendingPacketCount;					// Packets submitted but not finished yet
 	tbb::concurrent_queue<CullPacket> m_PendingPackets;		// Queue of packets that each thread accesses
-
-	std::atomic<MaskedOcclusionCulling *> m_FinalBuffer;	// Final scene depth buffer after calling Flush()
+	MOC_WorkerPool::Stats m_LastFlushStats;
 
 public:
-	MOC_ThreadedMerger(uint32_t Width, uint32_t Height, uint32_t Threads = 1, bool EnableCPUConservation = true);
+	MOC_ThreadedMerger(uint32_t Width, uint32_t Height, uint32_t Threads = 1);
 	~MOC_ThreadedMerger();
 
-	void SetTraverseSceneCallback(void(*Callback)(MaskedOcclusionCulling *MOC, void *UserData));
-	void SetRenderGeometryCallback(void(*Callback)(MaskedOcclusionCulling *MOC, void *UserData));
+	void SetTraverseSceneCallback(void(*Callback)(MOC_ThreadedMerger *Merger, void *UserData));
+	void SetRenderGeometryCallback(void(*Callback)(MOC_ThreadedMerger *Merger, void *UserData));
 
 	void Flush();
 	void Clear();
@@ -51,43 +49,46 @@ public:
 
 	__forceinline void SubmitSceneRender(void *UserData)
 	{
-		CullPacket p;
-		p.UserData = UserData;
-		p.Type = CULL_TRAVERSE_SCENE;
-
-		m_PendingPackets.push(p);
+		SubmitPacket(CULL_TRAVERSE_SCENE, UserData);
 	}
 
 	__forceinline void SubmitGeometry(void *UserData)
 	{
-		CullPacket p;
-		p.UserData = UserData;
-		p.Type = CULL_RENDER_GEOMETRY;
-
-		m_PendingPackets.push(p);
+		SubmitPacket(CULL_RENDER_GEOMETRY, UserData);
 	}
 
-	__forceinline MaskedOcclusionCulling *GetMOC()
+	// Thread-safe. Bins the triangles right away on the calling thread, so the vertex and index data
+	// only have to stay valid until this returns.
+	__forceinline void RenderTriangles(const float *Vertices, const uint32_t *Triangles, int TriangleCount, const float *ModelToClipMatrix,
+		MaskedOcclusionCulling::BackfaceWinding Winding, MaskedOcclusionCulling::ClipPlanes ClipPlaneMask)
 	{
-		return m_FinalBuffer.load();
+		m_BinQueue->RenderTriangles(Vertices, Triangles, TriangleCount, ModelToClipMatrix, Winding, ClipPlaneMask);
+		NotifyWork();
 	}
 
-	__forceinline void NotifyPreWork()
+	// Only complete after Flush()
+	__forceinline MaskedOcclusionCulling *GetMOC()
 	{
-		if (m_EarlySignalEvent)
-		{
-			SetEvent(m_EarlySignalEvent);
-			m_EarlySignalStack++;
-		}
+		return m_MOC;
 	}
 
-	__forceinline void ClearPreWorkNotify()
+protected:
+	bool DoWork(uint32_t ThreadIndex) override;
+	bool IsWorkComplete() override;
+	void OnWorkerStart(uint32_t ThreadIndex) override;
+
+private:
+	__forceinline void SubmitPacket(CullType Type, void *UserData)
 	{
-		if (m_EarlySignalEvent && --m_EarlySignalStack == 0)
-			ResetEvent(m_EarlySignalEvent);
+		CullPacket p;
+		p.Type = Type;
+		p.UserData = UserData;
+		p.SubmitTime = MOC_WorkerPool::Now();
+
+		m_PendingPacketCount++;
+		m_PendingPackets.push(p);
+		NotifyWork();
 	}
 
-private:
 	void DepthColorize(const float *FloatData, uint8_t *OutColorArray);
-	void CullThread(uint32_t ThreadIndex);
 };
\ No newline at end of file
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <immintrin.h>
+
+//
+// Worker threads for occlusion work. The pool handles only parking, wakeups, waiting for completion
+// and shutdown. The owner decides what work is by overriding DoWork() and IsWorkComplete().
+//
+// A worker calls DoWork() until it returns false, spins for SpinRounds more attempts and then parks on
+// a condition variable. NotifyWork() bumps an epoch and only takes the lock when somebody is parked.
+// Parking and notifying both go through seq_cst operations on the epoch and the parked count, so
+// either the worker sees the new epoch or the notifier sees the worker. A wakeup can't be lost.
+//
+// WaitForCompletion() works the same way for the thread that waits on the owner's results. It helps
+// through DoWork(CallerThread), spins, then parks until a worker that runs out of work finds
+// IsWorkComplete() true. Idle frames cost nothing once every thread is parked.
+//
+// Start() and Stop() must be called by the owner, so that threads never see a half-constructed or
+// half-destroyed owner. Stop() joins every thread.
+//
+class MOC_WorkerPool
+{
+public:
+	const static uint32_t SpinRounds = 1000;			// Failed DoWork() attempts before parking
+	const static uint32_t CallerThread = UINT32_MAX;	// ThreadIndex passed to DoWork() from WaitForCompletion()
+
+	struct Stats
+	{
+		uint64_t Wakeups;			// Parked workers that were woken
+		uint64_t Parks;
+		uint64_t LatencyCount;		// Work items passed to RecordLatency()
+		uint64_t LatencyTotal;		// Nanoseconds
+		uint64_t LatencyMax;		// Nanoseconds
+	};
+
+private:
+	std::vector<std::thread> m_Threads;
+
+	alignas(64) std::atomic_uint32_t m_WorkEpoch;
+	std::atomic_uint32_t m_ParkedCount;
+	std::atomic_uint32_t m_CompletionWaiters;
+	std::atomic_bool m_Stopping;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkCondition;
+	std::condition_variable m_CompletionCondition;
+
+	alignas(64) std::atomic_uint64_t m_Wakeups;
+	std::atomic_uint64_t m_Parks;
+	std::atomic_uint64_t m_LatencyCount;
+	std::atomic_uint64_t m_LatencyTotal;
+	std::atomic_uint64_t m_LatencyMax;
+
+public:
+	MOC_WorkerPool()
+	{
+		m_WorkEpoch.store(0);
+		m_ParkedCount.store(0);
+		m_CompletionWaiters.store(0);
+		m_Stopping.store(false);
+
+		m_Wakeups.store(0);
+		m_Parks.store(0);
+		m_LatencyCount.store(0);
+		m_LatencyTotal.store(0);
+		m_LatencyMax.store(0);
+	}
+
+	virtual ~MOC_WorkerPool()
+	{
+	}
+
+	MOC_WorkerPool(const MOC_WorkerPool&) = delete;
+	MOC_WorkerPool& operator=(const MOC_WorkerPool&) = delete;
+
+	static uint64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void Start(uint32_t ThreadCount)
+	{
+		for (uint32_t i = 0; i < ThreadCount; i++)
+			m_Threads.emplace_back(&MOC_WorkerPool::WorkerThread, this, i);
+	}
+
+	// Workers finish the DoWork() call they're in and exit. Work still queued is dropped.
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stopping.store(true);
+		}
+
+		m_WorkCondition.notify_all();
+		m_CompletionCondition.notify_all();
+
+		for (std::thread& thread : m_Threads)
+			thread.join();
+
+		m_Threads.clear();
+	}
+
+	uint32_t GetThreadCount() const
+	{
+		return (uint32_t)m_Threads.size();
+	}
+
+	// Call after making new work visible to DoWork()
+	void NotifyWork()
+	{
+		m_WorkEpoch.fetch_add(1);
+
+		if (m_ParkedCount.load() > 0)
+		{
+			// Taking the lock orders this with a worker that is between checking the epoch and sleeping
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_WorkCondition.notify_one();
+		}
+	}
+
+	// Returns once IsWorkComplete() is true. The calling thread helps through DoWork(CallerThread).
+	void WaitForCompletion()
+	{
+		uint32_t spins = 0;
+
+		while (!IsWorkComplete())
+		{
+			if (DoWork(CallerThread))
+			{
+				spins = 0;
+				continue;
+			}
+
+			if (spins++ < SpinRounds)
+			{
+				_mm_pause();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_Mutex);
+
+			m_CompletionWaiters.fetch_add(1);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			m_CompletionCondition.wait(lock, [this] { return m_Stopping.load() || IsWorkComplete(); });
+			m_CompletionWaiters.fetch_sub(1);
+			break;
+		}
+	}
+
+	void RecordLatency(uint64_t SubmitTime)
+	{
+		uint64_t latency = Now() - SubmitTime;
+		uint64_t max = m_LatencyMax.load(std::memory_order_relaxed);
+
+		m_LatencyCount.fetch_add(1, std::memory_order_relaxed);
+		m_LatencyTotal.fetch_add(latency, std::memory_order_relaxed);
+
+		while (latency > max && !m_LatencyMax.compare_exchange_weak(max, latency, std::memory_order_relaxed))
+			;
+	}
+
+	void GetStats(Stats *Out) const
+	{
+		Out->Wakeups = m_Wakeups.load(std::memory_order_relaxed);
+		Out->Parks = m_Parks.load(std::memory_order_relaxed);
+		Out->LatencyCount = m_LatencyCount.load(std::memory_order_relaxed);
+		Out->LatencyTotal = m_LatencyTotal.load(std::memory_order_relaxed);
+		Out->LatencyMax = m_LatencyMax.load(std::memory_order_relaxed);
+	}
+
+protected:
+	// Does one unit of work and returns true, or returns false if there was nothing to do
+	virtual bool DoWork(uint32_t ThreadIndex) = 0;
+	virtual bool IsWorkComplete() = 0;
+	virtual void OnWorkerStart(uint32_t ThreadIndex)
+	{
+	}
+
+private:
+	void NotifyIfComplete()
+	{
+		// Pairs with the seq_cst increment in WaitForCompletion(): either the waiter sees the finished
+		// work or this sees the waiter
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (m_CompletionWaiters.load() > 0 && IsWorkComplete())
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_CompletionCondition.notify_all();
+		}
+	}
+
+	void WorkerThread(uint32_t ThreadIndex)
+	{
+		OnWorkerStart(ThreadIndex);
+
+		uint32_t spins = 0;
+
+		while (!m_Stopping.load(std::memory_order_relaxed))
+		{
+			if (DoWork(ThreadIndex))
+			{
+				spins = 0;
+				continue;
+			}
+
+			// Ran out of work: this might have been the last item somebody is waiting for
+			if (spins == 0)
+				NotifyIfComplete();
+
+			if (spins++ < SpinRounds)
+			{
+				_mm_pause();
+				continue;
+			}
+
+			// Read the epoch before the final check. Work published after the check bumps it.
+			uint32_t epoch = m_WorkEpoch.load();
+
+			if (DoWork(ThreadIndex))
+			{
+				spins = 0;
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_Mutex);
+
+			m_ParkedCount.fetch_add(1);
+			m_Parks.fetch_add(1, std::memory_order_relaxed);
+			m_WorkCondition.wait(lock, [&] { return m_Stopping.load() || m_WorkEpoch.load() != epoch; });
+			m_ParkedCount.fetch_sub(1);
+			m_Wakeups.fetch_add(1, std::memory_order_relaxed);
+
+			spins = 0;
+		}
+	}
+};
\ No newline at end of file
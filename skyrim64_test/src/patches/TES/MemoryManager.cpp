@@ -1,5 +1,180 @@
 #include "../../common.h"
+#include <atomic>
 #include "MemoryManager.h"
+#include "SmallBlockHeap.h"
+#include "LargeBlockHeap.h"
+
+//
+// Per-thread bump arenas backing ScrapHeap. Each thread owns one slot of a reserved region and
+// allocates by moving a cursor. The arena is reset in bulk once every block handed out has been
+// returned, so the common alloc/free pattern never touches a free list. The size of each block is
+// stored right in front of it for _msize().
+//
+namespace ScrapArena
+{
+	const static size_t SlotCount			= 128;
+	const static size_t SlotSize			= ScrapHeap::MAX_ALLOC_SIZE;
+	const static size_t MaxArenaAlloc		= 1 * 1024 * 1024;	// Anything larger goes to the general heap
+	const static size_t CommitGranularity	= 1 * 1024 * 1024;
+	const static size_t RetainedCommitSize	= 8 * 1024 * 1024;	// Committed memory kept across resets
+	const static size_t HeaderSize			= sizeof(size_t);
+
+	struct alignas(64) Arena
+	{
+		std::atomic<int64_t> References;	// Live blocks plus one for the owning thread
+		size_t Cursor;
+		size_t Committed;
+	};
+
+	struct ArenaGuard
+	{
+		~ArenaGuard();
+	};
+
+	uintptr_t RegionBase;
+	uintptr_t RegionEnd;
+	Arena Arenas[SlotCount];
+
+	SRWLOCK SlotLock = SRWLOCK_INIT;
+	uint32_t FreeSlots[SlotCount];
+	uint32_t FreeSlotCount;
+
+	thread_local Arena *TLSArena;
+	thread_local bool TLSArenaReleased;
+	thread_local ArenaGuard TLSArenaGuard;
+
+	void Initialize()
+	{
+		void *base = VirtualAlloc(nullptr, SlotCount * SlotSize, MEM_RESERVE, PAGE_NOACCESS);
+
+		if (!base)
+			return;
+
+		for (uint32_t i = 0; i < SlotCount; i++)
+			FreeSlots[i] = SlotCount - i - 1;
+
+		FreeSlotCount = SlotCount;
+		RegionBase = (uintptr_t)base;
+		RegionEnd = RegionBase + (SlotCount * SlotSize);
+	}
+
+	__forceinline bool Owns(const void *Memory)
+	{
+		return (uintptr_t)Memory >= RegionBase && (uintptr_t)Memory < RegionEnd;
+	}
+
+	__forceinline uintptr_t GetArenaBase(const Arena *Entry)
+	{
+		return RegionBase + ((Entry - Arenas) * SlotSize);
+	}
+
+	void Reset(Arena *Entry)
+	{
+		Entry->Cursor = 0;
+
+		if (Entry->Committed > RetainedCommitSize)
+		{
+			VirtualFree((void *)(GetArenaBase(Entry) + RetainedCommitSize), Entry->Committed - RetainedCommitSize, MEM_DECOMMIT);
+			Entry->Committed = RetainedCommitSize;
+		}
+	}
+
+	void ReleaseSlot(Arena *Entry)
+	{
+		Reset(Entry);
+
+		AcquireSRWLockExclusive(&SlotLock);
+		FreeSlots[FreeSlotCount++] = (uint32_t)(Entry - Arenas);
+		ReleaseSRWLockExclusive(&SlotLock);
+	}
+
+	Arena *GetArena()
+	{
+		if (TLSArena || TLSArenaReleased || !RegionBase)
+			return TLSArena;
+
+		Arena *entry = nullptr;
+
+		AcquireSRWLockExclusive(&SlotLock);
+		if (FreeSlotCount > 0)
+			entry = &Arenas[FreeSlots[--FreeSlotCount]];
+		ReleaseSRWLockExclusive(&SlotLock);
+
+		// Out of slots: this thread permanently uses the general heap
+		if (!entry)
+		{
+			TLSArenaReleased = true;
+			return nullptr;
+		}
+
+		entry->References.store(1);
+		(void)&TLSArenaGuard;
+		TLSArena = entry;
+		return entry;
+	}
+
+	ArenaGuard::~ArenaGuard()
+	{
+		Arena *entry = TLSArena;
+
+		TLSArena = nullptr;
+		TLSArenaReleased = true;
+
+		// Blocks still alive on other threads keep the slot until the last one is freed
+		if (entry && entry->References.fetch_sub(1) == 1)
+			ReleaseSlot(entry);
+	}
+
+	void *Allocate(size_t Size, size_t Alignment)
+	{
+		Arena *entry = GetArena();
+
+		if (!entry || Size > MaxArenaAlloc)
+			return nullptr;
+
+		// Only the owner allocates, so seeing nothing but our own reference means nobody else
+		// can be holding a block from this arena
+		if (entry->References.load(std::memory_order_acquire) == 1)
+			Reset(entry);
+
+		Alignment = std::max<size_t>(Alignment, 16);
+		size_t offset = (entry->Cursor + HeaderSize + Alignment - 1) & ~(Alignment - 1);
+
+		if (offset + Size > SlotSize)
+			return nullptr;
+
+		if (offset + Size > entry->Committed)
+		{
+			size_t newCommitted = std::min((offset + Size + CommitGranularity - 1) & ~(CommitGranularity - 1), SlotSize);
+
+			if (!VirtualAlloc((void *)(GetArenaBase(entry) + entry->Committed), newCommitted - entry->Committed, MEM_COMMIT, PAGE_READWRITE))
+				return nullptr;
+
+			entry->Committed = newCommitted;
+		}
+
+		uintptr_t block = GetArenaBase(entry) + offset;
+		*(size_t *)(block - HeaderSize) = Size;
+
+		entry->Cursor = offset + Size;
+		entry->References.fetch_add(1, std::memory_order_relaxed);
+
+		return (void *)block;
+	}
+
+	void Free(void *Memory)
+	{
+		Arena *entry = &Arenas[((uintptr_t)Memory - RegionBase) / SlotSize];
+
+		if (entry->References.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			ReleaseSlot(entry);
+	}
+
+	size_t Size(void *Memory)
+	{
+		return *(const size_t *)((uintptr_t)Memory - HeaderSize);
+	}
+}
 
 void *MemAlloc(size_t Size, size_t Alignment = 0, bool Aligned = false, bool Zeroed = false)
 {
@@ -42,7 +217,15 @@ void *MemAlloc(size_t Size, size_t Alignment = 0, bool Aligned = false, bool Zer
 #if SKYRIM64_USE_PAGE_HEAP
 	void *ptr = VirtualAlloc(nullptr, Size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
 #else
-	void *ptr = scalable_aligned_malloc(Size, Alignment);
+	void *ptr = nullptr;
+
+#if SKYRIM64_USE_SMALLBLOCK_HEAP
+	if (Size <= SmallBlockHeap::MaxBlockSize && Alignment <= SmallBlockHeap::BlockGranularity)
+		ptr = SmallBlockHeap::Allocate(Size);
+
+	if (!ptr)
+#endif
+		ptr = scalable_aligned_malloc(Size, Alignment);
 
 	if (ptr && Zeroed)
 		memset(ptr, 0, Size);
@@ -73,7 +256,17 @@ void MemFree(void *Memory, bool Aligned = false)
 #if SKYRIM64_USE_PAGE_HEAP
 	VirtualFree(Memory, 0, MEM_RELEASE);
 #else
-	scalable_aligned_free(Memory);
+#if SKYRIM64_USE_SMALLBLOCK_HEAP
+	if (SmallBlockHeap::Owns(Memory))
+		SmallBlockHeap::Free(Memory);
+	else if (ScrapArena::Owns(Memory))
+		ScrapArena::Free(Memory);
+	else
+#endif
+	if (LargeBlockHeap::Owns(Memory))
+		LargeBlockHeap::Free(Memory);
+	else
+		scalable_aligned_free(Memory);
 #endif
 
 #if SKYRIM64_USE_VTUNE
@@ -93,7 +286,19 @@ size_t MemSize(void *Memory)
 
 	size_t result = info.RegionSize;
 #else
-	size_t result = scalable_msize(Memory);
+	size_t result;
+
+#if SKYRIM64_USE_SMALLBLOCK_HEAP
+	if (SmallBlockHeap::Owns(Memory))
+		result = SmallBlockHeap::BlockSize(Memory);
+	else if (ScrapArena::Owns(Memory))
+		result = ScrapArena::Size(Memory);
+	else
+#endif
+	if (LargeBlockHeap::Owns(Memory))
+		result = LargeBlockHeap::BlockSize(Memory);
+	else
+		result = scalable_msize(Memory);
 #endif
 
 #if SKYRIM64_USE_VTUNE
@@ -124,15 +329,63 @@ void *hk_aligned_malloc(size_t Size, size_t Alignment)
 
 void *hk_realloc(void *Memory, size_t Size)
 {
+	if (Size <= 0)
+	{
+		MemFree(Memory);
+		return nullptr;
+	}
+
+	// Recalloc behaves like calloc if there's no existing allocation. Realloc doesn't. Zero it either way.
+	if (!Memory)
+		return MemAlloc(Size, 0, false, true);
+
+	size_t oldSize = MemSize(Memory);
+
+#if !SKYRIM64_USE_PAGE_HEAP
+	// Fits in the slack of the existing block (size class, tbbmalloc bin, arena block or committed pages).
+	// _msize() keeps reporting the old size, so the bytes dropped by a shrink are zeroed. Otherwise a
+	// _recalloc growing back into them would return stale data instead of zeros. Larger shrinks move
+	// rather than clear that much.
+	const size_t maxShrinkClear = 64 * 1024;
+
+	if (Size <= oldSize && (oldSize - Size) <= maxShrinkClear)
+	{
+		memset((uint8_t *)Memory + Size, 0, oldSize - Size);
+
+		ProfileCounterInc("Realloc In Place");
+		return Memory;
+	}
+
+	// Commit more pages behind the block. The OS hands them back zeroed.
+	if (LargeBlockHeap::Owns(Memory) && LargeBlockHeap::TryResize(Memory, Size))
+	{
+		ProfileCounterInc("Realloc In Place");
+		return Memory;
+	}
+#endif
+
+	size_t copySize = std::min(Size, oldSize);
 	void *newMemory = nullptr;
 
-	if (Size > 0)
+	// Anything this big that's still growing is likely to keep growing. Move it once into a
+	// reserved slot so every future resize happens in place.
+	if (Size >= LargeBlockHeap::MinBlockSize)
+		newMemory = LargeBlockHeap::Allocate(Size);
+
+	if (newMemory)
 	{
-		// Recalloc behaves like calloc if there's no existing allocation. Realloc doesn't. Zero it either way.
-		newMemory = MemAlloc(Size, 0, false, true);
+		memcpy(newMemory, Memory, copySize);
+	}
+	else
+	{
+		newMemory = MemAlloc(Size);
+
+		if (!newMemory)
+			return nullptr;
 
-		if (Memory)
-			memcpy(newMemory, Memory, std::min(Size, MemSize(Memory)));
+		// Only the newly exposed tail needs clearing
+		memcpy(newMemory, Memory, copySize);
+		memset((uint8_t *)newMemory + copySize, 0, Size - copySize);
 	}
 
 	MemFree(Memory);
@@ -188,6 +441,15 @@ void *ScrapHeap::Allocate(size_t Size, uint32_t Alignment)
 	if (Size > MAX_ALLOC_SIZE)
 		return nullptr;
 
+#if SKYRIM64_USE_SMALLBLOCK_HEAP && !SKYRIM64_USE_PAGE_HEAP
+	if (void *ptr = ScrapArena::Allocate(Size, Alignment))
+	{
+		ProfileCounterInc("Alloc Count");
+		ProfileCounterAdd("Byte Count", Size);
+		return ptr;
+	}
+#endif
+
 	return MemAlloc(Size, Alignment, Alignment != 0);
 }
 
@@ -200,6 +462,15 @@ void PatchMemory()
 {
 	scalable_allocation_mode(TBBMALLOC_USE_HUGE_PAGES, 1);
 
+#if SKYRIM64_USE_SMALLBLOCK_HEAP && !SKYRIM64_USE_PAGE_HEAP
+	SmallBlockHeap::Initialize();
+	ScrapArena::Initialize();
+#endif
+
+#if !SKYRIM64_USE_PAGE_HEAP
+	LargeBlockHeap::Initialize();
+#endif
+
 	PatchIAT(hk_calloc, "API-MS-WIN-CRT-HEAP-L1-1-0.DLL", "calloc");
 	PatchIAT(hk_malloc, "API-MS-WIN-CRT-HEAP-L1-1-0.DLL", "malloc");
 	PatchIAT(hk_aligned_malloc, "API-MS-WIN-CRT-HEAP-L1-1-0.DLL", "_aligned_malloc");
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <new>
+
+//
+// Fixed-size block arena for render passes. Each thread frees into its own cache and carves fresh
+// blocks from its own slab, so the common path takes no lock and no interlocked instruction. A cache
+// that grows past two batches hands one batch to a global lock-free stack, and a thread with an empty
+// cache takes a whole batch back from it. Batches move as one linked list, so the shared stack is
+// touched once per BatchBlocks allocations at most.
+//
+// Slabs are never released. That keeps a stale read of a batch link safe during a pop, and the ABA
+// tag packed into the stack head makes the following compare-exchange fail.
+//
+// There is one arena per BlockSize. All of its state is static.
+//
+template<size_t BlockSize, size_t SlabBlocks = 512>
+class RenderPassArena
+{
+public:
+	const static uint32_t BatchBlocks = 64;
+
+private:
+	struct FreeBlock
+	{
+		FreeBlock *Next;						// Next block in the same batch
+		std::atomic<FreeBlock *> NextBatch;		// Only valid on a batch's first block
+		uint32_t BatchCount;					// Only valid on a batch's first block
+	};
+
+	static_assert(BlockSize >= sizeof(FreeBlock), "Blocks must be able to hold a free list entry");
+	static_assert(BlockSize % alignof(FreeBlock) == 0, "Blocks must stay pointer-aligned");
+
+	struct ThreadCache
+	{
+		FreeBlock *Head = nullptr;
+		uint32_t Count = 0;
+		uint8_t *SlabCursor = nullptr;
+		uint8_t *SlabEnd = nullptr;
+
+		~ThreadCache()
+		{
+			// Whatever this thread still holds goes to the others, including the rest of its slab
+			for (; SlabCursor < SlabEnd; SlabCursor += BlockSize)
+				Push(SlabCursor);
+
+			if (Head)
+				PushBatch(Head, Count);
+		}
+
+		void Push(void *Block)
+		{
+			auto block = static_cast<FreeBlock *>(Block);
+			block->Next = Head;
+
+			Head = block;
+			Count++;
+		}
+	};
+
+	// Pointer in the low 48 bits, ABA tag in the high 16
+	const static uint64_t PointerMask = (1ull << 48) - 1;
+
+	inline static std::atomic_uint64_t m_GlobalHead;
+	inline static thread_local ThreadCache t_Cache;
+
+	static FreeBlock *Unpack(uint64_t Head)
+	{
+		return reinterpret_cast<FreeBlock *>(Head & PointerMask);
+	}
+
+	static uint64_t Pack(FreeBlock *Block, uint64_t OldHead)
+	{
+		return reinterpret_cast<uint64_t>(Block) | ((OldHead & ~PointerMask) + (1ull << 48));
+	}
+
+	static void PushBatch(FreeBlock *Batch, uint32_t Count)
+	{
+		Batch->BatchCount = Count;
+
+		uint64_t head = m_GlobalHead.load(std::memory_order_relaxed);
+
+		do
+		{
+			Batch->NextBatch.store(Unpack(head), std::memory_order_relaxed);
+		} while (!m_GlobalHead.compare_exchange_weak(head, Pack(Batch, head), std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	static FreeBlock *PopBatch()
+	{
+		uint64_t head = m_GlobalHead.load(std::memory_order_acquire);
+
+		while (FreeBlock *batch = Unpack(head))
+		{
+			FreeBlock *next = batch->NextBatch.load(std::memory_order_relaxed);
+
+			if (m_GlobalHead.compare_exchange_weak(head, Pack(next, head), std::memory_order_acquire, std::memory_order_acquire))
+				return batch;
+		}
+
+		return nullptr;
+	}
+
+public:
+	static void *Allocate()
+	{
+		ThreadCache& cache = t_Cache;
+
+		if (!cache.Head)
+		{
+			if (FreeBlock *batch = PopBatch())
+			{
+				cache.Head = batch;
+				cache.Count = batch->BatchCount;
+			}
+		}
+
+		if (cache.Head)
+		{
+			FreeBlock *block = cache.Head;
+
+			cache.Head = block->Next;
+			cache.Count--;
+			return block;
+		}
+
+		if (cache.SlabCursor >= cache.SlabEnd)
+		{
+			cache.SlabCursor = static_cast<uint8_t *>(::operator new(BlockSize * SlabBlocks, std::nothrow));
+
+			if (!cache.SlabCursor)
+			{
+				cache.SlabEnd = nullptr;
+				return nullptr;
+			}
+
+			cache.SlabEnd = cache.SlabCursor + (BlockSize * SlabBlocks);
+		}
+
+		void *block = cache.SlabCursor;
+		cache.SlabCursor += BlockSize;
+		return block;
+	}
+
+	static void Free(void *Block)
+	{
+		if (!Block)
+			return;
+
+		ThreadCache& cache = t_Cache;
+		cache.Push(Block);
+
+		if (cache.Count < BatchBlocks * 2)
+			return;
+
+		// Keep the most recently freed (cache-warm) batch and give away the rest
+		FreeBlock *last = cache.Head;
+
+		for (uint32_t i = 1; i < BatchBlocks; i++)
+			last = last->Next;
+
+		FreeBlock *batch = last->Next;
+		last->Next = nullptr;
+
+		PushBatch(batch, cache.Count - BatchBlocks);
+		cache.Count = BatchBlocks;
+	}
+};
\ No newline at end of file
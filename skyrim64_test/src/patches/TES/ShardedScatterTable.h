@@ -0,0 +1,187 @@
+#pragma once
+
+#include "FlatScatterTable.h"
+
+//
+// FlatScatterTable split into independently locked shards. The shard is picked from the top bits
+// of a second hash so it doesn't correlate with the group index inside the shard. Readers take
+// the shard lock shared, writers exclusive. The drain callback may call back
+// into game code, so it always runs with no lock held.
+//
+template<typename Key, typename T, class Hash = BSTScatterTableDefaultHashPolicy<Key>, uint32_t ShardBits = 6>
+class ShardedScatterTable
+{
+public:
+	using value_type = typename FlatScatterTable<Key, T, Hash>::value_type;
+
+	const static uint32_t ShardCount = 1u << ShardBits;
+	const static uint32_t BatchSize = 256;
+
+private:
+	struct alignas(64) Shard
+	{
+		mutable SRWLOCK Lock = SRWLOCK_INIT;
+		FlatScatterTable<Key, T, Hash> Table;
+	};
+
+	Shard m_Shards[ShardCount];
+
+	static uint32_t GetShard(const Key& Lookup)
+	{
+		return (uint32_t)(((uint64_t)Hash()(Lookup) * 0xC2B2AE3D27D4EB4Full) >> (64 - ShardBits));
+	}
+
+public:
+	ShardedScatterTable() = default;
+
+	ShardedScatterTable(const ShardedScatterTable&) = delete;
+	ShardedScatterTable& operator=(const ShardedScatterTable&) = delete;
+
+	size_t size() const
+	{
+		size_t count = 0;
+
+		for (auto& shard : m_Shards)
+		{
+			AcquireSRWLockShared(&shard.Lock);
+			count += shard.Table.size();
+			ReleaseSRWLockShared(&shard.Lock);
+		}
+
+		return count;
+	}
+
+	bool contains(const Key& Lookup) const
+	{
+		auto& shard = m_Shards[GetShard(Lookup)];
+
+		AcquireSRWLockShared(&shard.Lock);
+		bool found = shard.Table.find(Lookup) != nullptr;
+		ReleaseSRWLockShared(&shard.Lock);
+
+		return found;
+	}
+
+	bool get(const Key& Lookup, T& Out) const
+	{
+		auto& shard = m_Shards[GetShard(Lookup)];
+
+		AcquireSRWLockShared(&shard.Lock);
+		bool found = shard.Table.get(Lookup, Out);
+		ReleaseSRWLockShared(&shard.Lock);
+
+		return found;
+	}
+
+	bool insert(const Key& NewKey, const T& NewValue)
+	{
+		auto& shard = m_Shards[GetShard(NewKey)];
+
+		AcquireSRWLockExclusive(&shard.Lock);
+		bool inserted = shard.Table.insert(NewKey, NewValue).second;
+		ReleaseSRWLockExclusive(&shard.Lock);
+
+		return inserted;
+	}
+
+	void insert_or_assign(const Key& NewKey, const T& NewValue)
+	{
+		auto& shard = m_Shards[GetShard(NewKey)];
+
+		AcquireSRWLockExclusive(&shard.Lock);
+		shard.Table.insert_or_assign(NewKey, NewValue);
+		ReleaseSRWLockExclusive(&shard.Lock);
+	}
+
+	//
+	// Returns the existing value if Accept(value) is true. Otherwise Create() is called with the
+	// shard locked and its result is stored. Only one thread ever creates a value for a key.
+	//
+	template<typename AcceptFunc, typename CreateFunc>
+	T find_or_insert(const Key& Lookup, AcceptFunc&& Accept, CreateFunc&& Create)
+	{
+		auto& shard = m_Shards[GetShard(Lookup)];
+		T value;
+
+		AcquireSRWLockShared(&shard.Lock);
+		bool found = shard.Table.get(Lookup, value) && Accept(value);
+		ReleaseSRWLockShared(&shard.Lock);
+
+		if (found)
+			return value;
+
+		AcquireSRWLockExclusive(&shard.Lock);
+		{
+			// Someone else may have won the race while the lock was dropped
+			if (!shard.Table.get(Lookup, value) || !Accept(value))
+			{
+				value = Create();
+				shard.Table.insert_or_assign(Lookup, value);
+			}
+		}
+		ReleaseSRWLockExclusive(&shard.Lock);
+
+		return value;
+	}
+
+	bool erase(const Key& Lookup, T *OldValue = nullptr)
+	{
+		auto& shard = m_Shards[GetShard(Lookup)];
+
+		AcquireSRWLockExclusive(&shard.Lock);
+		T *value = shard.Table.find(Lookup);
+
+		if (value && OldValue)
+			*OldValue = *value;
+
+		bool erased = value && shard.Table.erase(Lookup);
+		ReleaseSRWLockExclusive(&shard.Lock);
+
+		return erased;
+	}
+
+	void clear()
+	{
+		for (auto& shard : m_Shards)
+		{
+			AcquireSRWLockExclusive(&shard.Lock);
+			shard.Table.clear();
+			ReleaseSRWLockExclusive(&shard.Lock);
+		}
+	}
+
+	//
+	// Empties the table and hands every removed entry to Func(const value_type *Batch, uint32_t Count).
+	// Each shard is swapped out under its lock and visited after the lock is dropped.
+	//
+	template<typename Func>
+	void drain(Func&& Callback)
+	{
+		value_type batch[BatchSize];
+
+		for (auto& shard : m_Shards)
+		{
+			FlatScatterTable<Key, T, Hash> detached;
+
+			AcquireSRWLockExclusive(&shard.Lock);
+			shard.Table.swap(detached);
+			ReleaseSRWLockExclusive(&shard.Lock);
+
+			uint32_t count = 0;
+
+			for (auto& entry : detached)
+			{
+				batch[count++] = entry;
+
+				if (count >= BatchSize)
+				{
+					Callback((const value_type *)batch, count);
+					count = 0;
+				}
+			}
+
+			if (count > 0)
+				Callback((const value_type *)batch, count);
+		}
+	}
+};
\ No newline at end of file
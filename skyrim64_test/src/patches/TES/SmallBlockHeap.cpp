@@ -0,0 +1,314 @@
+#include "../../common.h"
+#include <atomic>
+#include "SmallBlockHeap.h"
+
+namespace SmallBlockHeap
+{
+	const static size_t SpanCount = ReserveSize / SpanSize;
+	const static size_t RefillCount = MagazineSize / 2;
+
+	struct FreeBlock
+	{
+		FreeBlock *Next;
+	};
+
+	struct alignas(64) SizeClass
+	{
+		SRWLOCK Lock					= SRWLOCK_INIT;
+		FreeBlock *DepotHead			= nullptr;	// Blocks handed back by thread magazines
+		int64_t DepotCount				= 0;
+		uintptr_t CarveCursor			= 0;		// Next never-used block in the active span
+		uintptr_t CarveEnd				= 0;
+		std::atomic<int64_t> SpanCount	= 0;
+		std::atomic<int64_t> RetiredAllocs = 0;		// Counters inherited from exited threads
+		std::atomic<int64_t> RetiredFrees = 0;
+	};
+
+	struct ThreadCache
+	{
+		struct Magazine
+		{
+			uint32_t Count;
+			void *Blocks[MagazineSize];
+		};
+
+		Magazine Magazines[ClassCount];
+
+		// Only written by the owning thread. Atomics keep GetStats() reads well defined.
+		std::atomic<int64_t> AllocCount[ClassCount];
+		std::atomic<int64_t> FreeCount[ClassCount];
+
+		ThreadCache *Next;
+		ThreadCache *Prev;
+	};
+
+	struct ThreadCacheGuard
+	{
+		~ThreadCacheGuard();
+	};
+
+	SizeClass Classes[ClassCount];
+	uint8_t SpanClasses[SpanCount];
+	std::atomic<size_t> NextSpan;
+
+	SRWLOCK RegistryLock = SRWLOCK_INIT;
+	ThreadCache *RegistryHead;
+
+	thread_local ThreadCache *TLSCache;
+	thread_local bool TLSCacheReleased;
+	thread_local ThreadCacheGuard TLSCacheGuard;
+
+	__forceinline uint32_t SizeToClass(size_t Size)
+	{
+		return (uint32_t)((Size - 1) / BlockGranularity);
+	}
+
+	__forceinline size_t ClassToSize(uint32_t Class)
+	{
+		return (Class + 1) * BlockGranularity;
+	}
+
+	__forceinline void Increment(std::atomic<int64_t>& Counter)
+	{
+		// Single writer, no need for a locked instruction
+		Counter.store(Counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	void Initialize()
+	{
+		if (HeapBase)
+			return;
+
+		void *base = VirtualAlloc(nullptr, ReserveSize, MEM_RESERVE, PAGE_NOACCESS);
+
+		// If the reservation fails, Owns() is always false and every allocation falls back to tbbmalloc
+		if (!base)
+			return;
+
+		HeapBase = (uintptr_t)base;
+		HeapEnd = HeapBase + ReserveSize;
+	}
+
+	bool CommitSpan(SizeClass& Entry, uint32_t Class)
+	{
+		size_t index = NextSpan.fetch_add(1);
+
+		if (index >= SpanCount)
+			return false;
+
+		uintptr_t span = HeapBase + (index * SpanSize);
+
+		if (!VirtualAlloc((void *)span, SpanSize, MEM_COMMIT, PAGE_READWRITE))
+			return false;
+
+		SpanClasses[index] = (uint8_t)Class;
+
+		// Trailing bytes that don't fit a whole block are left unused
+		Entry.CarveCursor = span;
+		Entry.CarveEnd = span + ((SpanSize / ClassToSize(Class)) * ClassToSize(Class));
+		Entry.SpanCount++;
+		return true;
+	}
+
+	uint32_t RefillBlocks(uint32_t Class, void **Blocks, uint32_t MaxCount)
+	{
+		SizeClass& entry = Classes[Class];
+		uint32_t count = 0;
+
+		AcquireSRWLockExclusive(&entry.Lock);
+		{
+			// Recycled blocks first, then fresh blocks from the active span
+			while (count < MaxCount && entry.DepotHead)
+			{
+				Blocks[count++] = entry.DepotHead;
+				entry.DepotHead = entry.DepotHead->Next;
+				entry.DepotCount--;
+			}
+
+			while (count < MaxCount)
+			{
+				if (entry.CarveCursor >= entry.CarveEnd && !CommitSpan(entry, Class))
+					break;
+
+				Blocks[count++] = (void *)entry.CarveCursor;
+				entry.CarveCursor += ClassToSize(Class);
+			}
+		}
+		ReleaseSRWLockExclusive(&entry.Lock);
+
+		return count;
+	}
+
+	void ReturnBlocks(uint32_t Class, void **Blocks, uint32_t Count)
+	{
+		if (Count == 0)
+			return;
+
+		// Link the batch outside of the lock and splice it in one go
+		for (uint32_t i = 0; i < Count - 1; i++)
+			((FreeBlock *)Blocks[i])->Next = (FreeBlock *)Blocks[i + 1];
+
+		SizeClass& entry = Classes[Class];
+
+		AcquireSRWLockExclusive(&entry.Lock);
+		{
+			((FreeBlock *)Blocks[Count - 1])->Next = entry.DepotHead;
+			entry.DepotHead = (FreeBlock *)Blocks[0];
+			entry.DepotCount += Count;
+		}
+		ReleaseSRWLockExclusive(&entry.Lock);
+	}
+
+	ThreadCache *GetThreadCache()
+	{
+		if (TLSCache || TLSCacheReleased)
+			return TLSCache;
+
+		// Can't recurse into the hooked CRT heap from here
+		auto cache = (ThreadCache *)VirtualAlloc(nullptr, sizeof(ThreadCache), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+		if (!cache)
+			return nullptr;
+
+		AcquireSRWLockExclusive(&RegistryLock);
+		{
+			cache->Next = RegistryHead;
+
+			if (RegistryHead)
+				RegistryHead->Prev = cache;
+
+			RegistryHead = cache;
+		}
+		ReleaseSRWLockExclusive(&RegistryLock);
+
+		// Touching the guard registers its destructor for this thread
+		(void)&TLSCacheGuard;
+		TLSCache = cache;
+		return cache;
+	}
+
+	ThreadCacheGuard::~ThreadCacheGuard()
+	{
+		ThreadCache *cache = TLSCache;
+
+		TLSCache = nullptr;
+		TLSCacheReleased = true;
+
+		if (!cache)
+			return;
+
+		for (uint32_t i = 0; i < ClassCount; i++)
+			ReturnBlocks(i, cache->Magazines[i].Blocks, cache->Magazines[i].Count);
+
+		AcquireSRWLockExclusive(&RegistryLock);
+		{
+			for (uint32_t i = 0; i < ClassCount; i++)
+			{
+				Classes[i].RetiredAllocs += cache->AllocCount[i].load();
+				Classes[i].RetiredFrees += cache->FreeCount[i].load();
+			}
+
+			if (cache->Prev)
+				cache->Prev->Next = cache->Next;
+			else
+				RegistryHead = cache->Next;
+
+			if (cache->Next)
+				cache->Next->Prev = cache->Prev;
+		}
+		ReleaseSRWLockExclusive(&RegistryLock);
+
+		VirtualFree(cache, 0, MEM_RELEASE);
+	}
+
+	void *Allocate(size_t Size)
+	{
+		if (!HeapBase || Size > MaxBlockSize)
+			return nullptr;
+
+		uint32_t sizeClass = SizeToClass(std::max<size_t>(Size, 1));
+		ThreadCache *cache = GetThreadCache();
+
+		if (!cache)
+		{
+			// Thread is shutting down: skip the magazine
+			void *block = nullptr;
+
+			if (RefillBlocks(sizeClass, &block, 1) == 0)
+				return nullptr;
+
+			Classes[sizeClass].RetiredAllocs++;
+			return block;
+		}
+
+		auto& magazine = cache->Magazines[sizeClass];
+
+		if (magazine.Count == 0)
+		{
+			magazine.Count = RefillBlocks(sizeClass, magazine.Blocks, RefillCount);
+
+			// Address space exhausted
+			if (magazine.Count == 0)
+				return nullptr;
+		}
+
+		Increment(cache->AllocCount[sizeClass]);
+		return magazine.Blocks[--magazine.Count];
+	}
+
+	void Free(void *Memory)
+	{
+		uint32_t sizeClass = SpanClasses[((uintptr_t)Memory - HeapBase) / SpanSize];
+		ThreadCache *cache = GetThreadCache();
+
+		if (!cache)
+		{
+			ReturnBlocks(sizeClass, &Memory, 1);
+			Classes[sizeClass].RetiredFrees++;
+			return;
+		}
+
+		auto& magazine = cache->Magazines[sizeClass];
+
+		// Cross-thread frees land in this thread's magazine. Overflow goes back to the depot
+		// in half-magazine batches so ping-ponging between two threads stays cheap.
+		if (magazine.Count >= MagazineSize)
+		{
+			magazine.Count -= RefillCount;
+			ReturnBlocks(sizeClass, &magazine.Blocks[magazine.Count], RefillCount);
+		}
+
+		Increment(cache->FreeCount[sizeClass]);
+		magazine.Blocks[magazine.Count++] = Memory;
+	}
+
+	size_t BlockSize(const void *Memory)
+	{
+		return ClassToSize(SpanClasses[((uintptr_t)Memory - HeapBase) / SpanSize]);
+	}
+
+	void GetStats(SizeClassStats (&Stats)[ClassCount])
+	{
+		for (uint32_t i = 0; i < ClassCount; i++)
+		{
+			Stats[i].BlockSize = (uint32_t)ClassToSize(i);
+			Stats[i].AllocCount = Classes[i].RetiredAllocs.load();
+			Stats[i].FreeCount = Classes[i].RetiredFrees.load();
+			Stats[i].SpanCount = Classes[i].SpanCount.load();
+			Stats[i].DepotCount = *(volatile int64_t *)&Classes[i].DepotCount;
+		}
+
+		AcquireSRWLockShared(&RegistryLock);
+		{
+			for (ThreadCache *cache = RegistryHead; cache; cache = cache->Next)
+			{
+				for (uint32_t i = 0; i < ClassCount; i++)
+				{
+					Stats[i].AllocCount += cache->AllocCount[i].load(std::memory_order_relaxed);
+					Stats[i].FreeCount += cache->FreeCount[i].load(std::memory_order_relaxed);
+				}
+			}
+		}
+		ReleaseSRWLockShared(&RegistryLock);
+	}
+}
\ No newline at end of file
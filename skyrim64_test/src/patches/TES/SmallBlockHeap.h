@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// Size-class slab heap for small engine allocations. Every block lives in a 64KB span carved
+// out of one reserved address range, so ownership checks are a range compare and the size
+// class comes from a per-span byte. Threads keep a magazine of free blocks per class and only
+// touch the shared depot when a magazine runs dry or overflows.
+//
+namespace SmallBlockHeap
+{
+	const static size_t BlockGranularity	= 16;
+	const static size_t MaxBlockSize		= 1024;
+	const static size_t ClassCount			= MaxBlockSize / BlockGranularity;
+	const static size_t SpanSize			= 64 * 1024;
+	const static size_t ReserveSize			= 32ull * 1024 * 1024 * 1024;
+	const static size_t MagazineSize		= 64;
+
+	struct SizeClassStats
+	{
+		uint32_t BlockSize;
+		int64_t AllocCount;
+		int64_t FreeCount;
+		int64_t SpanCount;
+		int64_t DepotCount;
+	};
+
+	inline uintptr_t HeapBase;
+	inline uintptr_t HeapEnd;
+
+	void Initialize();
+	void *Allocate(size_t Size);
+	void Free(void *Memory);
+	size_t BlockSize(const void *Memory);
+	void GetStats(SizeClassStats (&Stats)[ClassCount]);
+
+	inline bool Owns(const void *Memory)
+	{
+		return (uintptr_t)Memory >= HeapBase && (uintptr_t)Memory < HeapEnd;
+	}
+}
\ No newline at end of file
@@ -5,15 +5,70 @@
 #include "TESForm.h"
 #include "BGSDistantTreeBlock.h"
 #include "MemoryManager.h"
+#include "FlatScatterTable.h"
 
 AutoPtr(bool, byte_141EE9B98, 0x1EE9B98);
 
 AutoPtr(BSReadWriteLock, GlobalFormLock, 0x1EEA0D0);
 AutoPtr(templated(BSTCRCScatterTable<uint32_t, TESForm *> *), GlobalFormList, 0x1EE9C38);
 
-tbb::concurrent_hash_map<uint32_t, TESForm *> g_FormMap[TES_FORM_MASTER_COUNT];
 tbb::concurrent_hash_map<uint32_t, const char *> g_EditorNameMap;
 
+//
+// Form ID cache: a two-level radix table indexed by master byte, then the upper base id bits. Each
+// page covers 8192 consecutive ids. A slot is 0 when nothing is cached, 1 for a cached "no such
+// form", or the form pointer. Pages are published once with a CAS and never freed or remapped,
+// so a reader can't observe reclaimed memory: lookups are two dependent loads with no lock and
+// no epoch bookkeeping.
+//
+namespace FormCache
+{
+	const static uint32_t SlotBits = 13;
+	const static uint32_t SlotCount = 1u << SlotBits;
+	const static uint32_t PageCount = TES_FORM_INDEX_COUNT / SlotCount;
+	const static uintptr_t EmptySlot = 0;
+	const static uintptr_t NullSlot = 1;
+
+	using Slot = std::atomic<uintptr_t>;
+
+	std::atomic<Slot *> Pages[TES_FORM_MASTER_COUNT][PageCount];
+
+	__forceinline std::atomic<Slot *>& GetDirectoryEntry(uint32_t FormId)
+	{
+		return Pages[FormId >> 24][(FormId & 0x00FFFFFF) >> SlotBits];
+	}
+
+	__forceinline Slot& GetSlot(Slot *Page, uint32_t FormId)
+	{
+		return Page[FormId & (SlotCount - 1)];
+	}
+
+	Slot *CreatePage(uint32_t FormId)
+	{
+		auto& entry = GetDirectoryEntry(FormId);
+		Slot *page = entry.load(std::memory_order_acquire);
+
+		if (page)
+			return page;
+
+		// Committed pages are zeroed: every slot starts out empty
+		auto newPage = (Slot *)VirtualAlloc(nullptr, SlotCount * sizeof(Slot), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+		if (!newPage)
+			return nullptr;
+
+		if (!entry.compare_exchange_strong(page, newPage, std::memory_order_acq_rel))
+		{
+			// Another thread published first
+			VirtualFree(newPage, 0, MEM_RELEASE);
+			return page;
+		}
+
+		ProfileCounterInc("Cache Pages");
+		return newPage;
+	}
+}
+
 // The form list is maintained at the end of this file
 struct FormEnumEntry
 {
@@ -26,17 +81,237 @@ struct FormEnumEntry
 
 extern const FormEnumEntry FormEnum[138];
 
-void UpdateFormCache(uint32_t FormId, TESForm *Value, bool Invalidate)
+//
+// Per-type secondary index for LookupFormsByType. Built with one full scan of GlobalFormList on
+// first use. After that the same hooks that invalidate the form cache queue form ids here, and
+// queued ids are re-resolved right before the next query. Each bucket keeps lazily built
+// unsorted, ID-sorted and name-sorted views that are only thrown away when the bucket changes.
+//
+namespace FormTypeIndex
+{
+	const static uint32_t TypeCount = ARRAYSIZE(FormEnum);
+
+	enum : uint32_t
+	{
+		VIEW_UNSORTED,
+		VIEW_BY_ID,
+		VIEW_BY_NAME,
+		VIEW_COUNT,
+	};
+
+	struct Location
+	{
+		uint8_t Type;
+		uint32_t Index;
+	};
+
+	struct Bucket
+	{
+		std::vector<TESForm *> Forms;
+		std::vector<uint32_t> FormIds;	// Parallel to Forms. Removed forms may already be freed, never dereference them.
+		std::shared_ptr<const std::vector<TESForm *>> Views[VIEW_COUNT];
+	};
+
+	SRWLOCK IndexLock = SRWLOCK_INIT;
+	Bucket Buckets[TypeCount];
+	FlatScatterTable<uint32_t, Location> Locations;
+	std::atomic_bool Tracking;			// Set right before the initial scan so no change is lost while it runs
+	std::atomic_bool Built;
+
+	SRWLOCK PendingLock = SRWLOCK_INIT;
+	std::vector<uint32_t> PendingIds;
+
+	void InvalidateViews(Bucket& Entry)
+	{
+		for (auto& view : Entry.Views)
+			view.reset();
+	}
+
+	void Add(uint32_t FormId, TESForm *Form)
+	{
+		if (Form->GetType() >= TypeCount)
+			return;
+
+		auto& bucket = Buckets[Form->GetType()];
+
+		Locations.insert_or_assign(FormId, Location{ Form->GetType(), (uint32_t)bucket.Forms.size() });
+		bucket.Forms.push_back(Form);
+		bucket.FormIds.push_back(FormId);
+		InvalidateViews(bucket);
+	}
+
+	void Remove(uint32_t FormId)
+	{
+		Location *location = Locations.find(FormId);
+
+		if (!location)
+			return;
+
+		// Swap with the last element so removal is O(1)
+		auto& bucket = Buckets[location->Type];
+		const uint32_t lastId = bucket.FormIds.back();
+
+		bucket.Forms[location->Index] = bucket.Forms.back();
+		bucket.FormIds[location->Index] = lastId;
+		bucket.Forms.pop_back();
+		bucket.FormIds.pop_back();
+
+		if (lastId != FormId)
+			Locations.find(lastId)->Index = location->Index;
+
+		Locations.erase(FormId);
+		InvalidateViews(bucket);
+	}
+
+	void MarkDirty(const uint32_t *FormIds, size_t Count)
+	{
+		// Nothing to track until the first query builds the index
+		if (!Tracking.load(std::memory_order_acquire))
+			return;
+
+		AcquireSRWLockExclusive(&PendingLock);
+		PendingIds.insert(PendingIds.end(), FormIds, FormIds + Count);
+		ReleaseSRWLockExclusive(&PendingLock);
+	}
+
+	void Synchronize()
+	{
+		std::vector<uint32_t> pending;
+
+		if (Built.load(std::memory_order_acquire))
+		{
+			AcquireSRWLockExclusive(&PendingLock);
+			pending.swap(PendingIds);
+			ReleaseSRWLockExclusive(&PendingLock);
+
+			if (pending.empty())
+				return;
+		}
+
+		AcquireSRWLockExclusive(&IndexLock);
+		GlobalFormLock.LockForRead();
+		{
+			if (!Built.load(std::memory_order_relaxed))
+			{
+				ProfileTimer("Type Index Build Time");
+				Tracking.store(true);
+
+				if (GlobalFormList)
+				{
+					Locations.reserve(GlobalFormList->size());
+
+					for (auto itr = GlobalFormList->begin(); itr != GlobalFormList->end(); itr++)
+						Add((*itr)->GetId(), *itr);
+				}
+
+				// Ids queued during the scan are re-checked on the next query
+				Built.store(true, std::memory_order_release);
+			}
+			else
+			{
+				// The hooks only provide ids, so look up what each one maps to right now
+				for (uint32_t formId : pending)
+				{
+					TESForm *form = nullptr;
+
+					if (GlobalFormList)
+						GlobalFormList->get(formId, form);
+
+					Location *location = Locations.find(formId);
+
+					if (location && form && location->Type == form->GetType() && Buckets[location->Type].Forms[location->Index] == form)
+					{
+						// Unchanged, but an editor id may have been renamed
+						Buckets[location->Type].Views[VIEW_BY_NAME].reset();
+						continue;
+					}
+
+					Remove(formId);
+
+					if (form)
+						Add(formId, form);
+				}
+			}
+		}
+		GlobalFormLock.UnlockRead();
+		ReleaseSRWLockExclusive(&IndexLock);
+	}
+
+	std::shared_ptr<const std::vector<TESForm *>> GetView(uint32_t Type, uint32_t View)
+	{
+		auto& bucket = Buckets[Type];
+		std::shared_ptr<const std::vector<TESForm *>> result;
+
+		AcquireSRWLockShared(&IndexLock);
+		result = bucket.Views[View];
+		ReleaseSRWLockShared(&IndexLock);
+
+		if (result)
+			return result;
+
+		AcquireSRWLockExclusive(&IndexLock);
+		{
+			if (!bucket.Views[View])
+			{
+				auto data = std::make_shared<std::vector<TESForm *>>(bucket.Forms);
+
+				if (View == VIEW_BY_ID)
+				{
+					std::sort(data->begin(), data->end(),
+						[](TESForm *& a, TESForm *& b) -> bool
+					{
+						return a->GetId() < b->GetId();
+					});
+				}
+				else if (View == VIEW_BY_NAME)
+				{
+					std::sort(data->begin(), data->end(),
+						[](TESForm *& a, TESForm *& b) -> bool
+					{
+						return strcmp(a->GetName(), b->GetName()) < 0;
+					});
+				}
+
+				bucket.Views[View] = std::move(data);
+			}
+
+			result = bucket.Views[View];
+		}
+		ReleaseSRWLockExclusive(&IndexLock);
+
+		return result;
+	}
+}
+
+void InvalidateFormCache(uint32_t FormId)
 {
 	ProfileTimer("Cache Update Time");
 
-	const unsigned char masterId = (FormId & 0xFF000000) >> 24;
-	const unsigned int baseId = (FormId & 0x00FFFFFF);
+	// Nothing to clear if the page was never created
+	if (auto page = FormCache::GetDirectoryEntry(FormId).load(std::memory_order_acquire))
+		FormCache::GetSlot(page, FormId).store(FormCache::EmptySlot, std::memory_order_release);
 
+	BGSDistantTreeBlock::InvalidateCachedForm(FormId);
+}
+
+void UpdateFormCache(uint32_t FormId, TESForm *Value, bool Invalidate)
+{
 	if (Invalidate)
-		g_FormMap[masterId].erase(baseId);
-	else
-		g_FormMap[masterId].insert(std::make_pair(baseId, Value));
+	{
+		InvalidateFormCache(FormId);
+		return;
+	}
+
+	ProfileTimer("Cache Update Time");
+
+	if (auto page = FormCache::CreatePage(FormId))
+	{
+		// Same as a hash map insert: an existing entry is left alone
+		uintptr_t expected = FormCache::EmptySlot;
+		uintptr_t value = Value ? (uintptr_t)Value : FormCache::NullSlot;
+
+		FormCache::GetSlot(page, FormId).compare_exchange_strong(expected, value, std::memory_order_release, std::memory_order_relaxed);
+	}
 
 	BGSDistantTreeBlock::InvalidateCachedForm(FormId);
 }
@@ -49,16 +324,14 @@ bool GetFormCache(uint32_t FormId, TESForm *&Form)
 	ProfileCounterInc("Cache Lookups");
 	ProfileTimer("Cache Fetch Time");
 
-	const unsigned char masterId = (FormId & 0xFF000000) >> 24;
-	const unsigned int baseId = (FormId & 0x00FFFFFF);
-
 	// Is it present in our map?
+	if (auto page = FormCache::GetDirectoryEntry(FormId).load(std::memory_order_acquire))
 	{
-		tbb::concurrent_hash_map<uint32_t, TESForm *>::accessor accessor;
+		uintptr_t value = FormCache::GetSlot(page, FormId).load(std::memory_order_acquire);
 
-		if (g_FormMap[masterId].find(accessor, baseId))
+		if (value != FormCache::EmptySlot)
 		{
-			Form = accessor->second;
+			Form = (value == FormCache::NullSlot) ? nullptr : (TESForm *)value;
 			return true;
 		}
 	}
@@ -77,7 +350,7 @@ void TESForm::hk_GetFullTypeName(char *Buffer, uint32_t BufferSize)
 
 const char *TESForm::hk_GetName()
 {
-	tbb::concurrent_hash_map<uint32_t, const char *>::accessor accessor;
+	tbb::concurrent_hash_map<uint32_t, const char *>::const_accessor accessor;
 
 	if (g_EditorNameMap.find(accessor, GetId()))
 		return accessor->second;
@@ -93,6 +366,10 @@ bool TESForm::hk_SetEditorId(const char *Name)
 	strcpy_s(data, len, Name);
 
 	g_EditorNameMap.insert(std::make_pair(GetId(), data));
+
+	// Name sorted views of this form's type are now out of date
+	uint32_t formId = GetId();
+	FormTypeIndex::MarkDirty(&formId, 1);
 	return true;
 }
 
@@ -142,41 +419,19 @@ const char *TESObjectREFR::hk_GetName()
 	return "";
 }
 
-std::vector<TESForm *> TESForm::LookupFormsByType(uint32_t Type, bool SortById, bool SortByName)
+TESFormList TESForm::LookupFormsByType(uint32_t Type, bool SortById, bool SortByName)
 {
-	std::vector<TESForm *> data;
+	if (Type >= FormTypeIndex::TypeCount)
+		return TESFormList();
 
-	GlobalFormLock.LockForRead();
-	{
-		if (GlobalFormList)
-		{
-			for (auto itr = GlobalFormList->begin(); itr != GlobalFormList->end(); itr++)
-			{
-				if (itr->GetType() == Type)
-					data.push_back(*itr);
-			}
-		}
-	}
-	GlobalFormLock.UnlockRead();
+	FormTypeIndex::Synchronize();
 
 	if (SortById)
-	{
-		std::sort(data.begin(), data.end(),
-			[](TESForm *& a, TESForm *& b) -> bool
-		{
-			return a->GetId() < b->GetId();
-		});
-	}
+		return FormTypeIndex::GetView(Type, FormTypeIndex::VIEW_BY_ID);
 	else if (SortByName)
-	{
-		std::sort(data.begin(), data.end(),
-			[](TESForm *& a, TESForm *& b) -> bool
-		{
-			return strcmp(a->GetName(), b->GetName()) < 0;
-		});
-	}
+		return FormTypeIndex::GetView(Type, FormTypeIndex::VIEW_BY_NAME);
 
-	return data;
+	return FormTypeIndex::GetView(Type, FormTypeIndex::VIEW_UNSORTED);
 }
 
 void CRC32_Lazy(int *out, int idIn)
@@ -185,36 +440,57 @@ void CRC32_Lazy(int *out, int idIn)
 	sub_140C06030(out, idIn);
 }
 
+//
+// The form cache is cleared before GlobalFormList changes, same as always. The type index is only
+// marked dirty after the original returns: a query in between would otherwise consume the id and
+// rebuild from the old list.
+//
 uintptr_t origFunc3;
 __int64 UnknownFormFunction3(__int64 a1, __int64 a2, int a3, __int64 a4)
 {
-	UpdateFormCache(*(uint32_t *)a4, nullptr, true);
+	uint32_t formId = *(uint32_t *)a4;
+	UpdateFormCache(formId, nullptr, true);
+
+	__int64 result = ((decltype(&UnknownFormFunction3))origFunc3)(a1, a2, a3, a4);
 
-	return ((decltype(&UnknownFormFunction3))origFunc3)(a1, a2, a3, a4);
+	FormTypeIndex::MarkDirty(&formId, 1);
+	return result;
 }
 
 uintptr_t origFunc2;
 __int64 UnknownFormFunction2(__int64 a1, __int64 a2, int a3, DWORD *formId, __int64 **a5)
 {
-	UpdateFormCache(*formId, nullptr, true);
+	uint32_t id = *formId;
+	UpdateFormCache(id, nullptr, true);
 
-	return ((decltype(&UnknownFormFunction2))origFunc2)(a1, a2, a3, formId, a5);
+	__int64 result = ((decltype(&UnknownFormFunction2))origFunc2)(a1, a2, a3, formId, a5);
+
+	FormTypeIndex::MarkDirty(&id, 1);
+	return result;
 }
 
 uintptr_t origFunc1;
 __int64 UnknownFormFunction1(__int64 a1, __int64 a2, int a3, DWORD *formId, __int64 *a5)
 {
-	UpdateFormCache(*formId, nullptr, true);
+	uint32_t id = *formId;
+	UpdateFormCache(id, nullptr, true);
+
+	__int64 result = ((decltype(&UnknownFormFunction1))origFunc1)(a1, a2, a3, formId, a5);
 
-	return ((decltype(&UnknownFormFunction1))origFunc1)(a1, a2, a3, formId, a5);
+	FormTypeIndex::MarkDirty(&id, 1);
+	return result;
 }
 
 uintptr_t origFunc0;
 void UnknownFormFunction0(__int64 form, bool a2)
 {
-	UpdateFormCache(*(uint32_t *)(form + 0x14), nullptr, true);
+	// The form may be gone once the original returns
+	uint32_t formId = *(uint32_t *)(form + 0x14);
+	UpdateFormCache(formId, nullptr, true);
 
 	((decltype(&UnknownFormFunction0))origFunc0)(form, a2);
+
+	FormTypeIndex::MarkDirty(&formId, 1);
 }
 
 void PatchTESForm()
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include "NiMain/NiNode.h"
 
 class BaseFormComponent;
@@ -10,6 +11,48 @@ class TESObjectCell;
 #define TES_FORM_MASTER_COUNT	256			// Maximum master file index + 1 (2^8, 8 bits)
 #define TES_FORM_INDEX_COUNT	16777216	// Maximum index + 1 (2^24, 24 bits)
 
+//
+// Snapshot of one bucket of the per-type form index. It references an immutable, already sorted
+// array, so iterating costs nothing extra and the snapshot stays valid while the index changes.
+//
+class TESFormList
+{
+private:
+	std::shared_ptr<const std::vector<TESForm *>> m_Forms;
+
+public:
+	TESFormList() = default;
+
+	TESFormList(std::shared_ptr<const std::vector<TESForm *>> Forms) : m_Forms(std::move(Forms))
+	{
+	}
+
+	TESForm *const *begin() const
+	{
+		return m_Forms ? m_Forms->data() : nullptr;
+	}
+
+	TESForm *const *end() const
+	{
+		return begin() + size();
+	}
+
+	size_t size() const
+	{
+		return m_Forms ? m_Forms->size() : 0;
+	}
+
+	bool empty() const
+	{
+		return size() == 0;
+	}
+
+	TESForm *operator[](size_t Index) const
+	{
+		return (*m_Forms)[Index];
+	}
+};
+
 class BaseFormComponent
 {
 public:
@@ -95,7 +138,7 @@ public:
 	bool hk_SetEditorId(const char *Name);
 
 	static TESForm *LookupFormById(uint32_t FormId);
-	static std::vector<TESForm *> LookupFormsByType(uint32_t Type, bool SortById = false, bool SortByName = false);
+	static TESFormList LookupFormsByType(uint32_t Type, bool SortById = false, bool SortByName = false);
 };
 
 class NiNode;
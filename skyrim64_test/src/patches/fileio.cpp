@@ -1,43 +1,142 @@
 #include "../common.h"
 #include <tbb/concurrent_hash_map.h>
+#include <memory>
+
+//
+// Large files are read through a few sliding views instead of one mapping of the whole file. A
+// multi-GB archive then only takes WindowSize * MaxWindows of address space. Sequential reads
+// prefetch the pages ahead of the read position. The OS file pointer is only moved when an
+// operation other than a mapped read depends on it.
+//
+const static uint64_t MMapMinFileSize	= 4096;
+const static uint64_t WindowSize		= 4 * 1024 * 1024;	// Must be a multiple of the 64KB allocation granularity
+const static uint32_t MaxWindows		= 4;
+const static uint64_t ReadaheadSize		= 1 * 1024 * 1024;
+const static uint32_t ReadBufferSize	= 4096;				// Unmapped files read ahead into a user-space buffer
+
+decltype(&PrefetchVirtualMemory) PrefetchVirtualMemoryFn = (decltype(&PrefetchVirtualMemory))GetProcAddress(GetModuleHandleA("kernel32.dll"), "PrefetchVirtualMemory");
+
+struct MappedWindow
+{
+	uint64_t Offset;
+	uint64_t Size;
+	uint8_t *Base;
+	uint64_t LastUse;
+};
 
 struct MMapFileInfo
 {
 	HANDLE FileHandle;
 	HANDLE MapHandle;
-	void *MapBase;
 	uint64_t FilePosition;
 	uint64_t FileLength;
+	uint64_t MapLength;			// File size when the mapping was created
+	uint64_t LastReadEnd;		// Used to detect sequential reads
+	uint64_t ReadaheadEnd;
+	uint64_t UseCounter;
+	bool PositionDirty;			// OS file pointer lags behind FilePosition
+	MappedWindow Windows[MaxWindows];
+	std::unique_ptr<uint8_t[]> ReadBuffer;
+	uint64_t BufferOffset;
+	uint32_t BufferLength;
 
 	bool IsMMap()
 	{
 		return MapHandle != nullptr;
 	}
 
-	uint64_t ReadMapped(void *Buffer, size_t Size)
+	MappedWindow *GetWindow(uint64_t Offset)
 	{
-		AssertDebug(FilePosition <= FileLength);
-		AssertDebug(Size < std::numeric_limits<DWORD>::max());
+		MappedWindow *victim = &Windows[0];
 
-		if (FilePosition + Size > FileLength)
-			Size = FileLength - FilePosition;
+		for (auto& window : Windows)
+		{
+			if (window.Base && Offset >= window.Offset && Offset < window.Offset + window.Size)
+			{
+				window.LastUse = ++UseCounter;
+				return &window;
+			}
 
-		memcpy(Buffer, (void *)((uintptr_t)MapBase + FilePosition), Size);
-		FilePosition += Size;
+			if (!window.Base || (victim->Base && window.LastUse < victim->LastUse))
+				victim = &window;
+		}
+
+		// Least recently used view gets replaced
+		if (victim->Base)
+			UnmapViewOfFile(victim->Base);
+
+		uint64_t start = Offset & ~(WindowSize - 1);
+		uint64_t size = std::min(WindowSize, MapLength - start);
+
+		victim->Base = (uint8_t *)MapViewOfFile(MapHandle, FILE_MAP_READ, (DWORD)(start >> 32), (DWORD)start, (SIZE_T)size);
+
+		if (!victim->Base)
+			return nullptr;
+
+		victim->Offset = start;
+		victim->Size = size;
+		victim->LastUse = ++UseCounter;
+		return victim;
+	}
+
+	void UnmapWindows()
+	{
+		for (auto& window : Windows)
+		{
+			if (window.Base)
+				UnmapViewOfFile(window.Base);
+
+			window.Base = nullptr;
+		}
+	}
+
+	void Readahead(uint64_t Position)
+	{
+		if (!PrefetchVirtualMemoryFn)
+			return;
+
+		// Only issue a new request once the reader is halfway through the previous one
+		if (ReadaheadEnd < Position)
+			ReadaheadEnd = Position;
+
+		if (Position + (ReadaheadSize / 2) < ReadaheadEnd)
+			return;
+
+		uint64_t end = std::min(ReadaheadEnd + ReadaheadSize, MapLength);
+
+		while (ReadaheadEnd < end)
+		{
+			MappedWindow *window = GetWindow(ReadaheadEnd);
+
+			if (!window)
+				break;
+
+			uint64_t size = std::min(end, window->Offset + window->Size) - ReadaheadEnd;
+
+			WIN32_MEMORY_RANGE_ENTRY range;
+			range.VirtualAddress = window->Base + (ReadaheadEnd - window->Offset);
+			range.NumberOfBytes = (SIZE_T)size;
+
+			PrefetchVirtualMemoryFn(GetCurrentProcess(), 1, &range, 0);
+			ReadaheadEnd += size;
+		}
+	}
+
+	void SyncFilePointer()
+	{
+		if (!PositionDirty)
+			return;
 
 		LARGE_INTEGER pos;
 		pos.QuadPart = FilePosition;
 
 		Assert(SetFilePointerEx(FileHandle, pos, nullptr, FILE_BEGIN));
-		return Size;
+		PositionDirty = false;
 	}
 
-	uint64_t Read(void *Buffer, size_t Size)
+	uint64_t ReadDirect(void *Buffer, size_t Size)
 	{
-		AssertDebug(Size < std::numeric_limits<DWORD>::max());
-
-		if (IsMMap())
-			return ReadMapped(Buffer, Size);
+		SyncFilePointer();
 
 		DWORD bytesRead = 0;
 
@@ -50,15 +149,203 @@ struct MMapFileInfo
 		return std::numeric_limits<uint64_t>::max();
 	}
 
+	bool FillBuffer()
+	{
+		SyncFilePointer();
+
+		if (!ReadBuffer)
+			ReadBuffer.reset(new uint8_t[ReadBufferSize]);
+
+		DWORD bytesRead = 0;
+
+		if (!ReadFile(FileHandle, ReadBuffer.get(), ReadBufferSize, &bytesRead, nullptr))
+			bytesRead = 0;
+
+		// The OS pointer is now ahead of the logical position
+		BufferOffset = FilePosition;
+		BufferLength = bytesRead;
+		PositionDirty = true;
+
+		return bytesRead > 0;
+	}
+
+	uint64_t Peek(const uint8_t **Data)
+	{
+		// Returns how many bytes at FilePosition can be read in place, either from a mapped view or
+		// from the read buffer
+		if (IsMMap() && FilePosition < MapLength)
+		{
+			if (MappedWindow *window = GetWindow(FilePosition))
+			{
+				*Data = window->Base + (FilePosition - window->Offset);
+				return std::min(window->Offset + window->Size, FileLength) - FilePosition;
+			}
+		}
+
+		if (FilePosition < BufferOffset || FilePosition >= BufferOffset + BufferLength)
+		{
+			if (!FillBuffer())
+				return 0;
+		}
+
+		*Data = ReadBuffer.get() + (FilePosition - BufferOffset);
+		return (BufferOffset + BufferLength) - FilePosition;
+	}
+
+	void Advance(uint64_t Size)
+	{
+		FilePosition += Size;
+		PositionDirty = true;
+	}
+
+	uint64_t ReadBuffered(void *Buffer, size_t Size)
+	{
+		uint64_t bytesRead = 0;
+
+		while (bytesRead < Size)
+		{
+			const uint8_t *data;
+			uint64_t available = Peek(&data);
+
+			if (available == 0)
+				break;
+
+			uint64_t size = std::min<uint64_t>(Size - bytesRead, available);
+
+			memcpy((uint8_t *)Buffer + bytesRead, data, size);
+			Advance(size);
+			bytesRead += size;
+		}
+
+		return bytesRead;
+	}
+
+	char *ReadLine(char *Buffer, int Count)
+	{
+		// Same as fgets() in text mode except that every carriage return is dropped
+		if (!Buffer || Count <= 0)
+			return nullptr;
+
+		bool sequential = (FilePosition == LastReadEnd);
+		uint64_t limit = Count - 1;
+		uint64_t consumed = 0;
+		uint64_t length = 0;
+
+		while (consumed < limit)
+		{
+			const uint8_t *data;
+			uint64_t available = Peek(&data);
+
+			if (available == 0)
+				break;
+
+			uint64_t scan = std::min(available, limit - consumed);
+			auto newline = (const uint8_t *)memchr(data, '\n', (size_t)scan);
+
+			if (newline)
+				scan = (newline - data) + 1;
+
+			for (const uint8_t *ptr = data, *end = data + scan; ptr < end;)
+			{
+				auto cr = (const uint8_t *)memchr(ptr, '\r', end - ptr);
+				auto segmentEnd = cr ? cr : end;
+
+				memcpy(Buffer + length, ptr, segmentEnd - ptr);
+				length += segmentEnd - ptr;
+				ptr = cr ? cr + 1 : end;
+			}
+
+			Advance(scan);
+			consumed += scan;
+
+			if (newline)
+				break;
+		}
+
+		LastReadEnd = FilePosition;
+
+		if (sequential && IsMMap())
+			Readahead(FilePosition);
+
+		// Nothing left to read
+		if (consumed == 0 && limit > 0)
+			return nullptr;
+
+		Buffer[length] = '\0';
+		return Buffer;
+	}
+
+	uint64_t ReadMapped(void *Buffer, size_t Size)
+	{
+		AssertDebug(Size < std::numeric_limits<DWORD>::max());
+
+		if (FilePosition >= FileLength)
+			Size = 0;
+		else if (FilePosition + Size > FileLength)
+			Size = FileLength - FilePosition;
+
+		bool sequential = (FilePosition == LastReadEnd);
+		uint64_t bytesRead = 0;
+
+		while (bytesRead < Size)
+		{
+			MappedWindow *window = (FilePosition < MapLength) ? GetWindow(FilePosition) : nullptr;
+
+			if (!window)
+			{
+				// Appended after the mapping was created or out of address space
+				uint64_t remainder = ReadDirect((uint8_t *)Buffer + bytesRead, Size - bytesRead);
+
+				if (remainder != std::numeric_limits<uint64_t>::max())
+					bytesRead += remainder;
+
+				break;
+			}
+
+			uint64_t offset = FilePosition - window->Offset;
+			uint64_t size = std::min<uint64_t>(Size - bytesRead, window->Size - offset);
+
+			memcpy((uint8_t *)Buffer + bytesRead, window->Base + offset, size);
+			FilePosition += size;
+			bytesRead += size;
+			PositionDirty = true;
+		}
+
+		LastReadEnd = FilePosition;
+
+		if (sequential)
+			Readahead(FilePosition);
+
+		return bytesRead;
+	}
+
+	uint64_t Read(void *Buffer, size_t Size)
+	{
+		AssertDebug(Size < std::numeric_limits<DWORD>::max());
+
+		if (IsMMap())
+			return ReadMapped(Buffer, Size);
+
+		// Small reads are served from the buffer, large ones go straight to the file
+		if (Size < ReadBufferSize)
+			return ReadBuffered(Buffer, Size);
+
+		return ReadDirect(Buffer, Size);
+	}
+
 	uint64_t Write(const void *Buffer, size_t Size)
 	{
 		AssertDebug(Size < std::numeric_limits<DWORD>::max());
 
+		SyncFilePointer();
+		BufferLength = 0;
+
 		DWORD bytesWritten = 0;
 
 		if (WriteFile(FileHandle, Buffer, (DWORD)Size, &bytesWritten, nullptr))
 		{
 			FilePosition += bytesWritten;
+			FileLength = std::max(FileLength, FilePosition);
 			return bytesWritten;
 		}
 
@@ -67,6 +354,36 @@ struct MMapFileInfo
 
 	bool SetFilePointer(int64_t Offset, int64_t *NewPosition, uint32_t Method)
 	{
+		if (IsMMap())
+		{
+			// The length is known, so seeking doesn't need a system call
+			int64_t base = 0;
+
+			switch (Method)
+			{
+			case SEEK_SET: base = 0; break;
+			case SEEK_CUR: base = FilePosition; break;
+			case SEEK_END: base = FileLength; break;
+
+			default:
+				Assert(false);
+				return false;
+			}
+
+			if (base + Offset < 0)
+			{
+				SetLastError(ERROR_NEGATIVE_SEEK);
+				return false;
+			}
+
+			if (NewPosition)
+				*NewPosition = base + Offset;
+
+			FilePosition = base + Offset;
+			PositionDirty = true;
+			return true;
+		}
+
 		switch (Method)
 		{
 		case SEEK_SET: Method = FILE_BEGIN; break;
@@ -78,6 +395,8 @@ struct MMapFileInfo
 			return false;
 		}
 
+		SyncFilePointer();
+
 		LARGE_INTEGER move;
 		LARGE_INTEGER position;
 		move.QuadPart = Offset;
@@ -96,8 +415,9 @@ struct MMapFileInfo
 
 	bool Flush()
 	{
+		// Views are read-only, nothing to write back
 		if (IsMMap())
-			return FlushViewOfFile(MapBase, 0) != FALSE;
+			return true;
 
 		return FlushFileBuffers(FileHandle) != FALSE;
 	}
@@ -120,23 +440,22 @@ MMapFileInfo *GetFileMMap(HANDLE Input)
 		if (!GetFileSizeEx(Input, &fileSize))
 			Assert(false);
 
-		info = new MMapFileInfo;
+		info = new MMapFileInfo();
 		info->FileHandle = Input;
 		info->FilePosition = 0;
 		info->FileLength = fileSize.QuadPart;
 
-		if (info->FileLength <= 4096)
+		if (info->FileLength <= MMapMinFileSize)
 		{
 			info->MapHandle = nullptr;
-			info->MapBase = nullptr;
 		}
 		else
 		{
-			// Map the entire file into memory all at once
+			// Only the mapping object is created here, views are mapped on demand
 			info->MapHandle = CreateFileMapping(info->FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
-			info->MapBase = MapViewOfFile(info->MapHandle, FILE_MAP_READ, 0, 0, 0);
+			info->MapLength = info->FileLength;
 
-			Assert(info->MapHandle && info->MapBase);
+			Assert(info->MapHandle);
 		}
 
 		g_FileMap.emplace(Input, info);
@@ -157,17 +476,16 @@ MMapFileInfo *GetStdioFileMap(FILE *Input)
 	if (!GET_HANDLE_OVERRIDE(Input))
 		return nullptr;
 
-	HANDLE temp = (HANDLE)((uintptr_t)Input & ~0b11);
-	return GetFileMMap(temp);
+	// The tag is applied to the MMapFileInfo pointer itself, no lookup needed
+	return (MMapFileInfo *)((uintptr_t)Input & ~0b11);
 }
 
 FILE *RegisterFileHandle(HANDLE Input)
 {
-	AssertMsg(((uintptr_t)Input & 0b11) == 0, "Unexpected bits set");
+	MMapFileInfo *info = GetFileMMap(Input);
+	AssertMsg(((uintptr_t)info & 0b11) == 0, "Unexpected bits set");
 
-	FILE *temp = (FILE *)((uintptr_t)Input | 0b11);
-	GetStdioFileMap(temp);
-	return temp;
+	return (FILE *)((uintptr_t)info | 0b11);
 }
 
 BOOL WINAPI hk_ReadFile(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped)
@@ -227,7 +545,7 @@ BOOL WINAPI hk_CloseHandle(HANDLE Input)
 
 		if (info->IsMMap())
 		{
-			UnmapViewOfFile(info->MapBase);
+			info->UnmapWindows();
 			CloseHandle(info->MapHandle);
 		}
 
@@ -410,38 +728,7 @@ size_t hk_fwrite(const void *ptr, size_t size, size_t count, FILE *stream)
 char *hk_fgets(char *str, int count, FILE *stream)
 {
 	if (MMapFileInfo *info = GetStdioFileMap(stream))
-	{
-		if (info->FilePosition == info->FileLength)
-			return nullptr;
-
-		char *source = new char[count + 1];
-		char *sourcePtr = source;
-
-		for (char c; count > 0; count--)
-		{
-			if (hk_fread(&c, sizeof(char), 1, stream) != 1)
-				break;
-
-			// WARNING: By default MSVCRT skips carriage returns when not reading in binary format
-			if (c == '\r')
-			{
-				count--;
-				continue;
-			}
-
-			*source++ = c;
-
-			if (c == '\n')
-				break;
-		}
-
-		*source = '\0';
-
-		strncpy_s(str, count, sourcePtr, _TRUNCATE);
-		delete[] sourcePtr;
-
-		return str;
-	}
+		return info->ReadLine(str, count);
 
 	return VC140_fgets(str, count, stream);
 }
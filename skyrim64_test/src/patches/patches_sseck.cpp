@@ -328,11 +328,13 @@ void Patch_TESVCreationKit()
 	// AllowSaveESM         - Allow saving ESMs directly without version control
 	// AllowMasterESP       - Allow ESP files to act as master files while saving
 	// AllowMultipleMasters - Allow multiple master files to be loaded at once. Alias for bAllowMultipleMasterLoads.
+	// ParallelRecordDecompression - Decompress records of files being loaded on worker threads ahead of the loader
 	//
 	TESFile_CK::AllowSaveESM = g_INI.GetBoolean("CreationKit", "AllowSaveESM", false);
 	TESFile_CK::AllowMasterESP = g_INI.GetBoolean("CreationKit", "AllowMasterESP", false);
+	TESFile_CK::PrefetchCompressedRecords = g_INI.GetBoolean("CreationKit", "ParallelRecordDecompression", false);
 
-	if (TESFile_CK::AllowSaveESM || TESFile_CK::AllowMasterESP)
+	if (TESFile_CK::AllowSaveESM || TESFile_CK::AllowMasterESP || TESFile_CK::PrefetchCompressedRecords)
 	{
 		*(uintptr_t *)&TESFile_CK::LoadTESInfo = Detours::X64::DetourFunctionClass(OFFSET(0x1664CC0, 1530), &TESFile_CK::hk_LoadTESInfo);
 		*(uintptr_t *)&TESFile_CK::WriteTESInfo = Detours::X64::DetourFunctionClass(OFFSET(0x1665520, 1530), &TESFile_CK::hk_WriteTESInfo);
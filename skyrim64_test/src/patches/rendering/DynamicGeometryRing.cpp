@@ -0,0 +1,145 @@
+#include "DynamicGeometryRing.h"
+
+DynamicGeometryRing::DynamicGeometryRing(ID3D11Device *Device, uint32_t BufferSize, uint32_t MaxFrames) : m_Device(Device), m_MaxFrames(MaxFrames)
+{
+	m_Buffer = CreateBuffer(BufferSize);
+	m_Allocator = std::make_unique<RingAllocator>(BufferSize, MaxFrames);
+}
+
+DynamicGeometryRing::~DynamicGeometryRing()
+{
+	// Buffers are expected to be unmapped and unused by now
+	for (auto& retired : m_RetiredBuffers)
+		retired.Buffer->Release();
+
+	if (m_Buffer)
+		m_Buffer->Release();
+}
+
+void *DynamicGeometryRing::MapData(ID3D11DeviceContext *Context, uint32_t AllocationSize, uint32_t *AllocationOffset)
+{
+	AssertMsg(AllocationSize > 0, "Size must be > 0");
+	AssertMsg(!m_Mapped, "Dynamic geometry buffer is already mapped");
+
+	GpuCircularAllocator::Allocation allocation;
+
+	if (!m_Allocator->Allocate(AllocationSize, &allocation))
+	{
+		// Everything else is still in use by the GPU. Don't wait for it.
+		Grow(AllocationSize);
+		Assert(m_Allocator->Allocate(AllocationSize, &allocation));
+	}
+
+	D3D11_MAPPED_SUBRESOURCE resource;
+	Assert(SUCCEEDED(Context->Map(m_Buffer, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &resource)));
+
+	m_Mapped = true;
+	*AllocationOffset = allocation.Offset;
+
+	return (void *)((uintptr_t)resource.pData + allocation.Offset);
+}
+
+void DynamicGeometryRing::UnmapData(ID3D11DeviceContext *Context)
+{
+	if (!m_Mapped)
+		return;
+
+	Context->Unmap(m_Buffer, 0);
+	m_Mapped = false;
+}
+
+void DynamicGeometryRing::SwapFrame(uint32_t FrameIndex)
+{
+	AssertDebug(FrameIndex == m_FrameIndex);
+
+	m_Allocator->SwapFrame(FrameIndex);
+
+	GpuCircularAllocator::Stats stats;
+	m_Allocator->GetStats(&stats);
+
+	m_LastFrameBytes = stats.LastFrameBytes;
+	m_PeakFrameBytes = std::max(m_PeakFrameBytes, m_LastFrameBytes);
+
+	m_FrameIndex = (FrameIndex + 1) % m_MaxFrames;
+}
+
+void DynamicGeometryRing::FreeOldFrame(uint32_t FrameIndex)
+{
+	m_Allocator->FreeOldFrame(FrameIndex);
+
+	// The GPU is done with every draw that could have referenced these
+	for (size_t i = 0; i < m_RetiredBuffers.size();)
+	{
+		if (m_RetiredBuffers[i].FrameIndex != FrameIndex)
+		{
+			i++;
+			continue;
+		}
+
+		m_RetiredBuffers[i].Buffer->Release();
+		m_RetiredBuffers[i] = m_RetiredBuffers.back();
+		m_RetiredBuffers.pop_back();
+	}
+}
+
+void DynamicGeometryRing::BeginFrame()
+{
+	m_Allocator->BeginFrame();
+}
+
+ID3D11Buffer *DynamicGeometryRing::GetBuffer() const
+{
+	return m_Buffer;
+}
+
+void DynamicGeometryRing::GetStats(Stats *Out) const
+{
+	GpuCircularAllocator::Stats stats;
+	m_Allocator->GetStats(&stats);
+
+	Out->Capacity = m_Allocator->GetCapacity();
+	Out->Budget = stats.Budget;
+	Out->LastFrameBytes = m_LastFrameBytes;
+	Out->PeakFrameBytes = m_PeakFrameBytes;
+	Out->GrowCount = m_GrowCount;
+	Out->PendingReleases = (uint32_t)m_RetiredBuffers.size();
+}
+
+ID3D11Buffer *DynamicGeometryRing::CreateBuffer(uint32_t BufferSize)
+{
+	D3D11_BUFFER_DESC desc;
+	desc.ByteWidth = BufferSize;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_VERTEX_BUFFER | D3D11_BIND_INDEX_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = 0;
+	desc.StructureByteStride = 0;
+
+	ID3D11Buffer *buffer;
+	Assert(SUCCEEDED(m_Device->CreateBuffer(&desc, nullptr, &buffer)));
+
+	buffer->SetPrivateData(WKPDID_D3DDebugObjectName, strlen("DynamicGeometryRing"), "DynamicGeometryRing");
+	return buffer;
+}
+
+void DynamicGeometryRing::Grow(uint32_t MinimumSize)
+{
+	uint32_t newSize = m_Allocator->GetCapacity();
+
+	// A frame gets at most its share of the ring
+	while (newSize / m_MaxFrames < m_Allocator->AlignSize(MinimumSize) || newSize <= m_Allocator->GetCapacity())
+	{
+		AssertMsg(newSize < MaxBufferSize, "Dynamic geometry buffer overflow");
+		newSize *= 2;
+	}
+
+	// Draws recorded this frame may still point at the old buffer. Frames before this one retire
+	// first, so this frame's index is the last one that can reference it.
+	m_RetiredBuffers.push_back({ m_Buffer, m_FrameIndex });
+
+	// Nothing in flight uses the new buffer, so its bookkeeping starts over. Frames retired later
+	// give back nothing from it.
+	m_Buffer = CreateBuffer(newSize);
+	m_Allocator = std::make_unique<RingAllocator>(newSize, m_MaxFrames);
+	m_GrowCount++;
+}
\ No newline at end of file
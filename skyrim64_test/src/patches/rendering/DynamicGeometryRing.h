@@ -0,0 +1,78 @@
+#pragma once
+
+#include <memory>
+#include "../../common.h"
+#include "GpuCircularAllocator.h"
+
+//
+// Per-frame vertex data for skinned, particle and other CPU-updated geometry. Every allocation is
+// carved out of one DYNAMIC (VERTEX | INDEX) buffer with WRITE_NO_OVERWRITE maps. Space is given back
+// when the renderer's frame completion query for that frame has signaled, so the CPU never waits on
+// the GPU. Frame regions come from GpuCircularAllocator, same as the shader constant ring. A frame
+// that outgrows its share switches to a buffer twice the size. The old buffer is released once the
+// same frame retires.
+//
+class DynamicGeometryRing
+{
+public:
+	struct Stats
+	{
+		uint32_t Capacity;
+		uint32_t Budget;			// Bytes reserved for the current frame
+		uint32_t LastFrameBytes;
+		uint32_t PeakFrameBytes;
+		uint32_t GrowCount;			// Times a frame found the ring full. The old allocator stalled here.
+		uint32_t PendingReleases;	// Replaced buffers waiting for their frame to retire
+	};
+
+	DynamicGeometryRing(ID3D11Device *Device, uint32_t BufferSize, uint32_t MaxFrames);
+	~DynamicGeometryRing();
+
+	void *MapData(ID3D11DeviceContext *Context, uint32_t AllocationSize, uint32_t *AllocationOffset);
+	void UnmapData(ID3D11DeviceContext *Context);
+	void SwapFrame(uint32_t FrameIndex);
+	void FreeOldFrame(uint32_t FrameIndex);
+	void BeginFrame();
+
+	ID3D11Buffer *GetBuffer() const;
+	void GetStats(Stats *Out) const;
+
+private:
+	const static uint32_t Alignment = 16;
+	const static uint32_t MaxBufferSize = 256 * 1024 * 1024;
+
+	struct RetiredBuffer
+	{
+		ID3D11Buffer *Buffer;
+		uint32_t FrameIndex;		// Released when this frame is freed
+	};
+
+	// Frame regions without overflow pages. A full region grows the buffer instead.
+	class RingAllocator : public GpuCircularAllocator
+	{
+	public:
+		RingAllocator(uint32_t BufferSize, uint32_t MaxFrames) : GpuCircularAllocator(BufferSize, 0, Alignment, MaxFrames)
+		{
+		}
+
+	protected:
+		virtual bool CreatePage(uint32_t Page) override
+		{
+			return false;
+		}
+	};
+
+	ID3D11Buffer *CreateBuffer(uint32_t BufferSize);
+	void Grow(uint32_t MinimumSize);
+
+	ID3D11Device *m_Device;
+	ID3D11Buffer *m_Buffer = nullptr;
+	bool m_Mapped = false;
+	std::unique_ptr<RingAllocator> m_Allocator;
+	const uint32_t m_MaxFrames;
+	std::vector<RetiredBuffer> m_RetiredBuffers;
+	uint32_t m_FrameIndex = 0;		// Index the frame being recorded will be swapped with
+	uint32_t m_LastFrameBytes = 0;
+	uint32_t m_PeakFrameBytes = 0;
+	uint32_t m_GrowCount = 0;
+};
\ No newline at end of file
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+//
+// Offset bookkeeping behind GpuCircularBuffer and DynamicGeometryRing, free of graphics API calls.
+//
+// Every frame gets one contiguous region of the ring. Recording threads bump an atomic offset inside
+// it without taking a lock. The region is sized from the largest frame in recent history. When it
+// runs out, allocations continue in overflow pages that are chained onto the frame and recycled
+// when the frame retires. CreatePage() only runs on the thread that owns the frame (the one calling
+// ReservePages()). Other threads take pages ReservePages() set aside and fail once those run out.
+//
+// A PageSize of 0 turns overflow pages off. Every region then gets the full per-frame share and
+// Allocate() fails once it's used up.
+//
+// SwapFrame() closes the frame, FreeOldFrame() returns space once its fence has signaled and
+// BeginFrame() opens the next region, followed by ReservePages(). None of them may run while
+// another thread is allocating.
+//
+class GpuCircularAllocator
+{
+public:
+	const static uint32_t RingPage = 0;				// Allocation::Page for the ring itself. Overflow pages start at 1.
+	const static uint32_t MaxOverflowPages = 256;
+	const static uint32_t HistoryFrames = 32;
+	const static uint32_t SparePages = 8;			// Kept ready on top of the predicted spill
+
+	struct Allocation
+	{
+		uint32_t Page;
+		uint32_t Offset;
+	};
+
+	struct Stats
+	{
+		uint32_t Budget;				// Bytes reserved for the current frame's region
+		uint32_t LastFrameBytes;		// High-water mark of the last closed frame
+		uint32_t PeakFrameBytes;
+		uint32_t LastOverflowBytes;		// Part of LastFrameBytes that went to overflow pages
+		uint32_t OverflowFrames;		// Frames that needed at least one overflow page
+		uint32_t OverflowPages;			// Pages created so far (they're recycled, not freed)
+	};
+
+private:
+	struct OverflowPage
+	{
+		uint32_t Index;
+		std::atomic_uint32_t Offset;
+	};
+
+	const uint32_t m_Capacity;
+	const uint32_t m_PageSize;
+	const uint32_t m_Alignment;
+	const uint32_t m_MaxFrames;
+	const uint32_t m_MinBudget;
+	const uint32_t m_MaxBudget;
+
+	// Current frame, read by every allocating thread
+	alignas(64) std::atomic_uint32_t m_RegionOffset;
+	std::atomic<OverflowPage *> m_CurrentPage;
+	uint32_t m_RegionBase = 0;
+	uint32_t m_RegionBudget = 0;
+	uint32_t m_RegionPadding = 0;	// Bytes skipped at <END> when the region wrapped to <START>
+
+	// Frame bookkeeping, owned by the thread calling SwapFrame()/FreeOldFrame()/BeginFrame()
+	alignas(64) uint32_t m_Head = 0;
+	uint32_t m_Available;
+	uint32_t *m_FrameCharges;
+	std::vector<OverflowPage *> *m_FramePages;
+	uint32_t m_History[HistoryFrames] = {};
+	uint32_t m_HistoryIndex = 0;
+	uint32_t m_PagesWanted = 0;
+	std::thread::id m_OwnerThread;
+	Stats m_Stats = {};
+
+	std::mutex m_PageMutex;
+	std::vector<OverflowPage *> m_CurrentFramePages;
+	std::vector<OverflowPage *> m_FreePages;
+	OverflowPage m_Pages[MaxOverflowPages];
+	uint32_t m_PageCount = 0;
+
+public:
+	GpuCircularAllocator(uint32_t BufferSize, uint32_t PageSize, uint32_t Alignment, uint32_t MaxFrames) :
+		m_Capacity(BufferSize & ~(Alignment - 1)),
+		m_PageSize(PageSize),
+		m_Alignment(Alignment),
+		m_MaxFrames(MaxFrames),
+		m_MinBudget(PageSize ? std::min<uint32_t>(PageSize, (BufferSize / MaxFrames) & ~(Alignment - 1)) : (BufferSize / MaxFrames) & ~(Alignment - 1)),
+		m_MaxBudget((BufferSize / MaxFrames) & ~(Alignment - 1)),
+		m_Available(m_Capacity)
+	{
+		m_FrameCharges = new uint32_t[MaxFrames]();
+		m_FramePages = new std::vector<OverflowPage *>[MaxFrames];
+
+		m_RegionOffset.store(0, std::memory_order_relaxed);
+		m_CurrentPage.store(nullptr, std::memory_order_relaxed);
+
+		// No history yet: start with the largest budget
+		std::fill(std::begin(m_History), std::end(m_History), m_MaxBudget);
+		BeginFrame();
+	}
+
+	virtual ~GpuCircularAllocator()
+	{
+		delete[] m_FrameCharges;
+		delete[] m_FramePages;
+	}
+
+	GpuCircularAllocator(const GpuCircularAllocator&) = delete;
+	GpuCircularAllocator& operator=(const GpuCircularAllocator&) = delete;
+
+	uint32_t AlignSize(uint32_t Size) const
+	{
+		return (Size + m_Alignment - 1) & ~(m_Alignment - 1);
+	}
+
+	// Thread-safe. Size is rounded up to the alignment.
+	bool Allocate(uint32_t Size, Allocation *Out)
+	{
+		Size = AlignSize(Size);
+
+		// Every request bumps the region offset, even the ones that end up in overflow pages. That
+		// makes the final offset the frame's total demand.
+		uint32_t offset = m_RegionOffset.fetch_add(Size, std::memory_order_relaxed);
+
+		if ((uint64_t)offset + Size <= m_RegionBudget)
+		{
+			Out->Page = RingPage;
+			Out->Offset = m_RegionBase + offset;
+			return true;
+		}
+
+		return AllocateOverflow(Size, Out);
+	}
+
+	void SwapFrame(uint32_t FrameIndex)
+	{
+		uint32_t demand = m_RegionOffset.load(std::memory_order_acquire);
+		uint32_t used = std::min(demand, m_RegionBudget);
+
+		// Unused budget goes straight back to the ring
+		m_FrameCharges[FrameIndex] = m_RegionPadding + used;
+		m_Available += m_RegionBudget - used;
+		m_Head = m_RegionBase + used;
+
+		{
+			std::lock_guard<std::mutex> lock(m_PageMutex);
+
+			m_FramePages[FrameIndex].swap(m_CurrentFramePages);
+			m_CurrentFramePages.clear();
+			m_CurrentPage.store(nullptr, std::memory_order_relaxed);
+		}
+
+		m_History[m_HistoryIndex] = demand;
+		m_HistoryIndex = (m_HistoryIndex + 1) % HistoryFrames;
+
+		m_Stats.LastFrameBytes = demand;
+		m_Stats.PeakFrameBytes = std::max(m_Stats.PeakFrameBytes, demand);
+		m_Stats.LastOverflowBytes = demand - used;
+
+		if (!m_FramePages[FrameIndex].empty())
+			m_Stats.OverflowFrames++;
+
+		m_RegionBudget = 0;
+		m_RegionPadding = 0;
+	}
+
+	void FreeOldFrame(uint32_t FrameIndex)
+	{
+		m_Available += m_FrameCharges[FrameIndex];
+		m_FrameCharges[FrameIndex] = 0;
+
+		std::lock_guard<std::mutex> lock(m_PageMutex);
+
+		m_FreePages.insert(m_FreePages.end(), m_FramePages[FrameIndex].begin(), m_FramePages[FrameIndex].end());
+		m_FramePages[FrameIndex].clear();
+	}
+
+	void BeginFrame()
+	{
+		// Largest recent frame plus 25% headroom
+		uint32_t target = *std::max_element(std::begin(m_History), std::end(m_History));
+		target = AlignSize(std::clamp<uint32_t>(target + target / 4, m_MinBudget, m_MaxBudget));
+
+		uint32_t base = m_Head;
+		uint32_t padding = 0;
+		uint32_t budget = std::min({ target, m_Capacity - m_Head, m_Available });
+
+		// Space at <START> only exists if the oldest frame isn't stored there (tail <= head)
+		if (budget < target && m_Head != 0 && m_Available > m_Capacity - m_Head)
+		{
+			uint32_t wrapBudget = std::min(target, m_Available - (m_Capacity - m_Head));
+
+			if (wrapBudget > budget)
+			{
+				padding = m_Capacity - m_Head;
+				base = 0;
+				budget = wrapBudget;
+			}
+		}
+
+		budget &= ~(m_Alignment - 1);
+		m_Available -= padding + budget;
+
+		m_RegionBase = base;
+		m_RegionBudget = budget;
+		m_RegionPadding = padding;
+		m_RegionOffset.store(0, std::memory_order_release);
+
+		// Whatever the region couldn't fit is expected to spill
+		if (m_PageSize)
+			m_PagesWanted = SparePages + (target - budget + m_PageSize - 1) / m_PageSize;
+
+		m_Stats.Budget = budget;
+	}
+
+	// Creates pages until the free list covers what BeginFrame() expects this frame to spill
+	void ReservePages()
+	{
+		std::lock_guard<std::mutex> lock(m_PageMutex);
+
+		m_OwnerThread = std::this_thread::get_id();
+
+		while (m_FreePages.size() < m_PagesWanted)
+		{
+			OverflowPage *page = NewPage();
+
+			if (!page)
+				break;
+
+			m_FreePages.push_back(page);
+		}
+	}
+
+	void GetStats(Stats *Out) const
+	{
+		*Out = m_Stats;
+		Out->OverflowPages = m_PageCount;
+	}
+
+	uint32_t GetCapacity() const
+	{
+		return m_Capacity;
+	}
+
+	uint32_t GetPageSize() const
+	{
+		return m_PageSize;
+	}
+
+	uint32_t GetAlignment() const
+	{
+		return m_Alignment;
+	}
+
+protected:
+	// Called with the page lock held, on the thread that last called ReservePages(). Page is 1-based.
+	virtual bool CreatePage(uint32_t Page) = 0;
+
+private:
+	OverflowPage *NewPage()
+	{
+		if (m_PageCount >= MaxOverflowPages || !CreatePage(m_PageCount + 1))
+			return nullptr;
+
+		OverflowPage *page = &m_Pages[m_PageCount];
+		page->Index = ++m_PageCount;
+
+		return page;
+	}
+
+	bool AllocateOverflow(uint32_t Size, Allocation *Out)
+	{
+		if (Size > m_PageSize)
+			return false;
+
+		for (;;)
+		{
+			OverflowPage *page = m_CurrentPage.load(std::memory_order_acquire);
+
+			if (page)
+			{
+				uint32_t offset = page->Offset.fetch_add(Size, std::memory_order_relaxed);
+
+				if ((uint64_t)offset + Size <= m_PageSize)
+				{
+					Out->Page = page->Index;
+					Out->Offset = offset;
+					return true;
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(m_PageMutex);
+
+			// Another thread already chained a new page
+			if (m_CurrentPage.load(std::memory_order_relaxed) != page)
+				continue;
+
+			OverflowPage *next = nullptr;
+
+			if (!m_FreePages.empty())
+			{
+				next = m_FreePages.back();
+				m_FreePages.pop_back();
+			}
+			else if (std::this_thread::get_id() == m_OwnerThread)
+			{
+				next = NewPage();
+			}
+
+			if (!next)
+				return false;
+
+			next->Offset.store(0, std::memory_order_relaxed);
+			m_CurrentFramePages.push_back(next);
+			m_CurrentPage.store(next, std::memory_order_release);
+		}
+	}
+};
\ No newline at end of file
@@ -1,88 +1,91 @@
 #include "GpuCircularBuffer.h"
 
-GpuCircularBuffer::GpuCircularBuffer(ID3D11Device *Device, uint32_t Type, uint32_t BufferSize, uint32_t MaxFrames)
+// *SSetConstantBuffers1 offsets and sizes are counted in units of 16 constants (256 bytes)
+const static uint32_t ConstantBufferAlignment = 256;
+const static uint32_t DefaultAlignment = 16;
+
+GpuCircularBuffer::GpuCircularBuffer(ID3D11Device *Device, ID3D11DeviceContext *Context, uint32_t Type, uint32_t BufferSize, uint32_t MaxFrames) :
+	GpuCircularAllocator(BufferSize, OverflowPageSize, (Type & D3D11_BIND_CONSTANT_BUFFER) ? ConstantBufferAlignment : DefaultAlignment, MaxFrames),
+	m_Device(Device),
+	m_Context(Context),
+	m_Type(Type)
 {
-	memset(&Map, 0, sizeof(Map));
-	memset(&Description, 0, sizeof(Description));
+	// Buffers stay mapped for their whole lifetime
+	m_Buffers[RingPage].Buffer = CreateBuffer(GetCapacity(), "GpuCircularBuffer");
+	Assert(MapBuffer(m_Buffers[RingPage]));
 
-	// Request GPU-side allocation
-	Description.ByteWidth = BufferSize;
-	Description.Usage = D3D11_USAGE_DYNAMIC;
-	Description.BindFlags = Type;
-	Description.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	Description.MiscFlags = 0;
-	Description.StructureByteStride = 0;
-	Assert(SUCCEEDED(Device->CreateBuffer(&Description, nullptr, &D3DBuffer)));
-
-	FrameUtilizedAmounts = new uint32_t[MaxFrames];
-	CurrentAvailable = BufferSize;
-
-	D3DBuffer->SetPrivateData(WKPDID_D3DDebugObjectName, strlen("GpuCircularBuffer"), "GpuCircularBuffer");
+	ReservePages();
 }
 
 GpuCircularBuffer::~GpuCircularBuffer()
 {
-	// Buffer is expected to be unmapped across all contexts by now
-	if (D3DBuffer)
+	// Buffers are expected to be unused by now
+	for (auto& entry : m_Buffers)
 	{
-		D3DBuffer->Release();
-		D3DBuffer = nullptr;
-	}
+		if (!entry.Buffer)
+			continue;
 
-	delete[] FrameUtilizedAmounts;
-	FrameUtilizedAmounts = nullptr;
-}
+		if (entry.Data)
+			m_Context->Unmap(entry.Buffer, 0);
 
-void *GpuCircularBuffer::MapData(ID3D11DeviceContext *Context, uint32_t AllocationSize, uint32_t *AllocationOffset, bool ForceRemap)
-{
-	Assert(AllocationSize % 16 == 0);
-
-	//
-	// Allocation boundaries are linear - they don't wrap around to the beginning:
-	//
-	// <START> ||Free   ||F1 In Use||F2 In Use||F3 In Use||Free     || <END>
-	//
-	if (CurrentOffset + AllocationSize >= Description.ByteWidth)
-	{
-		// We exceeded <END> so let's try an allocation from <START>
-		CurrentUtilized += Description.ByteWidth - CurrentOffset;
-		CurrentOffset = 0;
+		entry.Buffer->Release();
 	}
+}
 
-	uint32_t newSize = CurrentUtilized + AllocationSize;
-	uint32_t allocBase = CurrentOffset;
-	AssertMsg(newSize <= CurrentAvailable, "Allocation would exceed available free data for this frame");
-
-	// Allow the buffer to stay mapped across multiple function calls
-	if (ForceRemap || !Map.pData)
-		Assert(SUCCEEDED(Context->Map(D3DBuffer, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &Map)));
+void *GpuCircularBuffer::MapData(uint32_t AllocationSize, ID3D11Buffer **Buffer, uint32_t *AllocationOffset)
+{
+	Allocation allocation;
+	AssertMsg(Allocate(AllocationSize, &allocation), "Unable to allocate from GPU ring buffer or its overflow pages");
 
-	CurrentUtilized = newSize;
-	CurrentOffset += AllocationSize;
+	// Filled in by ReservePages() or by this thread, before the page pointer was published
+	const MappedBuffer& entry = m_Buffers[allocation.Page];
 
-	if (AllocationOffset)
-		*AllocationOffset = allocBase;
+	*Buffer = entry.Buffer;
+	*AllocationOffset = allocation.Offset;
 
-	return (void *)((uintptr_t)Map.pData + allocBase);
+	return (void *)((uintptr_t)entry.Data + allocation.Offset);
 }
 
-void GpuCircularBuffer::UnmapData(ID3D11DeviceContext *Context)
+bool GpuCircularBuffer::CreatePage(uint32_t Page)
 {
-	if (!Map.pData)
-		return;
+	MappedBuffer& entry = m_Buffers[Page];
+	entry.Buffer = CreateBuffer(GetPageSize(), "GpuCircularBuffer overflow page");
 
-	Context->Unmap(D3DBuffer, 0);
-	memset(&Map, 0, sizeof(Map));
+	if (!MapBuffer(entry))
+	{
+		entry.Buffer->Release();
+		entry.Buffer = nullptr;
+		return false;
+	}
+
+	return true;
 }
 
-void GpuCircularBuffer::SwapFrame(uint32_t FrameIndex)
+ID3D11Buffer *GpuCircularBuffer::CreateBuffer(uint32_t BufferSize, const char *Name)
 {
-	FrameUtilizedAmounts[FrameIndex] = CurrentUtilized;
-	CurrentAvailable -= CurrentUtilized;
-	CurrentUtilized = 0;
+	// Request GPU-side allocation
+	D3D11_BUFFER_DESC desc;
+	desc.ByteWidth = BufferSize;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = m_Type;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = 0;
+	desc.StructureByteStride = 0;
+
+	ID3D11Buffer *buffer;
+	Assert(SUCCEEDED(m_Device->CreateBuffer(&desc, nullptr, &buffer)));
+
+	buffer->SetPrivateData(WKPDID_D3DDebugObjectName, (UINT)strlen(Name), Name);
+	return buffer;
 }
 
-void GpuCircularBuffer::FreeOldFrame(uint32_t FrameIndex)
+bool GpuCircularBuffer::MapBuffer(MappedBuffer& Entry)
 {
-	CurrentAvailable += FrameUtilizedAmounts[FrameIndex];
-}
+	D3D11_MAPPED_SUBRESOURCE map;
+
+	if (FAILED(m_Context->Map(Entry.Buffer, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &map)))
+		return false;
+
+	Entry.Data = map.pData;
+	return true;
+}
\ No newline at end of file
@@ -1,28 +1,45 @@
 #pragma once
 
 #include "../../common.h"
+#include "GpuCircularAllocator.h"
 
 //
 // Idea implemented from http://gamedevs.org/uploads/efficient-buffer-management.pdf
 // "Dont Throw it all Away: Efficient Buffer Management"
 //
-class GpuCircularBuffer
+// One DYNAMIC buffer that stays mapped with WRITE_NO_OVERWRITE. Offsets come from GpuCircularAllocator,
+// so any thread may call MapData(). Frames that outgrow their budget spill into smaller overflow
+// buffers, which is why MapData() returns the buffer along with the offset.
+//
+// The device context isn't thread-safe, so it's only used on the render thread: the ring is mapped
+// when it's created and overflow pages by ReservePages(). Past those, only the render thread's own
+// MapData() calls may create pages.
+//
+class GpuCircularBuffer : public GpuCircularAllocator
 {
 public:
-	D3D11_MAPPED_SUBRESOURCE Map;
-	D3D11_BUFFER_DESC Description;
-	ID3D11Buffer *D3DBuffer = nullptr;
-
-	uint32_t *FrameUtilizedAmounts = nullptr;	// History tracker for how many bytes each frame is using
-	uint32_t CurrentOffset = 0;					// Byte offset into the buffer
-	uint32_t CurrentUtilized = 0;				// Number of bytes possibly in use by GPU (cannot be written)
-	uint32_t CurrentAvailable = 0;				// Number of unused bytes (as guaranteed by Initialize()/FreeOldFrame())
-
-	GpuCircularBuffer(ID3D11Device *Device, uint32_t Type, uint32_t BufferSize, uint32_t MaxFrames);
-	~GpuCircularBuffer();
-
-	void *MapData(ID3D11DeviceContext *Context, uint32_t AllocationSize, uint32_t *AllocationOffset, bool ForceRemap);
-	void UnmapData(ID3D11DeviceContext *Context);
-	void SwapFrame(uint32_t FrameIndex);
-	void FreeOldFrame(uint32_t FrameIndex);
+	const static uint32_t OverflowPageSize = 256 * 1024;
+
+	GpuCircularBuffer(ID3D11Device *Device, ID3D11DeviceContext *Context, uint32_t Type, uint32_t BufferSize, uint32_t MaxFrames);
+	virtual ~GpuCircularBuffer();
+
+	void *MapData(uint32_t AllocationSize, ID3D11Buffer **Buffer, uint32_t *AllocationOffset);
+
+protected:
+	virtual bool CreatePage(uint32_t Page) override;
+
+private:
+	struct MappedBuffer
+	{
+		ID3D11Buffer *Buffer;
+		void *Data;
+	};
+
+	ID3D11Buffer *CreateBuffer(uint32_t BufferSize, const char *Name);
+	bool MapBuffer(MappedBuffer& Entry);
+
+	ID3D11Device *m_Device;
+	ID3D11DeviceContext *m_Context;		// Immediate context, only used on the render thread
+	uint32_t m_Type;
+	MappedBuffer m_Buffers[1 + MaxOverflowPages] = {};
 };
\ No newline at end of file
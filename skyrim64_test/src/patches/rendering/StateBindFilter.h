@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+//
+// Shadow copy of the pipeline state objects bound to one device context. Each Set*() call records
+// the new binding and returns false if the context already had it, so the bind can be dropped.
+//
+// Renderer::SetDirtyStates() rebinds a whole category whenever any of its dirty bits is set, and
+// the engine sets those bits without checking the old value. The shadow copy catches what that
+// misses. It must see every bind made on its context. Anything that resets or replaces context
+// state without going through it (ClearState, command lists, context state swaps) has to call
+// Invalidate().
+//
+// Pointer equality is enough. A bound state object is referenced by the context, so its address
+// can't be reused while the shadow copy still holds it.
+//
+class StateBindFilter
+{
+public:
+	const static uint32_t SamplerSlotCount = 16;	// D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT
+
+	enum SamplerStage
+	{
+		SAMPLER_STAGE_PS = 0,
+		SAMPLER_STAGE_CS = 1,
+		SAMPLER_STAGE_COUNT,
+	};
+
+private:
+	const void *m_DepthStencilState;
+	uint32_t m_StencilRef;
+
+	const void *m_RasterizerState;
+
+	const void *m_BlendState;
+	float m_BlendFactor[4];
+	uint32_t m_SampleMask;
+
+	const void *m_Samplers[SAMPLER_STAGE_COUNT][SamplerSlotCount];
+	uint32_t m_ValidSamplerSlots[SAMPLER_STAGE_COUNT];
+
+	bool m_DepthStencilValid;
+	bool m_RasterizerValid;
+	bool m_BlendValid;
+
+public:
+	StateBindFilter()
+	{
+		Invalidate();
+	}
+
+	void Invalidate()
+	{
+		m_DepthStencilValid = false;
+		m_RasterizerValid = false;
+		m_BlendValid = false;
+
+		for (uint32_t i = 0; i < SAMPLER_STAGE_COUNT; i++)
+			m_ValidSamplerSlots[i] = 0;
+	}
+
+	bool SetDepthStencilState(const void *State, uint32_t StencilRef)
+	{
+		if (m_DepthStencilValid && m_DepthStencilState == State && m_StencilRef == StencilRef)
+			return false;
+
+		m_DepthStencilState = State;
+		m_StencilRef = StencilRef;
+		m_DepthStencilValid = true;
+		return true;
+	}
+
+	bool SetRasterizerState(const void *State)
+	{
+		if (m_RasterizerValid && m_RasterizerState == State)
+			return false;
+
+		m_RasterizerState = State;
+		m_RasterizerValid = true;
+		return true;
+	}
+
+	bool SetBlendState(const void *State, const float *BlendFactor, uint32_t SampleMask)
+	{
+		// A null blend factor means { 1, 1, 1, 1 }
+		const static float defaultFactor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+		if (!BlendFactor)
+			BlendFactor = defaultFactor;
+
+		if (m_BlendValid && m_BlendState == State && m_SampleMask == SampleMask && memcmp(m_BlendFactor, BlendFactor, sizeof(m_BlendFactor)) == 0)
+			return false;
+
+		m_BlendState = State;
+		memcpy(m_BlendFactor, BlendFactor, sizeof(m_BlendFactor));
+		m_SampleMask = SampleMask;
+		m_BlendValid = true;
+		return true;
+	}
+
+	bool SetSamplers(SamplerStage Stage, uint32_t StartSlot, uint32_t Count, const void *const *Samplers)
+	{
+		// Out of range calls are passed through untouched. The runtime rejects them anyway.
+		if (StartSlot >= SamplerSlotCount || Count > SamplerSlotCount - StartSlot || !Samplers)
+			return true;
+
+		bool changed = false;
+
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			uint32_t slot = StartSlot + i;
+
+			if ((m_ValidSamplerSlots[Stage] & (1u << slot)) && m_Samplers[Stage][slot] == Samplers[i])
+				continue;
+
+			m_Samplers[Stage][slot] = Samplers[i];
+			m_ValidSamplerSlots[Stage] |= 1u << slot;
+			changed = true;
+		}
+
+		return changed;
+	}
+};
\ No newline at end of file
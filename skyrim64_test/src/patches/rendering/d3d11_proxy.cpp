@@ -2,6 +2,42 @@
 #include "../TES/BSGraphics/BSGraphicsRenderer.h"
 #include "d3d11_proxy.h"
 
+//
+// The immediate context is wrapped twice (device creation and D3D11DeviceProxy). Both wrappers must
+// see the same bound state, so filters are looked up by the real context.
+//
+SRWLOCK StateFilterLock = SRWLOCK_INIT;
+std::unordered_map<ID3D11DeviceContext2 *, std::pair<StateBindFilter *, uint32_t>> StateFilters;
+
+StateBindFilter *AcquireStateFilter(ID3D11DeviceContext2 *Context)
+{
+	AcquireSRWLockExclusive(&StateFilterLock);
+
+	auto& entry = StateFilters[Context];
+
+	if (!entry.first)
+		entry.first = new StateBindFilter();
+
+	entry.second++;
+	StateBindFilter *filter = entry.first;
+
+	ReleaseSRWLockExclusive(&StateFilterLock);
+	return filter;
+}
+
+void ReleaseStateFilter(ID3D11DeviceContext2 *Context)
+{
+	AcquireSRWLockExclusive(&StateFilterLock);
+
+	if (auto itr = StateFilters.find(Context); itr != StateFilters.end() && --itr->second.second == 0)
+	{
+		delete itr->second.first;
+		StateFilters.erase(itr);
+	}
+
+	ReleaseSRWLockExclusive(&StateFilterLock);
+}
+
 // ***************************************** //
 //											 //
 // D3D11DeviceProxy							 //
@@ -362,6 +398,8 @@ D3D11DeviceContextProxy::D3D11DeviceContextProxy(ID3D11DeviceContext *Context)
 
 	if (!SUCCEEDED(hr))
 		m_UserAnnotation = nullptr;
+
+	m_StateFilter = AcquireStateFilter(m_Context);
 }
 
 D3D11DeviceContextProxy::D3D11DeviceContextProxy(ID3D11DeviceContext2 *Context)
@@ -373,6 +411,8 @@ D3D11DeviceContextProxy::D3D11DeviceContextProxy(ID3D11DeviceContext2 *Context)
 
 	if (!SUCCEEDED(hr))
 		m_UserAnnotation = nullptr;
+
+	m_StateFilter = AcquireStateFilter(m_Context);
 }
 
 // IUnknown
@@ -399,6 +439,8 @@ ULONG STDMETHODCALLTYPE D3D11DeviceContextProxy::Release()
 			m_UserAnnotation = nullptr;
 		}
 
+		ReleaseStateFilter(m_Context);
+
 		m_Context = nullptr;
 		delete this;
 	}
@@ -445,6 +487,14 @@ void STDMETHODCALLTYPE D3D11DeviceContextProxy::PSSetShader(ID3D11PixelShader *p
 
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::PSSetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState *const *ppSamplers)
 {
+	ProfileCounterInc("Sampler Binds");
+
+	if (!m_StateFilter->SetSamplers(StateBindFilter::SAMPLER_STAGE_PS, StartSlot, NumSamplers, (const void *const *)ppSamplers) && ui::opt::EnableStateBindFilter)
+	{
+		ProfileCounterInc("Sampler Binds Filtered");
+		return;
+	}
+
 	m_Context->PSSetSamplers(StartSlot, NumSamplers, ppSamplers);
 }
 
@@ -578,11 +628,27 @@ void STDMETHODCALLTYPE D3D11DeviceContextProxy::OMSetRenderTargetsAndUnorderedAc
 
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::OMSetBlendState(ID3D11BlendState *pBlendState, const FLOAT BlendFactor[4], UINT SampleMask)
 {
+	ProfileCounterInc("Blend Binds");
+
+	if (!m_StateFilter->SetBlendState(pBlendState, BlendFactor, SampleMask) && ui::opt::EnableStateBindFilter)
+	{
+		ProfileCounterInc("Blend Binds Filtered");
+		return;
+	}
+
 	m_Context->OMSetBlendState(pBlendState, BlendFactor, SampleMask);
 }
 
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::OMSetDepthStencilState(ID3D11DepthStencilState *pDepthStencilState, UINT StencilRef)
 {
+	ProfileCounterInc("Depth Binds");
+
+	if (!m_StateFilter->SetDepthStencilState(pDepthStencilState, StencilRef) && ui::opt::EnableStateBindFilter)
+	{
+		ProfileCounterInc("Depth Binds Filtered");
+		return;
+	}
+
 	m_Context->OMSetDepthStencilState(pDepthStencilState, StencilRef);
 }
 
@@ -628,6 +694,14 @@ void STDMETHODCALLTYPE D3D11DeviceContextProxy::DispatchIndirect(ID3D11Buffer *p
 
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::RSSetState(ID3D11RasterizerState *pRasterizerState)
 {
+	ProfileCounterInc("Raster Binds");
+
+	if (!m_StateFilter->SetRasterizerState(pRasterizerState) && ui::opt::EnableStateBindFilter)
+	{
+		ProfileCounterInc("Raster Binds Filtered");
+		return;
+	}
+
 	m_Context->RSSetState(pRasterizerState);
 }
 
@@ -703,6 +777,10 @@ void STDMETHODCALLTYPE D3D11DeviceContextProxy::ResolveSubresource(ID3D11Resourc
 
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::ExecuteCommandList(ID3D11CommandList *pCommandList, BOOL RestoreContextState)
 {
+	// Without a restore, the context is left in its default state
+	if (!RestoreContextState)
+		m_StateFilter->Invalidate();
+
 	m_Context->ExecuteCommandList(pCommandList, RestoreContextState);
 }
 
@@ -763,6 +841,14 @@ void STDMETHODCALLTYPE D3D11DeviceContextProxy::CSSetShader(ID3D11ComputeShader
 
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::CSSetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState *const *ppSamplers)
 {
+	ProfileCounterInc("Sampler Binds");
+
+	if (!m_StateFilter->SetSamplers(StateBindFilter::SAMPLER_STAGE_CS, StartSlot, NumSamplers, (const void *const *)ppSamplers) && ui::opt::EnableStateBindFilter)
+	{
+		ProfileCounterInc("Sampler Binds Filtered");
+		return;
+	}
+
 	m_Context->CSSetSamplers(StartSlot, NumSamplers, ppSamplers);
 }
 
@@ -963,6 +1049,7 @@ void STDMETHODCALLTYPE D3D11DeviceContextProxy::CSGetConstantBuffers(UINT StartS
 
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::ClearState()
 {
+	m_StateFilter->Invalidate();
 	m_Context->ClearState();
 }
 
@@ -978,6 +1065,9 @@ UINT STDMETHODCALLTYPE D3D11DeviceContextProxy::GetContextFlags()
 
 HRESULT STDMETHODCALLTYPE D3D11DeviceContextProxy::FinishCommandList(BOOL RestoreDeferredContextState, ID3D11CommandList **ppCommandList)
 {
+	if (!RestoreDeferredContextState)
+		m_StateFilter->Invalidate();
+
 	return m_Context->FinishCommandList(RestoreDeferredContextState, ppCommandList);
 }
 
@@ -1069,6 +1159,7 @@ void STDMETHODCALLTYPE D3D11DeviceContextProxy::CSGetConstantBuffers1(UINT Start
 
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::SwapDeviceContextState(ID3DDeviceContextState *pState, ID3DDeviceContextState **ppPreviousState)
 {
+	m_StateFilter->Invalidate();
 	m_Context->SwapDeviceContextState(pState, ppPreviousState);
 }
 
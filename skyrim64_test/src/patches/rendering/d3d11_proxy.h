@@ -1,6 +1,7 @@
 #pragma once
 
 #include <d3d11_2.h>
+#include "StateBindFilter.h"
 
 struct D3D11DeviceProxy;
 struct D3D11DeviceContextProxy;
@@ -80,6 +81,7 @@ struct D3D11DeviceContextProxy : ID3D11DeviceContext2
 {
 	ID3D11DeviceContext2 *m_Context;
 	ID3DUserDefinedAnnotation *m_UserAnnotation;
+	StateBindFilter *m_StateFilter;		// Shared by every proxy of m_Context
 
 	D3D11DeviceContextProxy(ID3D11DeviceContext *Context);
 	D3D11DeviceContextProxy(ID3D11DeviceContext2 *Context);
@@ -13,6 +13,20 @@ namespace Profiler
         std::unordered_map<uint32_t, Entry *> LookupMap;
         int64_t QpcFrequency;
 		int64_t CpuFrequency;
+		std::atomic_bool CaptureEnabled;
+		std::atomic<uint64_t> CaptureStartTime;		// Events older than this belong to a previous capture
+
+		struct ThreadShardGuard
+		{
+			~ThreadShardGuard();
+		};
+
+		SRWLOCK ShardLock = SRWLOCK_INIT;
+		ThreadShard *ShardHead;
+		std::atomic<int64_t> RetiredValues[MaxEntries];	// Totals inherited from exited threads
+
+		thread_local bool TLSShardReleased;
+		thread_local ThreadShardGuard TLSShardGuard;
 
 		void ReadCounters(int64_t& TSC, int64_t& QPC)
 		{
@@ -92,6 +106,134 @@ namespace Profiler
 			CalibrateRDTSC();
 		});
 
+		ThreadShard *CreateShard()
+		{
+			if (TLSShardReleased)
+				return nullptr;
+
+			// Zero filled by the OS. Pages of counters that are never touched never become resident.
+			auto shard = (ThreadShard *)VirtualAlloc(nullptr, sizeof(ThreadShard), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+			if (!shard)
+				return nullptr;
+
+			shard->ThreadId = GetCurrentThreadId();
+
+			AcquireSRWLockExclusive(&ShardLock);
+			{
+				shard->Next = ShardHead;
+
+				if (ShardHead)
+					ShardHead->Prev = shard;
+
+				ShardHead = shard;
+			}
+			ReleaseSRWLockExclusive(&ShardLock);
+
+			// Touching the guard registers its destructor for this thread
+			(void)&TLSShardGuard;
+			TLSShard = shard;
+			return shard;
+		}
+
+		void FreeShard(ThreadShard *Shard)
+		{
+			if (Shard->Events)
+				VirtualFree(Shard->Events, 0, MEM_RELEASE);
+
+			VirtualFree(Shard, 0, MEM_RELEASE);
+		}
+
+		ThreadShardGuard::~ThreadShardGuard()
+		{
+			ThreadShard *shard = TLSShard;
+
+			TLSShard = nullptr;
+			TLSShardReleased = true;
+
+			if (!shard)
+				return;
+
+			bool keepEvents = false;
+
+			// Readers hold the lock shared, so they never see a value in both places
+			AcquireSRWLockExclusive(&ShardLock);
+			{
+				for (uint32_t i = 0; i < MaxEntries; i++)
+				{
+					if (int64_t value = shard->Values[i].load(std::memory_order_relaxed); value != 0)
+					{
+						RetiredValues[i].fetch_add(value, std::memory_order_relaxed);
+						shard->Values[i].store(0, std::memory_order_relaxed);
+					}
+				}
+
+				// Captured events stay around until the next capture starts
+				keepEvents = shard->Events != nullptr;
+				shard->Exited = true;
+
+				if (!keepEvents)
+				{
+					if (shard->Prev)
+						shard->Prev->Next = shard->Next;
+					else
+						ShardHead = shard->Next;
+
+					if (shard->Next)
+						shard->Next->Prev = shard->Prev;
+				}
+			}
+			ReleaseSRWLockExclusive(&ShardLock);
+
+			if (!keepEvents)
+				FreeShard(shard);
+		}
+
+		void AddRetired(uint32_t Index, int64_t Value)
+		{
+			RetiredValues[Index].fetch_add(Value, std::memory_order_relaxed);
+		}
+
+		void RecordEvent(uint32_t Index, int64_t Start, int64_t End)
+		{
+			ThreadShard *shard = TLSShard;
+
+			if (!shard)
+				return;
+
+			if (!shard->Events)
+			{
+				shard->Events = (TraceEvent *)VirtualAlloc(nullptr, TraceRingSize * sizeof(TraceEvent), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+				if (!shard->Events)
+					return;
+			}
+
+			// Oldest events are overwritten once the ring wraps
+			uint64_t head = shard->EventHead.load(std::memory_order_relaxed);
+			TraceEvent& event = shard->Events[head & (TraceRingSize - 1)];
+
+			event.Start = Start;
+			event.Duration = (uint32_t)std::min<int64_t>(End - Start, UINT32_MAX);
+			event.Index = Index;
+
+			shard->EventHead.store(head + 1, std::memory_order_release);
+		}
+
+		int64_t SumValue(uint32_t Index)
+		{
+			int64_t total = RetiredValues[Index].load(std::memory_order_relaxed);
+
+			AcquireSRWLockShared(&ShardLock);
+			{
+				for (ThreadShard *shard = ShardHead; shard; shard = shard->Next)
+					total += shard->Values[Index].load(std::memory_order_relaxed);
+			}
+			ReleaseSRWLockShared(&ShardLock);
+
+			return total;
+		}
+
         Entry *FindEntry(uint32_t CRC)
         {
             // Check if it's in the hashmap
@@ -115,14 +257,157 @@ namespace Profiler
 
             return nullptr;
         }
+
+		uint32_t EntryIndex(const Entry *Counter)
+		{
+			return (uint32_t)(Counter - GlobalCounters.data());
+		}
+
+		void WriteJsonString(FILE *File, const char *String)
+		{
+			fputc('"', File);
+
+			for (; *String; String++)
+			{
+				if (*String == '"' || *String == '\\')
+					fputc('\\', File);
+
+				fputc(*String, File);
+			}
+
+			fputc('"', File);
+		}
+
+		template<typename Callback>
+		uint32_t ForEachCapturedEvent(const ThreadShard *Shard, Callback&& Functor)
+		{
+			uint64_t head = Shard->EventHead.load(std::memory_order_acquire);
+			uint64_t count = std::min<uint64_t>(head, TraceRingSize);
+			uint64_t startTime = CaptureStartTime.load();
+			uint32_t visited = 0;
+
+			for (uint64_t i = head - count; i < head; i++)
+			{
+				const TraceEvent& event = Shard->Events[i & (TraceRingSize - 1)];
+
+				if (event.Start >= startTime)
+				{
+					Functor(event);
+					visited++;
+				}
+			}
+
+			return visited;
+		}
+
+		//
+		// Binary layout, little endian:
+		//
+		// char[4]		Magic "SKPT"
+		// uint32_t		Version (1)
+		// int64_t		Ticks per second
+		// uint32_t		Name count
+		// uint32_t		Thread count
+		// Name count times:
+		//	uint32_t	Counter index
+		//	uint16_t	Length, followed by that many characters (no terminator)
+		// Thread count times:
+		//	uint32_t	Thread id
+		//	uint32_t	Event count, followed by that many TraceEvent structures (16 bytes each)
+		//
+		void WriteBinaryTrace(FILE *File)
+		{
+			uint32_t nameCount = 0;
+			uint32_t threadCount = 0;
+
+			for (auto& counter : GlobalCounters)
+				nameCount += counter.Init ? 1 : 0;
+
+			for (ThreadShard *shard = ShardHead; shard; shard = shard->Next)
+				threadCount += shard->Events ? 1 : 0;
+
+			const uint32_t version = 1;
+
+			fwrite("SKPT", 4, 1, File);
+			fwrite(&version, sizeof(version), 1, File);
+			fwrite(&CpuFrequency, sizeof(CpuFrequency), 1, File);
+			fwrite(&nameCount, sizeof(nameCount), 1, File);
+			fwrite(&threadCount, sizeof(threadCount), 1, File);
+
+			for (auto& counter : GlobalCounters)
+			{
+				if (!counter.Init)
+					continue;
+
+				uint32_t index = EntryIndex(&counter);
+				uint16_t length = (uint16_t)strlen(counter.Name);
+
+				fwrite(&index, sizeof(index), 1, File);
+				fwrite(&length, sizeof(length), 1, File);
+				fwrite(counter.Name, length, 1, File);
+			}
+
+			for (ThreadShard *shard = ShardHead; shard; shard = shard->Next)
+			{
+				if (!shard->Events)
+					continue;
+
+				uint32_t eventCount = ForEachCapturedEvent(shard, [](const TraceEvent&) {});
+
+				fwrite(&shard->ThreadId, sizeof(shard->ThreadId), 1, File);
+				fwrite(&eventCount, sizeof(eventCount), 1, File);
+
+				ForEachCapturedEvent(shard, [&](const TraceEvent& Event)
+				{
+					fwrite(&Event, sizeof(TraceEvent), 1, File);
+				});
+			}
+		}
+
+		void WriteChromeTrace(FILE *File)
+		{
+			// Timestamps are relative to the oldest captured event
+			uint64_t baseTime = UINT64_MAX;
+
+			for (ThreadShard *shard = ShardHead; shard; shard = shard->Next)
+			{
+				if (shard->Events)
+					ForEachCapturedEvent(shard, [&](const TraceEvent& Event) { baseTime = std::min(baseTime, Event.Start); });
+			}
+
+			double ticksToMicroseconds = 1000000.0 / (double)CpuFrequency;
+			bool first = true;
+
+			fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", File);
+
+			for (ThreadShard *shard = ShardHead; shard; shard = shard->Next)
+			{
+				if (!shard->Events)
+					continue;
+
+				ForEachCapturedEvent(shard, [&](const TraceEvent& Event)
+				{
+					fputs(first ? "{\"name\":" : ",\n{\"name\":", File);
+					WriteJsonString(File, GlobalCounters[Event.Index].Name);
+					fprintf(File, ",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+						shard->ThreadId,
+						(double)(Event.Start - baseTime) * ticksToMicroseconds,
+						(double)Event.Duration * ticksToMicroseconds);
+
+					first = false;
+				});
+			}
+
+			fputs("\n]}\n", File);
+		}
     }
 
     int64_t GetValue(uint32_t CRC)
     {
         if (auto e = Internal::FindEntry(CRC); e)
         {
-            // e->Value might be updated in the middle of this code
-            int64_t temp = e->Value;
+            // The value might be updated in the middle of this code
+            int64_t temp = Internal::SumValue(Internal::EntryIndex(e));
             e->OldValue  = temp;
             return temp;
         }
@@ -133,7 +418,7 @@ namespace Profiler
 	int64_t GetDeltaValue(uint32_t CRC)
 	{
 		if (auto e = Internal::FindEntry(CRC); e)
-			return e->Value - e->OldValue;
+			return Internal::SumValue(Internal::EntryIndex(e)) - e->OldValue;
 
 		return 0;
 	}
@@ -147,5 +432,73 @@ namespace Profiler
 	{
 		return ((double)GetDeltaValue(CRC) / (double)Internal::CpuFrequency) * 1000.0;
 	}
+
+	void BeginCapture()
+	{
+		using namespace Internal;
+
+		AcquireSRWLockExclusive(&ShardLock);
+		{
+			// Drop shards that were only kept for the previous capture's events. Live rings can't be
+			// reset from here, older events are skipped by timestamp instead.
+			for (ThreadShard *shard = ShardHead, *next; shard; shard = next)
+			{
+				next = shard->Next;
+
+				if (!shard->Exited)
+					continue;
+
+				if (shard->Prev)
+					shard->Prev->Next = shard->Next;
+				else
+					ShardHead = shard->Next;
+
+				if (shard->Next)
+					shard->Next->Prev = shard->Prev;
+
+				FreeShard(shard);
+			}
+
+			uint32_t unused;
+			CaptureStartTime.store(__rdtscp(&unused));
+			CaptureEnabled.store(true);
+		}
+		ReleaseSRWLockExclusive(&ShardLock);
+	}
+
+	void EndCapture()
+	{
+		Internal::CaptureEnabled.store(false);
+	}
+
+	bool IsCapturing()
+	{
+		return Internal::CaptureEnabled.load();
+	}
+
+	bool ExportTrace(const char *FilePath, TraceFormat Format)
+	{
+		using namespace Internal;
+
+		// Timers that are still running may write a few more events. They land in the ring
+		// before or after the snapshot, either is fine.
+		EndCapture();
+
+		FILE *f;
+		if (fopen_s(&f, FilePath, Format == TraceFormat::Binary ? "wb" : "w") != 0)
+			return false;
+
+		AcquireSRWLockShared(&ShardLock);
+		{
+			if (Format == TraceFormat::Binary)
+				WriteBinaryTrace(f);
+			else
+				WriteChromeTrace(f);
+		}
+		ReleaseSRWLockShared(&ShardLock);
+
+		fclose(f);
+		return true;
+	}
 }
 #endif // SKYRIM64_USE_PROFILER
\ No newline at end of file
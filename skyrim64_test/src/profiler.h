@@ -12,6 +12,7 @@
 #else
 #include <intrin.h>
 #include <array>
+#include <atomic>
 #include <unordered_map>
 
 #define EXPAND_MACRO(x) x
@@ -46,17 +47,17 @@ namespace Profiler
 		inline ScopedCounter(const char *File, const char *Function, const char *Name)
 		{
 			if (!m_Entry.Init)
-				m_Entry = { 0, 0, File, Function, Name, true };
+				m_Entry = { 0, File, Function, Name, true };
 
-			InterlockedIncrement64(&m_Entry.Value);
+			Internal::AddValue(UniqueIndex, 1);
 		}
 
 		inline ScopedCounter(const char *File, const char *Function, const char *Name, int64_t Add)
 		{
 			if (!m_Entry.Init)
-				m_Entry = { 0, 0, File, Function, Name, true };
+				m_Entry = { 0, File, Function, Name, true };
 
-			InterlockedAdd64(&m_Entry.Value, Add);
+			Internal::AddValue(UniqueIndex, Add);
 		}
 
 	private:
@@ -86,7 +87,7 @@ namespace Profiler
 		__forceinline ScopedTimer(const char *File, const char *Function, const char *Name)
 		{
 			if (!m_Entry.Init)
-				m_Entry = { 0, 0, File, Function, Name, true };
+				m_Entry = { 0, File, Function, Name, true };
 
 			GetTime(&m_Start);
 		}
@@ -96,7 +97,10 @@ namespace Profiler
 			LARGE_INTEGER endTime;
 			GetTime(&endTime);
 
-			InterlockedAdd64(&m_Entry.Value, endTime.QuadPart - m_Start.QuadPart);
+			Internal::AddValue(UniqueIndex, endTime.QuadPart - m_Start.QuadPart);
+
+			if (Internal::CaptureEnabled.load(std::memory_order_relaxed))
+				Internal::RecordEvent(UniqueIndex, m_Start.QuadPart, endTime.QuadPart);
 		}
 
 	private:
@@ -133,6 +137,17 @@ namespace Profiler
 		return GetDeltaTime(CRC);
 	}
 
+	enum class TraceFormat
+	{
+		Binary,			// See WriteBinaryTrace() in profiler.cpp
+		ChromeTrace,	// JSON for chrome://tracing or https://ui.perfetto.dev
+	};
+
+	void BeginCapture();
+	void EndCapture();
+	bool IsCapturing();
+	bool ExportTrace(const char *FilePath, TraceFormat Format);
+
 	float GetProcessorUsagePercent();
 	float GetThreadUsagePercent();
 	float GetGpuUsagePercent(int GpuIndex = 0);
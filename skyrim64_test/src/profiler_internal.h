@@ -75,18 +75,67 @@ constexpr uint32_t CRC32(const char *in)
 
 struct Entry
 {
-	int64_t Value;
-	int64_t OldValue;		// Only updated after a request to get 'Value'
+	int64_t OldValue;		// Only updated after a request to get the value
 	const char *File;
 	const char *Function;
 	const char *Name;
 	bool Init;
 };
 
+struct TraceEvent
+{
+	uint64_t Start;			// Ticks (RDTSCP)
+	uint32_t Duration;		// Ticks, clamped to UINT32_MAX
+	uint32_t Index;			// GlobalCounters index
+};
+
 constexpr int MaxEntries = 16384;
+constexpr int TraceRingSize = 65536;	// Events kept per thread. Must be a power of two.
+
+//
+// Counters are sharded per thread. Only the owning thread writes to its shard, so increments are
+// plain stores instead of locked instructions and no cache line is ever shared between two
+// writers. Readers sum every live shard plus the totals folded in from threads that exited.
+//
+struct alignas(64) ThreadShard
+{
+	std::atomic<int64_t> Values[MaxEntries];
+	std::atomic<uint64_t> EventHead;
+	TraceEvent *Events;		// Ring buffer, allocated on the first captured event
+	uint32_t ThreadId;
+	bool Exited;
+	ThreadShard *Next;
+	ThreadShard *Prev;
+};
+
 extern std::array<Entry, MaxEntries> GlobalCounters;
 extern std::unordered_map<uint32_t, Entry *> LookupMap;
 extern int64_t CpuFrequency;
+extern std::atomic_bool CaptureEnabled;
+inline thread_local ThreadShard *TLSShard;
+
+ThreadShard *CreateShard();
+void AddRetired(uint32_t Index, int64_t Value);
+void RecordEvent(uint32_t Index, int64_t Start, int64_t End);
+
+__forceinline void AddValue(uint32_t Index, int64_t Value)
+{
+	ThreadShard *shard = TLSShard;
+
+	if (!shard)
+		shard = CreateShard();
+
+	if (!shard)
+	{
+		// Thread is shutting down
+		AddRetired(Index, Value);
+		return;
+	}
+
+	// Single writer, no need for a locked instruction
+	auto& counter = shard->Values[Index];
+	counter.store(counter.load(std::memory_order_relaxed) + Value, std::memory_order_relaxed);
+}
 
 #define COMPILE_TIME_CRC32_STR(x) (Profiler::Internal::XCRCCalculate<sizeof(x)-1>::crc32(x))
 #define COMPILE_TIME_CRC32_INDEX(x) (COMPILE_TIME_CRC32_STR(x) % Profiler::Internal::MaxEntries)
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include "../patches/rendering/GpuTimer.h"
 #include "../patches/TES/TESForm.h"
 #include "../patches/TES/Console.h"
+#include "../patches/TES/SmallBlockHeap.h"
 
 namespace ui::opt
 {
@@ -25,6 +26,11 @@ namespace ui::opt
 	bool EnableOccluderRendering = true;
 	float OccluderMaxDistance = 15000.0f;
 	float OccluderFirstLevelMinSize = 550.0f;
+	int OccluderTriangleBudget = 150000;
+	float OccluderReuseBonus = 1.5f;
+	bool RecordOccluderCandidates = false;
+	bool EnableDrawSorting = true;
+	bool EnableStateBindFilter = true;
 }
 
 namespace ui
@@ -220,6 +226,15 @@ namespace ui
 			ImGui::MenuItem("Synchronization", nullptr, &showLockWindow);
 			ImGui::MenuItem("Memory", nullptr, &showMemoryWindow);
 			ImGui::MenuItem("TESForm Cache", nullptr, &showTESFormWindow);
+#if SKYRIM64_USE_PROFILER
+			ImGui::Separator();
+			if (ImGui::MenuItem("Start Timer Capture", nullptr, nullptr, !Profiler::IsCapturing()))
+				Profiler::BeginCapture();
+			if (ImGui::MenuItem("Export Timer Capture (Chrome)", nullptr, nullptr, Profiler::IsCapturing()))
+				Profiler::ExportTrace("C:\\profiler_trace.json", Profiler::TraceFormat::ChromeTrace);
+			if (ImGui::MenuItem("Export Timer Capture (Binary)", nullptr, nullptr, Profiler::IsCapturing()))
+				Profiler::ExportTrace("C:\\profiler_trace.bin", Profiler::TraceFormat::Binary);
+#endif
 			ImGui::EndMenu();
 		}
 
@@ -483,6 +498,7 @@ namespace ui
                 ImGui::Text("Allocs: %lld", ProfileGetDeltaValue("Alloc Count"));
                 ImGui::Text("Frees: %lld", ProfileGetDeltaValue("Free Count"));
                 ImGui::Text("Bytes: %.3f MB", (double)ProfileGetDeltaValue("Byte Count") / 1024 / 1024);
+                ImGui::Text("Reallocs in place: %lld", ProfileGetDeltaValue("Realloc In Place"));
                 ImGui::Spacing();
                 ImGui::Text("Time spent allocating: %.2fms", ProfileGetDeltaTime("Time Spent Allocating"));
                 ImGui::Text("Time spent freeing: %.2fms", ProfileGetDeltaTime("Time Spent Freeing"));
@@ -497,6 +513,7 @@ namespace ui
                 ImGui::Text("Allocs: %lld", allocCount);
                 ImGui::Text("Frees: %lld", freeCount);
                 ImGui::Text("Bytes: %.3f MB", (double)ProfileGetValue("Byte Count") / 1024 / 1024);
+                ImGui::Text("Reallocs in place: %lld", ProfileGetValue("Realloc In Place"));
                 ImGui::Spacing();
                 ImGui::Text("Time spent allocating: %.2fms", ProfileGetTime("Time Spent Allocating"));
                 ImGui::Text("Time spent freeing: %.2fms", ProfileGetTime("Time Spent Freeing"));
@@ -504,6 +521,58 @@ namespace ui
                 ImGui::Text("Active allocations: %lld", allocCount - freeCount);
                 ImGui::EndGroupSplitter();
             }
+
+            if (ImGui::BeginGroupSplitter("Dynamic Geometry"))
+            {
+                DynamicGeometryRing::Stats stats;
+                BSGraphics::Renderer::QInstance()->GetDynamicVertexBufferStats(&stats);
+
+                ImGui::Text("Capacity: %.3f MB", (double)stats.Capacity / 1024 / 1024);
+                ImGui::Text("Frame budget: %.3f MB", (double)stats.Budget / 1024 / 1024);
+                ImGui::Text("Last frame: %.3f MB", (double)stats.LastFrameBytes / 1024 / 1024);
+                ImGui::Text("Peak frame: %.3f MB", (double)stats.PeakFrameBytes / 1024 / 1024);
+                ImGui::Text("Overflows (grown): %u", stats.GrowCount);
+                ImGui::Text("Pending releases: %u", stats.PendingReleases);
+                ImGui::EndGroupSplitter();
+            }
+
+            if (ImGui::BeginGroupSplitter("Shader Constants"))
+            {
+                GpuCircularAllocator::Stats stats;
+                BSGraphics::Renderer::QInstance()->GetShaderConstantBufferStats(&stats);
+
+                ImGui::Text("Frame budget: %.3f MB", (double)stats.Budget / 1024 / 1024);
+                ImGui::Text("Last frame: %.3f MB", (double)stats.LastFrameBytes / 1024 / 1024);
+                ImGui::Text("Peak frame: %.3f MB", (double)stats.PeakFrameBytes / 1024 / 1024);
+                ImGui::Text("Last frame overflow: %.3f MB", (double)stats.LastOverflowBytes / 1024 / 1024);
+                ImGui::Text("Frames overflowed: %u", stats.OverflowFrames);
+                ImGui::Text("Overflow pages: %u", stats.OverflowPages);
+                ImGui::EndGroupSplitter();
+            }
+
+            if (ImGui::BeginGroupSplitter("Size Classes"))
+            {
+                SmallBlockHeap::SizeClassStats stats[SmallBlockHeap::ClassCount];
+                SmallBlockHeap::GetStats(stats);
+
+                ImGui::BeginChild("sizeclassscrolling", ImVec2(0, 300), false, ImGuiWindowFlags_HorizontalScrollbar);
+
+                for (const auto& entry : stats)
+                {
+                    if (entry.SpanCount <= 0)
+                        continue;
+
+                    ImGui::Text("%4u bytes: %s live, %lld allocs, %lld spans, %lld cached",
+                        entry.BlockSize,
+                        ImGui::CommaFormat(entry.AllocCount - entry.FreeCount),
+                        entry.AllocCount,
+                        entry.SpanCount,
+                        entry.DepotCount);
+                }
+
+                ImGui::EndChild();
+                ImGui::EndGroupSplitter();
+            }
         }
 
         ImGui::End();
@@ -543,6 +612,8 @@ namespace ui
                 ImGui::Spacing();
                 ImGui::Text("Update time: %.2fms", ProfileGetTime("Cache Update Time"));
 				ImGui::Text("Fetch time: %.2fms", ProfileGetTime("Cache Fetch Time"));
+				ImGui::Spacing();
+				ImGui::Text("Pages: %lld (%.2f MB)", ProfileGetValue("Cache Pages"), (ProfileGetValue("Cache Pages") * 8192 * sizeof(uintptr_t)) / (1024.0 * 1024.0));
                 ImGui::EndGroupSplitter();
             }
         }
@@ -557,6 +628,9 @@ namespace ui
 
 		if (ImGui::Begin("Shader Tweaks", &showShaderTweakWindow))
 		{
+			ImGui::Checkbox("Sort draws by state and depth", &opt::EnableDrawSorting);
+			ImGui::Checkbox("Drop redundant state binds", &opt::EnableStateBindFilter);
+			ImGui::Spacing();
 			ImGui::Checkbox("Use original BSLightingShader::Technique", &BSShader::g_ShaderToggles[6][0]);
 			ImGui::Checkbox("Use original BSLightingShader::Material", &BSShader::g_ShaderToggles[6][1]);
 			ImGui::Checkbox("Use original BSLightingShader::Geometry", &BSShader::g_ShaderToggles[6][2]);
@@ -588,20 +662,23 @@ namespace ui
 
 		if (ImGui::Begin("Job List", &showJobListWindow))
 		{
-			// Easy way to sort by name. Pair<total count, current count>.
-			std::map<const std::string, std::pair<uint64_t, uint32_t>> sortedMap;
+			// Easy way to sort by name. Some names are shared by several callbacks, so the offset is part of the key.
+			// Pair<tracking entry, invocations this frame>.
+			std::map<std::pair<std::string, uintptr_t>, std::pair<BSJobs::TrackingInfo *, uint32_t>> sortedMap;
 			int activeJobs = 0;
+			uint32_t runningNow = 0;
 
-			for (auto& [k, v] : BSJobs::JobTracker)
+			BSJobs::ForEachTrackingInfo([&](uintptr_t Offset, BSJobs::TrackingInfo& Info)
 			{
-				uint32_t active = v.ActiveCount.load();
+				uint32_t frameCount = Info.FrameCount.exchange(0);
 
-				if (active > 0)
+				if (frameCount > 0)
 					activeJobs++;
 
-				sortedMap.insert_or_assign(v.Name, std::pair(v.TotalCount.load(), active));
-				v.ActiveCount.store(0);
-			}
+				runningNow += Info.ActiveCount.load();
+
+				sortedMap.insert_or_assign(std::pair(std::string(Info.Name), Offset), std::pair(&Info, frameCount));
+			});
 
 			// Show currently running jobs
 			char header[64];
@@ -609,12 +686,13 @@ namespace ui
 
 			if (ImGui::BeginGroupSplitter(header))
 			{
+				ImGui::Text("Running: %u", runningNow);
 				ImGui::BeginChild("jobscrolling1", ImVec2(0, 300), false, ImGuiWindowFlags_HorizontalScrollbar);
 
 				for (const auto& [k, v] : sortedMap)
 				{
 					if (v.second > 0)
-						ImGui::Text("%s (%d)", k.c_str(), v.second);
+						ImGui::Text("%s (%u)", k.first.c_str(), v.second);
 				}
 
 				ImGui::EndChild();
@@ -624,14 +702,42 @@ namespace ui
 			// Show history
 			if (ImGui::BeginGroupSplitter("Job Counters"))
 			{
+				static bool resetHistograms;
+
+				if (ImGui::Button("Reset Latency"))
+					resetHistograms = true;
+
 				ImGui::BeginChild("jobscrolling2", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
+				ImGui::Columns(5, "jobcolumns");
+				ImGui::Text("Name"); ImGui::NextColumn();
+				ImGui::Text("Count"); ImGui::NextColumn();
+				ImGui::Text("p50 (us)"); ImGui::NextColumn();
+				ImGui::Text("p99 (us)"); ImGui::NextColumn();
+				ImGui::Text("Max (us)"); ImGui::NextColumn();
+				ImGui::Separator();
 
 				for (const auto& [k, v] : sortedMap)
 				{
-					if (v.first > 0)
-						ImGui::Text("%s (%lld)", k.c_str(), v.first);
+					auto& latency = v.first->Latency;
+
+					if (resetHistograms)
+						latency.Reset();
+
+					uint64_t total = v.first->TotalCount.load();
+
+					if (total == 0)
+						continue;
+
+					ImGui::Text("%s", k.first.c_str()); ImGui::NextColumn();
+					ImGui::Text("%llu", total); ImGui::NextColumn();
+					ImGui::Text("%.1f", latency.GetPercentile(50.0) / 1000.0); ImGui::NextColumn();
+					ImGui::Text("%.1f", latency.GetPercentile(99.0) / 1000.0); ImGui::NextColumn();
+					ImGui::Text("%.1f", latency.GetMax() / 1000.0); ImGui::NextColumn();
 				}
 
+				resetHistograms = false;
+
+				ImGui::Columns(1);
 				ImGui::EndChild();
 				ImGui::EndGroupSplitter();
 			}
@@ -13,6 +13,11 @@ namespace ui
 		extern bool EnableOccluderRendering;
 		extern float OccluderMaxDistance;
 		extern float OccluderFirstLevelMinSize;
+		extern int OccluderTriangleBudget;
+		extern float OccluderReuseBonus;
+		extern bool RecordOccluderCandidates;
+		extern bool EnableDrawSorting;
+		extern bool EnableStateBindFilter;
 	}
 
 	extern bool showTracyWindow;
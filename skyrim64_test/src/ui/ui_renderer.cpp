@@ -117,6 +117,38 @@ namespace ui
 			ProfileGetValue("CB Bytes Requested");
 			ProfileGetValue("VIB Bytes Requested");
 			ProfileGetValue("CB Bytes Wasted");
+
+			// State objects. "Dirty" is how often SetDirtyStates() flushed the category, "Binds" is every
+			// bind the context saw (engine code included) and "Redundant" is the part that changed nothing.
+			ImGui::Spacing();
+			ImGui::Columns(4, "StateBinds");
+			ImGui::Text("State"); ImGui::NextColumn();
+			ImGui::Text("Dirty"); ImGui::NextColumn();
+			ImGui::Text("Binds"); ImGui::NextColumn();
+			ImGui::Text("Redundant"); ImGui::NextColumn();
+			ImGui::Separator();
+
+#define STATE_BIND_ROW(Label, DirtyName, BindName) \
+			ImGui::Text(Label); ImGui::NextColumn(); \
+			ImGui::Text("%lld", (int64_t)ProfileGetDeltaValue(DirtyName)); ImGui::NextColumn(); \
+			ImGui::Text("%lld", (int64_t)ProfileGetDeltaValue(BindName)); ImGui::NextColumn(); \
+			ImGui::Text("%lld", (int64_t)ProfileGetDeltaValue(BindName " Filtered")); ImGui::NextColumn(); \
+			ProfileGetValue(DirtyName); \
+			ProfileGetValue(BindName); \
+			ProfileGetValue(BindName " Filtered");
+
+			STATE_BIND_ROW("Depth Stencil", "Dirty Depth", "Depth Binds");
+			STATE_BIND_ROW("Rasterizer", "Dirty Raster", "Raster Binds");
+			STATE_BIND_ROW("Blend", "Dirty Blend", "Blend Binds");
+			STATE_BIND_ROW("Samplers", "Dirty Samplers", "Sampler Binds");
+#undef STATE_BIND_ROW
+
+			ImGui::Columns(1);
+			ImGui::Text("Render target flushes: %lld", (int64_t)ProfileGetDeltaValue("Dirty Render Target"));
+			ImGui::Text("Alpha test flushes: %lld", (int64_t)ProfileGetDeltaValue("Dirty Alpha Test"));
+
+			ProfileGetValue("Dirty Render Target");
+			ProfileGetValue("Dirty Alpha Test");
 		}
 		ImGui::End();
 	}
@@ -197,6 +229,32 @@ namespace ui
 			ImGui::Text("Passed Objects:"); ImGui::NextColumn();
 			ImGui::Text("%s (%.1f%%)", ImGui::CommaFormat(ProfileGetDeltaValue("MOC CullObjectPassed")), culledPercent); ImGui::NextColumn();
 
+			double packetLatency = (double)ProfileGetDeltaValue("MOC PacketLatencyNs") / (double)std::max<uint64_t>(ProfileGetDeltaValue("MOC PacketsStarted"), 1);
+
+			ImGui::Text("Submit To Start:"); ImGui::NextColumn();
+			ImGui::Text("%.1fus", packetLatency / 1000.0); ImGui::NextColumn();
+
+			ImGui::Text("Worker Wakeups:"); ImGui::NextColumn();
+			ImGui::Text("%s", ImGui::CommaFormat(ProfileGetDeltaValue("MOC WorkerWakeups"))); ImGui::NextColumn();
+
+			ImGui::Text("Occluders Built:"); ImGui::NextColumn();
+			ImGui::Text("%s (%.2fms)", ImGui::CommaFormat(ProfileGetDeltaValue("MOC OccludersBuilt")), ProfileGetDeltaTime("MOC BuildOccluder")); ImGui::NextColumn();
+
+			ImGui::Text("Occluders Loaded:"); ImGui::NextColumn();
+			ImGui::Text("%s", ImGui::CommaFormat(ProfileGetDeltaValue("MOC OccludersLoaded"))); ImGui::NextColumn();
+
+			ImGui::Text("Frustum Tests:"); ImGui::NextColumn();
+			ImGui::Text("%s", ImGui::CommaFormat(ProfileGetDeltaValue("MOC FrustumTests"))); ImGui::NextColumn();
+
+			ImGui::Text("Occluder Candidates:"); ImGui::NextColumn();
+			ImGui::Text("%s", ImGui::CommaFormat(ProfileGetDeltaValue("MOC OccluderCandidates"))); ImGui::NextColumn();
+
+			ImGui::Text("Occluders Selected:"); ImGui::NextColumn();
+			ImGui::Text("%s", ImGui::CommaFormat(ProfileGetDeltaValue("MOC OccludersSelected"))); ImGui::NextColumn();
+
+			ImGui::Text("Selected Triangles:"); ImGui::NextColumn();
+			ImGui::Text("%s", ImGui::CommaFormat(ProfileGetDeltaValue("MOC TrianglesSelected"))); ImGui::NextColumn();
+
 			ProfileGetTime("MOC TraverseSceneGraph");
 			ProfileGetTime("MOC WaitForRender");
 			ProfileGetTime("MOC RenderGeometry");
@@ -205,6 +263,16 @@ namespace ui
 			ProfileGetValue("MOC CullObjectCount");
 			ProfileGetValue("MOC TrianglesRendered");
 			ProfileGetValue("MOC CullObjectPassed");
+			ProfileGetValue("MOC PacketLatencyNs");
+			ProfileGetValue("MOC PacketsStarted");
+			ProfileGetValue("MOC WorkerWakeups");
+			ProfileGetTime("MOC BuildOccluder");
+			ProfileGetValue("MOC OccludersBuilt");
+			ProfileGetValue("MOC OccludersLoaded");
+			ProfileGetValue("MOC FrustumTests");
+			ProfileGetValue("MOC OccludersSelected");
+			ProfileGetValue("MOC OccluderCandidates");
+			ProfileGetValue("MOC TrianglesSelected");
 
 			ImGui::Columns(1);
 			ImGui::Separator();
@@ -212,6 +280,9 @@ namespace ui
 			ImGui::Spacing();
 			ImGui::DragFloat("Max 2D Render Distance", &ui::opt::OccluderMaxDistance, 10.0f, 1.0f, 1000000.0f);
 			ImGui::DragFloat("First Level Occluder Size", &ui::opt::OccluderFirstLevelMinSize, 1.0f, 1.0f, 100000.0f);
+			ImGui::DragInt("Occluder Triangle Budget", &ui::opt::OccluderTriangleBudget, 100.0f, 0, 10000000);
+			ImGui::DragFloat("Occluder Reuse Bonus", &ui::opt::OccluderReuseBonus, 0.01f, 1.0f, 10.0f);
+			ImGui::Checkbox("Record Occluder Candidates", &ui::opt::RecordOccluderCandidates);
 			ImGui::Checkbox("Draw Occluders", &ui::opt::EnableOccluderRendering);
 			ImGui::Checkbox("Test Occludees", &ui::opt::EnableOcclusionTesting);
 			ImGui::Checkbox("Disable Viewer Updates", &disableViewerUpdates);